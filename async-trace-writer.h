@@ -0,0 +1,399 @@
+#ifndef ASYNC_TRACE_WRITER_H
+#define ASYNC_TRACE_WRITER_H
+
+#include "ns3/core-module.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace ns3 {
+
+static GlobalValue g_asyncTraceWriter ("asyncTraceWriter",
+                                       "Format and write the trace and statistics files on a background thread",
+                                       BooleanValue (true),
+                                       MakeBooleanChecker ());
+
+// Moves file output off the simulation thread.  The simulation thread pushes
+// fixed-size records into a lock-free single-producer single-consumer ring;
+// a background thread formats them with the formatter of their stream and
+// writes every file in large blocks.  Records of one stream are written in the
+// order they were pushed.  Files written by ns-3 itself (PDCP statistics, REM)
+// are given a named pipe from Relay () instead of their real name, which the
+// same thread drains into the real file.  Everything is flushed when the
+// simulator is destroyed; with asyncTraceWriter = false records are formatted
+// and written directly.
+class AsyncTraceWriter
+{
+public:
+  struct Record
+  {
+    uint32_t stream;
+    uint32_t type;
+    int64_t id;
+    double values[6];
+  };
+  typedef void (*Formatter) (std::string &out, const Record &record);
+
+  static AsyncTraceWriter &Get ();
+
+  // returns the stream id to use in the records, or -1 if the file can't be opened
+  int32_t Open (std::string filename, Formatter formatter);
+  void Write (const Record &record);
+  void Close (uint32_t stream);
+  // name under which an ns-3 component should write filename
+  std::string Relay (std::string filename);
+  void Flush ();
+  // flushes and forgets the streams, so that the next simulation in the same
+  // process starts with a fresh writer
+  void Reset ();
+
+private:
+  enum
+  {
+    RING_SIZE = 1 << 16,
+    WRITE_SIZE = 1 << 20,
+    CLOSE = 0xffffffff
+  };
+  struct Stream
+  {
+    FILE *file;
+    Formatter formatter;
+    std::string buffer;
+    int fd;
+    std::string fifo;
+    std::string filename;
+  };
+
+  AsyncTraceWriter ();
+  ~AsyncTraceWriter ();
+
+  void Start ();
+  void Run ();
+  uint32_t DrainRing ();
+  uint32_t DrainRelays ();
+  void Process (const Record &record);
+  void WriteBuffer (Stream &stream, bool all);
+  void CloseStream (Stream &stream);
+  void RemoveRelays ();
+
+  bool m_async;
+  bool m_started;
+  std::vector<Stream> m_streams;
+  std::mutex m_streamsMutex;
+  std::string m_fifoDir;
+
+  Record m_ring[RING_SIZE];
+  std::atomic<uint32_t> m_head;
+  std::atomic<uint32_t> m_tail;
+  std::atomic<bool> m_stop;
+  std::thread m_thread;
+};
+
+inline AsyncTraceWriter &
+AsyncTraceWriter::Get ()
+{
+  static AsyncTraceWriter writer;
+  return writer;
+}
+
+inline
+AsyncTraceWriter::AsyncTraceWriter ()
+  : m_async (false),
+    m_started (false),
+    m_head (0),
+    m_tail (0),
+    m_stop (false)
+{
+}
+
+inline
+AsyncTraceWriter::~AsyncTraceWriter ()
+{
+  Flush ();
+  RemoveRelays ();
+}
+
+inline void
+AsyncTraceWriter::Start ()
+{
+  if (m_started)
+  {
+      return;
+  }
+  m_started = true;
+  BooleanValue booleanValue;
+  GlobalValue::GetValueByName ("asyncTraceWriter", booleanValue);
+  m_async = booleanValue.Get ();
+  Simulator::ScheduleDestroy (&AsyncTraceWriter::Flush, this);
+  if (m_async)
+  {
+      m_stop = false;
+      m_thread = std::thread (&AsyncTraceWriter::Run, this);
+  }
+}
+
+inline int32_t
+AsyncTraceWriter::Open (std::string filename, Formatter formatter)
+{
+  Start ();
+  Stream stream;
+  stream.file = std::fopen (filename.c_str (), "w");
+  if (!stream.file)
+  {
+      return -1;
+  }
+  stream.formatter = formatter;
+  stream.fd = -1;
+  stream.filename = filename;
+  std::lock_guard<std::mutex> lock (m_streamsMutex);
+  m_streams.push_back (stream);
+  return m_streams.size () - 1;
+}
+
+inline std::string
+AsyncTraceWriter::Relay (std::string filename)
+{
+  Start ();
+  if (!m_async)
+  {
+      return filename;
+  }
+  if (m_fifoDir.empty ())
+  {
+      char dir[] = "/tmp/trace-relay-XXXXXX";
+      if (!mkdtemp (dir))
+      {
+          return filename;
+      }
+      m_fifoDir = dir;
+  }
+  Stream stream;
+  stream.fifo = m_fifoDir + "/" + filename;
+  stream.filename = filename;
+  stream.formatter = 0;
+  // opened read-write, so the pipe stays open while the writer reopens it
+  if (mkfifo (stream.fifo.c_str (), 0600) != 0
+      || (stream.fd = open (stream.fifo.c_str (), O_RDWR | O_NONBLOCK)) < 0)
+  {
+      return filename;
+  }
+  stream.file = std::fopen (filename.c_str (), "w");
+  if (!stream.file)
+  {
+      close (stream.fd);
+      unlink (stream.fifo.c_str ());
+      return filename;
+  }
+  std::lock_guard<std::mutex> lock (m_streamsMutex);
+  m_streams.push_back (stream);
+  return stream.fifo;
+}
+
+inline void
+AsyncTraceWriter::Write (const Record &record)
+{
+  if (!m_async)
+  {
+      Process (record);
+      return;
+  }
+  uint32_t head = m_head.load (std::memory_order_relaxed);
+  while (head - m_tail.load (std::memory_order_acquire) == RING_SIZE)
+  {
+      std::this_thread::yield ();
+  }
+  m_ring[head % RING_SIZE] = record;
+  m_head.store (head + 1, std::memory_order_release);
+}
+
+inline void
+AsyncTraceWriter::Close (uint32_t stream)
+{
+  Record record = Record ();
+  record.stream = stream;
+  record.type = CLOSE;
+  Write (record);
+}
+
+inline void
+AsyncTraceWriter::Flush ()
+{
+  if (m_async)
+  {
+      m_stop = true;
+      m_thread.join ();
+      m_async = false;
+  }
+  std::lock_guard<std::mutex> lock (m_streamsMutex);
+  for (uint32_t i = 0; i < m_streams.size (); ++i)
+  {
+      CloseStream (m_streams[i]);
+  }
+}
+
+inline void
+AsyncTraceWriter::Reset ()
+{
+  Flush ();
+  RemoveRelays ();
+  std::lock_guard<std::mutex> lock (m_streamsMutex);
+  m_streams.clear ();
+  m_head = 0;
+  m_tail = 0;
+  m_stop = false;
+  m_started = false;
+}
+
+inline void
+AsyncTraceWriter::Run ()
+{
+  while (true)
+  {
+      bool stop = m_stop;
+      uint32_t n = DrainRing () + DrainRelays ();
+      if (stop && n == 0)
+      {
+          return;
+      }
+      if (n == 0)
+      {
+          std::this_thread::sleep_for (std::chrono::milliseconds (1));
+      }
+  }
+}
+
+inline uint32_t
+AsyncTraceWriter::DrainRing ()
+{
+  uint32_t tail = m_tail.load (std::memory_order_relaxed);
+  uint32_t head = m_head.load (std::memory_order_acquire);
+  if (tail == head)
+  {
+      return 0;
+  }
+  std::lock_guard<std::mutex> lock (m_streamsMutex);
+  for (uint32_t i = tail; i != head; ++i)
+  {
+      Process (m_ring[i % RING_SIZE]);
+  }
+  m_tail.store (head, std::memory_order_release);
+  return head - tail;
+}
+
+inline uint32_t
+AsyncTraceWriter::DrainRelays ()
+{
+  uint32_t n = 0;
+  char buffer[65536];
+  std::lock_guard<std::mutex> lock (m_streamsMutex);
+  for (uint32_t i = 0; i < m_streams.size (); ++i)
+  {
+      Stream &stream = m_streams[i];
+      if (stream.fd < 0)
+      {
+          continue;
+      }
+      ssize_t r;
+      while ((r = read (stream.fd, buffer, sizeof (buffer))) > 0)
+      {
+          stream.buffer.append (buffer, r);
+          n += r;
+      }
+      WriteBuffer (stream, false);
+  }
+  return n;
+}
+
+inline void
+AsyncTraceWriter::Process (const Record &record)
+{
+  if (record.stream >= m_streams.size ())
+  {
+      return;
+  }
+  Stream &stream = m_streams[record.stream];
+  if (record.type == CLOSE)
+  {
+      CloseStream (stream);
+      return;
+  }
+  if (!stream.file)
+  {
+      return;
+  }
+  stream.formatter (stream.buffer, record);
+  WriteBuffer (stream, !m_async);
+}
+
+inline void
+AsyncTraceWriter::WriteBuffer (Stream &stream, bool all)
+{
+  if (stream.file && (all || stream.buffer.size () >= WRITE_SIZE))
+  {
+      std::fwrite (stream.buffer.data (), 1, stream.buffer.size (), stream.file);
+      stream.buffer.clear ();
+  }
+}
+
+// Relayed files are replaced by a link to the real file until the writer is
+// reset or the process exits.  Components that write on disposal should be
+// disposed before Simulator::Destroy (), while the relay is still drained.
+inline void
+AsyncTraceWriter::CloseStream (Stream &stream)
+{
+  if (!stream.file)
+  {
+      return;
+  }
+  WriteBuffer (stream, true);
+  std::fclose (stream.file);
+  stream.file = 0;
+  if (stream.fd >= 0)
+  {
+      close (stream.fd);
+      stream.fd = -1;
+      unlink (stream.fifo.c_str ());
+      char *cwd = getcwd (0, 0);
+      std::string target = stream.filename[0] == '/' || !cwd ? stream.filename : std::string (cwd) + "/" + stream.filename;
+      std::free (cwd);
+      if (symlink (target.c_str (), stream.fifo.c_str ()) != 0)
+      {
+          std::cerr << "Can't link " << stream.fifo << " to " << target << "\n";
+      }
+  }
+}
+
+// removes the links and the temporary directory of the relays
+inline void
+AsyncTraceWriter::RemoveRelays ()
+{
+  if (m_fifoDir.empty ())
+  {
+      return;
+  }
+  std::lock_guard<std::mutex> lock (m_streamsMutex);
+  for (uint32_t i = 0; i < m_streams.size (); ++i)
+  {
+      if (!m_streams[i].fifo.empty ())
+      {
+          unlink (m_streams[i].fifo.c_str ());
+      }
+  }
+  rmdir (m_fifoDir.c_str ());
+  m_fifoDir.clear ();
+}
+
+} // namespace ns3
+
+#endif // ASYNC_TRACE_WRITER_H
@@ -0,0 +1,137 @@
+#ifndef BATCH_RUNNER_H
+#define BATCH_RUNNER_H
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+
+#include "async-trace-writer.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace ns3 {
+
+static GlobalValue g_batchFile ("batchFile",
+                                "File listing scenarios to run back to back in this process (empty: run the command line once)",
+                                StringValue (""),
+                                MakeStringChecker ());
+
+typedef int (*ScenarioFunction) (int argc, char *argv[]);
+
+// Runs many short scenarios in one process, so that loading the ns-3
+// libraries and registering the TypeIds is paid once.  Each line of the batch
+// file is a scenario:
+//
+//   name [argument ...] [GlobalValue=value ...]
+//
+// e.g. "small-rr-3 10 6 rr simTime=1 RngRun=3"; empty lines and lines
+// starting with # are skipped.  Every scenario runs in the directory name,
+// created in the working directory, with the command line arguments of the
+// program and the global values of the environment (NS_GLOBAL_VALUE) plus
+// its own.  After every scenario, whatever its outcome, Simulator::Destroy ()
+// clears the node, building and channel lists; the state that outlives it
+// is reset: attribute defaults and global values (Config::Reset), the RNG
+// stream counter, the IP address generators and the trace writer.  The
+// outcome and wall time of every scenario go to BatchSummary.txt.  A fatal
+// error in one scenario ends the process.
+inline int
+RunBatch (int argc, char *argv[], ScenarioFunction scenario)
+{
+  StringValue batchFile;
+  GlobalValue::GetValueByName ("batchFile", batchFile);
+  if (batchFile.Get ().empty ())
+  {
+      return scenario (argc, argv);
+  }
+  std::ifstream batch (batchFile.Get ().c_str ());
+  if (!batch.is_open ())
+  {
+      NS_FATAL_ERROR ("Can't open batch file " << batchFile.Get ());
+  }
+  std::ofstream summary ("BatchSummary.txt", std::ios_base::out | std::ios_base::trunc);
+  summary << "% scenario\tstatus\twallTime" << std::endl;
+  char *cwd = getcwd (0, 0);
+  std::string batchDir = cwd ? cwd : ".";
+  std::free (cwd);
+  std::string line;
+  uint32_t failures = 0;
+  while (std::getline (batch, line))
+  {
+      std::istringstream tokens (line);
+      std::string name;
+      if (!(tokens >> name) || name[0] == '#')
+      {
+          continue;
+      }
+      std::vector<std::string> args (1, argv[0]);
+      std::vector<std::pair<std::string, std::string> > settings;
+      std::string token;
+      while (tokens >> token)
+      {
+          std::string::size_type eq = token.find ('=');
+          if (eq == std::string::npos)
+          {
+              args.push_back (token);
+          }
+          else
+          {
+              settings.push_back (std::make_pair (token.substr (0, eq), token.substr (eq + 1)));
+          }
+      }
+
+      AsyncTraceWriter::Get ().Reset ();
+      Config::Reset ();
+      RngSeedManager::ResetNextStreamIndex ();
+      Ipv4AddressGenerator::Reset ();
+      Ipv6AddressGenerator::Reset ();
+      bool valid = true;
+      for (uint32_t i = 0; i < settings.size (); ++i)
+      {
+          if (!GlobalValue::BindFailSafe (settings[i].first, StringValue (settings[i].second)))
+          {
+              NS_LOG_UNCOND ("Scenario " << name << ": invalid global value " << settings[i].first
+                             << "=" << settings[i].second);
+              valid = false;
+          }
+      }
+      mkdir (name.c_str (), 0755);
+      if (!valid || chdir (name.c_str ()) != 0)
+      {
+          summary << name << "\tskipped\t0" << std::endl;
+          ++failures;
+          continue;
+      }
+      std::vector<char *> scenarioArgv;
+      for (uint32_t i = 0; i < args.size (); ++i)
+      {
+          scenarioArgv.push_back (&args[i][0]);
+      }
+      scenarioArgv.push_back (0);
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+      int status = scenario (args.size (), &scenarioArgv[0]);
+      // a scenario that returns early leaves its nodes, buildings and
+      // channels in the global lists; the second call is a no-op otherwise
+      Simulator::Destroy ();
+      double wall = std::chrono::duration<double> (std::chrono::steady_clock::now () - start).count ();
+      if (chdir (batchDir.c_str ()) != 0)
+      {
+          NS_FATAL_ERROR ("Can't leave the directory of scenario " << name);
+      }
+      summary << name << "\t" << status << "\t" << wall << std::endl;
+      failures += status != 0;
+  }
+  AsyncTraceWriter::Get ().Reset ();
+  return failures > 0 ? 1 : 0;
+}
+
+} // namespace ns3
+
+#endif // BATCH_RUNNER_H
@@ -0,0 +1,128 @@
+#ifndef BEST_SERVER_ATTACH_H
+#define BEST_SERVER_ATTACH_H
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/mobility-module.h"
+#include "ns3/lte-module.h"
+
+#include <cmath>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace ns3 {
+
+static GlobalValue g_fastAttach ("fastAttach",
+                                 "Attach every UE directly to its best cell from a precomputed RSRP map "
+                                 "instead of running idle mode cell selection",
+                                 BooleanValue (false),
+                                 MakeBooleanChecker ());
+
+// Picks the cell LteUeRrc initial cell selection would camp on, without the
+// simulated PSS/RSRP measurements: the strongest RSRP among the cells on the
+// DL EARFCN of the UE that are suitable, i.e. above their QRxLevMin and, for
+// closed subscriber group cells, with the CSG identity of the UE.  RSRP is
+// computed from the cell power per resource element, the eNB antenna gain and
+// the given pathloss model (a separate instance with the same defaults).
+class BestServerMap
+{
+public:
+  BestServerMap (std::string pathlossModelType);
+
+  void AddCells (NetDeviceContainer enbDevs);
+  // 0 if no cell is suitable
+  Ptr<LteEnbNetDevice> GetBestServer (Ptr<LteUeNetDevice> ueDev);
+  // UEs without a suitable cell fall back to the normal cell selection
+  void Attach (Ptr<LteHelper> lteHelper, NetDeviceContainer ueDevs);
+
+private:
+  Ptr<PropagationLossModel> GetPathloss (uint32_t earfcn);
+
+  std::string m_pathlossModelType;
+  std::map<uint32_t, Ptr<PropagationLossModel> > m_pathloss;
+  std::vector<Ptr<LteEnbNetDevice> > m_cells;
+};
+
+inline
+BestServerMap::BestServerMap (std::string pathlossModelType)
+  : m_pathlossModelType (pathlossModelType)
+{
+}
+
+inline Ptr<PropagationLossModel>
+BestServerMap::GetPathloss (uint32_t earfcn)
+{
+  Ptr<PropagationLossModel> &model = m_pathloss[earfcn];
+  if (!model)
+  {
+      ObjectFactory factory;
+      factory.SetTypeId (m_pathlossModelType);
+      model = factory.Create<PropagationLossModel> ();
+      model->SetAttributeFailSafe ("Frequency", DoubleValue (LteSpectrumValueHelper::GetCarrierFrequency (earfcn)));
+  }
+  return model;
+}
+
+inline void
+BestServerMap::AddCells (NetDeviceContainer enbDevs)
+{
+  for (uint32_t i = 0; i < enbDevs.GetN (); ++i)
+  {
+      m_cells.push_back (enbDevs.Get (i)->GetObject<LteEnbNetDevice> ());
+  }
+}
+
+inline Ptr<LteEnbNetDevice>
+BestServerMap::GetBestServer (Ptr<LteUeNetDevice> ueDev)
+{
+  Ptr<MobilityModel> ueMobility = ueDev->GetNode ()->GetObject<MobilityModel> ();
+  Ptr<LteEnbNetDevice> best;
+  double bestRsrp = 0;
+  for (uint32_t c = 0; c < m_cells.size (); ++c)
+  {
+      Ptr<LteEnbNetDevice> cell = m_cells[c];
+      if (cell->GetDlEarfcn () != ueDev->GetDlEarfcn ()
+          || (cell->GetCsgIndication () && cell->GetCsgId () != ueDev->GetCsgId ()))
+      {
+          continue;
+      }
+      Ptr<MobilityModel> enbMobility = cell->GetNode ()->GetObject<MobilityModel> ();
+      double rsrp = cell->GetPhy ()->GetTxPower () - 10 * std::log10 (12.0 * cell->GetDlBandwidth ())
+        + GetPathloss (cell->GetDlEarfcn ())->CalcRxPower (0, enbMobility, ueMobility);
+      Ptr<AntennaModel> antenna = cell->GetPhy ()->GetDownlinkSpectrumPhy ()->GetRxAntenna ();
+      if (antenna)
+      {
+          rsrp += antenna->GetGainDb (Angles (ueMobility->GetPosition (), enbMobility->GetPosition ()));
+      }
+      IntegerValue qRxLevMin;
+      cell->GetRrc ()->GetAttribute ("QRxLevMin", qRxLevMin);
+      if (rsrp >= 2 * qRxLevMin.Get () && (!best || rsrp > bestRsrp))
+      {
+          best = cell;
+          bestRsrp = rsrp;
+      }
+  }
+  return best;
+}
+
+inline void
+BestServerMap::Attach (Ptr<LteHelper> lteHelper, NetDeviceContainer ueDevs)
+{
+  for (uint32_t i = 0; i < ueDevs.GetN (); ++i)
+  {
+      Ptr<LteEnbNetDevice> best = GetBestServer (ueDevs.Get (i)->GetObject<LteUeNetDevice> ());
+      if (best)
+      {
+          lteHelper->Attach (ueDevs.Get (i), best);
+      }
+      else
+      {
+          lteHelper->Attach (ueDevs.Get (i));
+      }
+  }
+}
+
+} // namespace ns3
+
+#endif // BEST_SERVER_ATTACH_H
@@ -21,6 +21,27 @@
 #include "ios"
 #include "string"
 #include "vector"
+#include "progress-reporter.h"
+#include "async-trace-writer.h"
+#include "capacity-estimator.h"
+#include "best-server-attach.h"
+#include "flow-reclaimer.h"
+#include "flow-demux-sink.h"
+#include "lte-trace-registry.h"
+#include "sinr-histogram-collector.h"
+#include "event-log.h"
+#include "result-cache.h"
+#include "scene-exporter.h"
+#include "scheduler-latency-probe.h"
+#include "batch-runner.h"
+#include "sampled-flow-monitor.h"
+#include "packet-pool.h"
+#include "kpi-time-series.h"
+#include "fading-trace-bank.h"
+#include "handover-stats-collector.h"
+#include "wrap-around-propagation-loss-model.h"
+#include "culling-propagation-loss-model.h"
+#include "room-table-propagation-loss-model.h"
 
 
 using namespace ns3;
@@ -122,81 +143,42 @@ FemtocellBlockAllocator::OverlapsWithAnyPrevious (Box box)
   return false;
 }
 
-void
-PrintGnuplottableBuildingListToFile (std::string filename)
+// Same sectorisation as LteHexGridEnbTopologyHelper (3 sectors per site at 0, 120
+// and -120 degrees, 0.5 m away from a 30 m mast), on explicitly given sites
+NetDeviceContainer
+InstallHexClusterEnbDevices (Ptr<LteHelper> lteHelper, NodeContainer enbs, std::vector<Vector> sites)
 {
-  std::ofstream outFile;
-  outFile.open (filename.c_str (), std::ios_base::out | std::ios_base::trunc);
-  if (!outFile.is_open ())
-  {
-      return;
-  }
-  uint32_t index = 0;
-  for (BuildingList::Iterator it = BuildingList::Begin (); it != BuildingList::End (); ++it)
+  const double offset = 0.5;
+  const double height = 30;
+  NetDeviceContainer enbDevs;
+  for (uint32_t n = 0; n < enbs.GetN (); ++n)
   {
-      ++index;
-      Box box = (*it)->GetBoundaries ();
-      outFile << "set object " << index
-              << " rect from " << box.xMin  << "," << box.yMin
-              << " to "   << box.xMax  << "," << box.yMax
-              << " front fs empty "
-              << std::endl;
-  }
-}
-
-void
-PrintGnuplottableUeListToFile (std::string filename)
-{
-  std::ofstream outFile;
-  outFile.open (filename.c_str (), std::ios_base::out | std::ios_base::trunc);
-  if (!outFile.is_open ())
-  {
-      return;
-  }
-  for (NodeList::Iterator it = NodeList::Begin (); it != NodeList::End (); ++it)
-  {
-      Ptr<Node> node = *it;
-      int nDevs = node->GetNDevices ();
-      for (int j = 0; j < nDevs; j++)
+      Vector site = sites[n / 3];
+      double x = site.x;
+      double y = site.y;
+      double antennaOrientation = 0;
+      switch (n % 3)
       {
-          Ptr<LteUeNetDevice> uedev = node->GetDevice (j)->GetObject <LteUeNetDevice> ();
-          if (uedev)
-          {
-              Vector pos = node->GetObject<MobilityModel> ()->GetPosition ();
-              outFile << "set label \"" << uedev->GetImsi ()
-                      << "\" at "<< pos.x << "," << pos.y << " left font \"Helvetica,4\" textcolor rgb \"grey\" front point pt 1 ps 0.3 lc rgb \"grey\" offset 0,0"
-                      << std::endl;
-          }
-      }
-  }
-}
-
-void
-PrintGnuplottableEnbListToFile (std::string filename)
-{
-  std::ofstream outFile;
-  outFile.open (filename.c_str (), std::ios_base::out | std::ios_base::trunc);
-  if (!outFile.is_open ())
-  {
-      return;
-  }
-  for (NodeList::Iterator it = NodeList::Begin (); it != NodeList::End (); ++it)
-  {
-      Ptr<Node> node = *it;
-      int nDevs = node->GetNDevices ();
-      for (int j = 0; j < nDevs; j++)
-      {
-          Ptr<LteEnbNetDevice> enbdev = node->GetDevice (j)->GetObject <LteEnbNetDevice> ();
-          if (enbdev)
-          {
-              Vector pos = node->GetObject<MobilityModel> ()->GetPosition ();
-              outFile << "set label \"" << enbdev->GetCellId ()
-                      << "\" at "<< pos.x << "," << pos.y
-                      << " left font \"Helvetica,4\" textcolor rgb \"white\" front  point pt 2 ps 0.3 lc rgb \"white\" offset 0,0"
-                      << std::endl;
-          }
+        case 0:
+          antennaOrientation = 0;
+          x += offset;
+          break;
+        case 1:
+          antennaOrientation = 120;
+          x -= offset / 2.0;
+          y += offset * std::sqrt (0.75);
+          break;
+        case 2:
+          antennaOrientation = -120;
+          x -= offset / 2.0;
+          y -= offset * std::sqrt (0.75);
+          break;
       }
+      enbs.Get (n)->GetObject<MobilityModel> ()->SetPosition (Vector (x, y, height));
+      lteHelper->SetEnbAntennaModelAttribute ("Orientation", DoubleValue (antennaOrientation));
+      enbDevs.Add (lteHelper->InstallEnbDevice (enbs.Get (n)));
   }
+  return enbDevs;
 }
 
 static ns3::GlobalValue g_nBlocks ("nBlocks",
@@ -229,6 +211,28 @@ static ns3::GlobalValue g_areaMarginFactor ("areaMarginFactor",
                                             ns3::DoubleValue (0.5),
                                             ns3::MakeDoubleChecker<double> ());
 
+static ns3::GlobalValue g_wrapAround ("wrapAround",
+                                      "Place the macro sites in a compact hexagonal cluster (nMacroEnbSites = 1, 7, 19, ...) "
+                                      "and use wrap-around (toroidal) distances",
+                                      ns3::BooleanValue (false),
+                                      ns3::MakeBooleanChecker ());
+
+static ns3::GlobalValue g_interferenceCulling ("interferenceCulling",
+                                               "Skip the spectrum deliveries received below the noise floor plus cullingThresholdDb",
+                                               ns3::BooleanValue (false),
+                                               ns3::MakeBooleanChecker ());
+
+static ns3::GlobalValue g_cullingThresholdDb ("cullingThresholdDb",
+                                              "Received power relative to the noise floor [dB] below which deliveries are culled",
+                                              ns3::DoubleValue (-10),
+                                              ns3::MakeDoubleChecker<double> ());
+
+static ns3::GlobalValue g_roomLossTable ("roomLossTable",
+                                         "Take the wall losses of the buildings pathloss model from per-room tables "
+                                         "built at setup (same losses as the hybrid model)",
+                                         ns3::BooleanValue (false),
+                                         ns3::MakeBooleanChecker ());
+
 static ns3::GlobalValue g_homeEnbDeploymentRatio ("homeEnbDeploymentRatio",
                                                   "The HeNB deployment ratio as per 3GPP R4-092042",
                                                   ns3::DoubleValue (0.2),
@@ -254,6 +258,20 @@ static ns3::GlobalValue g_homeEnbDlEarfcn ("homeEnbDlEarfcn",
                                            "DL EARFCN used by HeNBs",
                                            ns3::UintegerValue (100),
                                            ns3::MakeUintegerChecker<uint16_t> ());
+static ns3::GlobalValue g_handoverAlgorithm ("handoverAlgorithm",
+                                             "Handover algorithm of the eNBs: none, a3rsrp or a2a4rsrq "
+                                             "(with none, as the UEs are static, HandoverStats.txt has no handovers)",
+                                             ns3::StringValue ("none"),
+                                             ns3::MakeStringChecker ());
+
+static ns3::GlobalValue g_nMacroUes ("nMacroUes",
+                                     "Number of macro UEs (0: as many as the home UEs given on the command line)",
+                                     ns3::UintegerValue (0),
+                                     ns3::MakeUintegerChecker<uint32_t> ());
+static ns3::GlobalValue g_simTime ("simTime",
+                                   "Simulated time [s]",
+                                   ns3::DoubleValue (1.0),
+                                   ns3::MakeDoubleChecker<double> (0.0));
 
 static ns3::GlobalValue g_outdoorUeMinSpeed ("outdoorUeMinSpeed",
                                              "Minimum speed value of macor UE with random waypoint model [m/s].",
@@ -264,7 +282,9 @@ static ns3::GlobalValue g_outdoorUeMaxSpeed ("outdoorUeMaxSpeed",
                                              ns3::DoubleValue (0.0),
                                              ns3::MakeDoubleChecker<double> ());
 
-int main(int argc, char *argv[]) {
+// one simulation; main () runs it once or for every scenario of the batch file
+static int RunScenario(int argc, char *argv[]) {
+	ProgressReporter progress;
 	uint16_t macroEnbBandwidth = 15;
 
 	uint16_t homeEnbBandwidth = 6;
@@ -272,7 +292,6 @@ int main(int argc, char *argv[]) {
 	uint32_t nMacroUes = 10;
 	std::string schedulerType = "rr";
 	bool createRem = false;
-	double simTime = 1; // 100
 
 	if (argc == 2)
 	{
@@ -318,6 +337,54 @@ int main(int argc, char *argv[]) {
 	double interSiteDistance = doubleValue.Get ();
 	GlobalValue::GetValueByName ("areaMarginFactor", doubleValue);
 	double areaMarginFactor = doubleValue.Get ();
+	GlobalValue::GetValueByName ("wrapAround", booleanValue);
+	bool wrapAround = booleanValue.Get ();
+	GlobalValue::GetValueByName ("interferenceCulling", booleanValue);
+	bool interferenceCulling = booleanValue.Get ();
+	GlobalValue::GetValueByName ("cullingThresholdDb", doubleValue);
+	double cullingThresholdDb = doubleValue.Get ();
+	GlobalValue::GetValueByName ("roomLossTable", booleanValue);
+	bool roomLossTable = booleanValue.Get ();
+	GlobalValue::GetValueByName ("capacityEstimate", booleanValue);
+	bool capacityEstimate = booleanValue.Get ();
+	GlobalValue::GetValueByName ("fastAttach", booleanValue);
+	bool fastAttach = booleanValue.Get ();
+	GlobalValue::GetValueByName ("reclaimFlows", booleanValue);
+	bool reclaimFlows = booleanValue.Get ();
+	GlobalValue::GetValueByName ("flowDrainTime", doubleValue);
+	double flowDrainTime = doubleValue.Get ();
+	GlobalValue::GetValueByName ("directTraceConnect", booleanValue);
+	bool directTraceConnect = booleanValue.Get ();
+	GlobalValue::GetValueByName ("sinrHistograms", booleanValue);
+	bool sinrHistograms = booleanValue.Get ();
+	GlobalValue::GetValueByName ("sinrTDigest", uintegerValue);
+	uint32_t sinrTDigest = uintegerValue.Get ();
+	GlobalValue::GetValueByName ("fadingBank", stringValue);
+	std::string fadingBank = stringValue.Get ();
+	GlobalValue::GetValueByName ("sceneSampleInterval", doubleValue);
+	double sceneSampleInterval = doubleValue.Get ();
+	GlobalValue::GetValueByName ("sceneSampleMinDistance", doubleValue);
+	double sceneSampleMinDistance = doubleValue.Get ();
+	GlobalValue::GetValueByName ("schedulerLatency", booleanValue);
+	bool schedulerLatency = booleanValue.Get ();
+	GlobalValue::GetValueByName ("schedulerLatencyBudget", doubleValue);
+	double schedulerLatencyBudget = doubleValue.Get ();
+	GlobalValue::GetValueByName ("flowSampleFraction", doubleValue);
+	double flowSampleFraction = doubleValue.Get ();
+	GlobalValue::GetValueByName ("flowSamplePacketInterval", uintegerValue);
+	uint32_t flowSamplePacketInterval = uintegerValue.Get ();
+	GlobalValue::GetValueByName ("flowSampleMaxFlows", uintegerValue);
+	uint32_t flowSampleMaxFlows = uintegerValue.Get ();
+	GlobalValue::GetValueByName ("kpiHistory", uintegerValue);
+	uint32_t kpiHistory = uintegerValue.Get ();
+	GlobalValue::GetValueByName ("kpiDownsample", uintegerValue);
+	uint32_t kpiDownsample = uintegerValue.Get ();
+	GlobalValue::GetValueByName ("handoverStats", booleanValue);
+	bool handoverStats = booleanValue.Get ();
+	GlobalValue::GetValueByName ("handoverPingPongTime", doubleValue);
+	double handoverPingPongTime = doubleValue.Get ();
+	GlobalValue::GetValueByName ("handoverAlgorithm", stringValue);
+	std::string handoverAlgorithm = stringValue.Get ();
 
 	GlobalValue::GetValueByName ("homeEnbDeploymentRatio", doubleValue);
 	double homeEnbDeploymentRatio = doubleValue.Get ();
@@ -333,9 +400,50 @@ int main(int argc, char *argv[]) {
 	GlobalValue::GetValueByName ("homeEnbDlEarfcn", uintegerValue);
 	uint16_t homeEnbDlEarfcn = uintegerValue.Get ();
 
+	GlobalValue::GetValueByName ("nMacroUes", uintegerValue);
+	if (uintegerValue.Get () > 0)
+	{
+		nMacroUes = uintegerValue.Get ();
+	}
+	GlobalValue::GetValueByName ("simTime", doubleValue);
+	double simTime = doubleValue.Get ();
+
+	GlobalValue::GetValueByName ("progressInterval", doubleValue);
+	double progressInterval = doubleValue.Get ();
+	GlobalValue::GetValueByName ("progressFile", stringValue);
+	std::string progressFile = stringValue.Get ();
+
+	// rerunning an identical configuration restores the results of the previous run
+	ResultCache resultCache (argc, argv);
+	if (resultCache.Restore ())
+	{
+		return 0;
+	}
+
 	Box macroUeBox;
 	double ueZ = 1.5;
-	if (nMacroEnbSites > 0)
+	Box blockBox;
+	std::vector<Vector> clusterSites;
+	Vector clusterCenter;
+	double clusterRadius = 0;
+	if (wrapAround && nMacroEnbSites > 0)
+	{
+		// the cluster region is inside clusterRadius of the centre; femtocell blocks
+		// go in a square well inside the cluster region
+		clusterSites = GetHexClusterSites (nMacroEnbSites, interSiteDistance, Vector (0, 0, 0));
+		for (uint32_t i = 0; i < clusterSites.size (); i++)
+		{
+			clusterRadius = std::max (clusterRadius, CalculateDistance (clusterSites[i], Vector (0, 0, 0)));
+		}
+		double innerRadius = (clusterRadius + interSiteDistance / 2) * sqrt (0.75) / sqrt (2);
+		clusterRadius += interSiteDistance;
+		clusterCenter = Vector (clusterRadius, clusterRadius, 0);
+		clusterSites = GetHexClusterSites (nMacroEnbSites, interSiteDistance, clusterCenter);
+		macroUeBox = Box (0, 2 * clusterRadius, 0, 2 * clusterRadius, ueZ, ueZ);
+		blockBox = Box (clusterRadius - innerRadius, clusterRadius + innerRadius,
+		                clusterRadius - innerRadius, clusterRadius + innerRadius, ueZ, ueZ);
+	}
+	else if (nMacroEnbSites > 0)
 	{
 	      uint32_t currentSite = nMacroEnbSites -1;
 	      uint32_t biRowIndex = (currentSite / (nMacroEnbSitesX + nMacroEnbSitesX + 1));
@@ -359,8 +467,12 @@ int main(int argc, char *argv[]) {
 	      // still need the box to place femtocell blocks
 	      macroUeBox = Box (0, 150, 0, 150, ueZ, ueZ);
 	}
+	if (!wrapAround || nMacroEnbSites == 0)
+	{
+		blockBox = macroUeBox;
+	}
 
-	FemtocellBlockAllocator blockAllocator (macroUeBox, nApartmentsX, nFloors);
+	FemtocellBlockAllocator blockAllocator (blockBox, nApartmentsX, nFloors);
 	blockAllocator.Create (nBlocks);
 
 	uint32_t nHomeEnbs = round (4 * nApartmentsX * nBlocks * nFloors * homeEnbDeploymentRatio * homeEnbActivationRatio);
@@ -382,12 +494,37 @@ int main(int argc, char *argv[]) {
 
 
 	// Set the RBs
-	lteHelper->SetAttribute ("PathlossModel", StringValue ("ns3::HybridBuildingsPropagationLossModel"));
-	lteHelper->SetPathlossModelAttribute ("ShadowSigmaExtWalls", DoubleValue (0));
-	lteHelper->SetPathlossModelAttribute ("ShadowSigmaOutdoor", DoubleValue (1));
-	lteHelper->SetPathlossModelAttribute ("ShadowSigmaIndoor", DoubleValue (1.5));
+	// the pathloss attributes are set as defaults, so that they also reach the
+	// buildings model when it is wrapped by another propagation loss model
+	Config::SetDefault ("ns3::BuildingsPropagationLossModel::ShadowSigmaExtWalls", DoubleValue (0));
+	Config::SetDefault ("ns3::BuildingsPropagationLossModel::ShadowSigmaOutdoor", DoubleValue (1));
+	Config::SetDefault ("ns3::BuildingsPropagationLossModel::ShadowSigmaIndoor", DoubleValue (1.5));
 	// use always LOS model
-	lteHelper->SetPathlossModelAttribute ("Los2NlosThr", DoubleValue (1e6));
+	Config::SetDefault ("ns3::HybridBuildingsPropagationLossModel::Los2NlosThr", DoubleValue (1e6));
+	Config::SetDefault ("ns3::RoomTablePropagationLossModel::Los2NlosThr", DoubleValue (1e6));
+	std::string pathlossModelType = roomLossTable ? "ns3::RoomTablePropagationLossModel"
+	                                              : "ns3::HybridBuildingsPropagationLossModel";
+	Ptr<WrapAroundPropagationLossModel> wrapGeometry;
+	if (wrapAround && nMacroEnbSites > 0)
+	{
+		Config::SetDefault ("ns3::WrapAroundPropagationLossModel::InnerModelType", StringValue (pathlossModelType));
+		Config::SetDefault ("ns3::WrapAroundPropagationLossModel::InterSiteDistance", DoubleValue (interSiteDistance));
+		Config::SetDefault ("ns3::WrapAroundPropagationLossModel::ClusterSize", UintegerValue (nMacroEnbSites));
+		Config::SetDefault ("ns3::WrapAroundPropagationLossModel::CenterX", DoubleValue (clusterCenter.x));
+		Config::SetDefault ("ns3::WrapAroundPropagationLossModel::CenterY", DoubleValue (clusterCenter.y));
+		pathlossModelType = "ns3::WrapAroundPropagationLossModel";
+		wrapGeometry = CreateObject<WrapAroundPropagationLossModel> ();
+	}
+	std::string unculledPathlossModelType = pathlossModelType;
+	if (interferenceCulling)
+	{
+		Config::SetDefault ("ns3::CullingPropagationLossModel::InnerModelType", StringValue (pathlossModelType));
+		Config::SetDefault ("ns3::CullingPropagationLossModel::ThresholdDb", DoubleValue (cullingThresholdDb));
+		pathlossModelType = "ns3::CullingPropagationLossModel";
+		// the channel drops the deliveries the culling model marks with its loss
+		Config::SetDefault ("ns3::SpectrumChannel::MaxLossDb", DoubleValue (CullingPropagationLossModel::CULLED_LOSS_DB / 2));
+	}
+	lteHelper->SetAttribute ("PathlossModel", StringValue (pathlossModelType));
 	lteHelper->SetSpectrumChannelType ("ns3::MultiModelSpectrumChannel");
 
 
@@ -445,6 +582,21 @@ int main(int argc, char *argv[]) {
 		std::cout << "Wrong scheduler type. Use: rr, pf, tdtbfq, fdtbfq" << "\n";
 		return -1;
 	}
+
+	// Handover, between the macro eNBs and HeNBs joined by X2 below
+	if (handoverAlgorithm.compare("a3rsrp") == 0)
+	{
+		lteHelper->SetHandoverAlgorithmType ("ns3::A3RsrpHandoverAlgorithm");
+	}
+	else if (handoverAlgorithm.compare("a2a4rsrq") == 0)
+	{
+		lteHelper->SetHandoverAlgorithmType ("ns3::A2A4RsrqHandoverAlgorithm");
+	}
+	else if (handoverAlgorithm.compare("none") != 0)
+	{
+		std::cout << "Wrong handover algorithm. Use: none, a3rsrp, a2a4rsrq" << "\n";
+		return -1;
+	}
 	// Macro eNBs in 3-sector hex grid
 	mobility.Install (macroEnbs);
 	BuildingsHelper::Install (macroEnbs);
@@ -463,7 +615,15 @@ int main(int argc, char *argv[]) {
 	lteHelper->SetEnbDeviceAttribute ("UlBandwidth", UintegerValue (macroEnbBandwidth));
 
 
-	NetDeviceContainer macroEnbDevs = lteHexGridEnbTopologyHelper->SetPositionAndInstallEnbDevice (macroEnbs);
+	NetDeviceContainer macroEnbDevs;
+	if (wrapGeometry)
+	{
+		macroEnbDevs = InstallHexClusterEnbDevices (lteHelper, macroEnbs, clusterSites);
+	}
+	else
+	{
+		macroEnbDevs = lteHexGridEnbTopologyHelper->SetPositionAndInstallEnbDevice (macroEnbs);
+	}
 
 	// HomeEnbs randomly indoor
 
@@ -479,6 +639,10 @@ int main(int argc, char *argv[]) {
 	lteHelper->SetEnbDeviceAttribute ("UlBandwidth", UintegerValue (homeEnbBandwidth));
 
 	NetDeviceContainer homeEnbDevs  = lteHelper->InstallEnbDevice (homeEnbs);
+	if (!fadingBank.empty ())
+	{
+		AddFadingBankToChannels (fadingBank);
+	}
 
 	// this enables handover for macro eNBs
 	lteHelper->AddX2Interface (macroEnbs);
@@ -526,6 +690,15 @@ int main(int argc, char *argv[]) {
 
 	// macro Ues
 
+	if (wrapGeometry)
+	{
+		// uniform over the cluster region, the fundamental domain of the torus
+		Ptr<HexClusterPositionAllocator> clusterAlloc = CreateObject<HexClusterPositionAllocator> ();
+		clusterAlloc->SetCluster (wrapGeometry, clusterCenter, clusterRadius, ueZ);
+		mobility.SetPositionAllocator (clusterAlloc);
+	}
+	else
+	{
 	positionAlloc = CreateObject<RandomBoxPositionAllocator> ();
 	Ptr<UniformRandomVariable> xVal = CreateObject<UniformRandomVariable> ();
 	xVal->SetAttribute ("Min", DoubleValue (macroUeBox.xMin));
@@ -540,6 +713,7 @@ int main(int argc, char *argv[]) {
 	zVal->SetAttribute ("Max", DoubleValue (macroUeBox.zMax));
 	positionAlloc->SetAttribute ("Z", PointerValue (zVal));
 	mobility.SetPositionAllocator (positionAlloc);
+	}
 	mobility.Install (macroUes);
 
 
@@ -568,23 +742,44 @@ int main(int argc, char *argv[]) {
 	internet.Install (ues);
 	ueIpIfaces = epcHelper->AssignUeIpv4Address (NetDeviceContainer (ueDevs));
 
+	BuildingsHelper::MakeMobilityModelConsistent ();
+
 	// attachment (needs to be done after IP stack configuration)
-	// using initial cell selection
-	lteHelper->Attach (macroUeDevs);
-	lteHelper->Attach (homeUeDevs);
+	// using initial cell selection, or directly to the cell it would select
+	if (fastAttach)
+	{
+		BestServerMap bestServerMap (unculledPathlossModelType);
+		bestServerMap.AddCells (macroEnbDevs);
+		bestServerMap.AddCells (homeEnbDevs);
+		bestServerMap.Attach (lteHelper, macroUeDevs);
+		bestServerMap.Attach (lteHelper, homeUeDevs);
+	}
+	else
+	{
+		lteHelper->Attach (macroUeDevs);
+		lteHelper->Attach (homeUeDevs);
+	}
 
-	BuildingsHelper::MakeMobilityModelConsistent ();
+	// trace sources of the devices, connected through pointers
+	LteTraceRegistry traceRegistry;
+	traceRegistry.AddEnbDevices (macroEnbDevs);
+	traceRegistry.AddEnbDevices (homeEnbDevs);
+	traceRegistry.AddUeDevices (ueDevs);
+
+	// buildings, eNBs and UEs, for plotting the REM and replaying mobility and attachment
+	SceneExporter sceneExporter;
+	if (createRem || sceneSampleInterval > 0)
+	{
+		sceneExporter.Start (traceRegistry, "scene.bin", Seconds (sceneSampleInterval), sceneSampleMinDistance);
+	}
 
 	Ptr<RadioEnvironmentMapHelper> remHelper;
 	if (createRem)
 	{
 		//Radio Environment Map
-		PrintGnuplottableBuildingListToFile ("buildings.txt");
-		PrintGnuplottableEnbListToFile ("enbs.txt");
-		PrintGnuplottableUeListToFile ("ues.txt");
 		remHelper = CreateObject<RadioEnvironmentMapHelper> ();
 		remHelper->SetAttribute ("ChannelPath", StringValue ("/ChannelList/0"));
-		remHelper->SetAttribute ("OutputFile", StringValue ("rem.out"));
+		remHelper->SetAttribute ("OutputFile", StringValue (AsyncTraceWriter::Get ().Relay ("rem.out")));
 
 		remHelper->SetAttribute ("XMin", DoubleValue (macroUeBox.xMin));
 		remHelper->SetAttribute ("XMax", DoubleValue (macroUeBox.xMax));
@@ -600,7 +795,14 @@ int main(int argc, char *argv[]) {
 
 	// install applications
 
-	for (uint16_t i = 0; i < ues.GetN(); i++)
+	// one sink per port on the remote host, shared by the flows of all UEs
+	FlowDemuxSinkHelper remoteSinks (remoteHost);
+	SampledFlowMonitor flowSampler (flowSampleFraction, flowSamplePacketInterval, flowSampleMaxFlows);
+	SinrHistogramCollector sinrCollector (sinrTDigest);
+	FlowReclaimer flowReclaimer (lteHelper, flowDrainTime, Seconds (simTime));
+	flowReclaimer.AddCells (macroEnbDevs);
+	flowReclaimer.AddCells (homeEnbDevs);
+	for (uint32_t i = 0; i < ues.GetN(); i++)
 	{
 		Ptr<Ipv4StaticRouting> ueStaticRouting = ipv4RoutingHelper.GetStaticRouting (ues.Get(i)->GetObject<Ipv4> ());
 		ueStaticRouting->SetDefaultRoute (epcHelper->GetUeDefaultGatewayAddress (), 1);
@@ -623,10 +825,9 @@ int main(int argc, char *argv[]) {
 			if (interPacketInterval < 1)
 				interPacketInterval = 1;
 			PacketSinkHelper packetSinkHelper_ue ("ns3::UdpSocketFactory", InetSocketAddress (Ipv4Address::GetAny (), otherPort1));
-			PacketSinkHelper packetSinkHelper_remote("ns3::UdpSocketFactory", InetSocketAddress(Ipv4Address::GetAny(), otherPort2));
 
 			serverApps.Add(packetSinkHelper_ue.Install(ues.Get(i)));
-			serverApps.Add (packetSinkHelper_remote.Install (remoteHost));
+			remoteSinks.Install (otherPort2);
 
 			UdpClientHelper client_ue(ueIpIfaces.GetAddress(i), otherPort1);
 			client_ue.SetAttribute("MaxPackets", UintegerValue(maxPackets));
@@ -650,9 +851,8 @@ int main(int argc, char *argv[]) {
 			interPacketInterval = packetSize*8 / 657;
 
 			PacketSinkHelper packetSinkHelper_ue("ns3::UdpSocketFactory", InetSocketAddress (Ipv4Address::GetAny (), otherPort1));
-			PacketSinkHelper packetSinkHelper_remote("ns3::UdpSocketFactory", InetSocketAddress(Ipv4Address::GetAny(), otherPort2));
 			serverApps.Add (packetSinkHelper_ue.Install (ues.Get(i)));
-			serverApps.Add (packetSinkHelper_remote.Install (remoteHost));
+			remoteSinks.Install (otherPort2);
 			UdpClientHelper client(ueIpIfaces.GetAddress(i), otherPort1);
 			client.SetAttribute ("Interval", TimeValue (MilliSeconds(interPacketInterval))); // 657 KBps (http://www.theglobeandmail.com/technology/tech-news/how-much-bandwidth-does-streaming-use/article7365916/)
 
@@ -675,9 +875,8 @@ int main(int argc, char *argv[]) {
 			maxPackets = fileSize / packetSize + 1;
 			interPacketInterval = packetSize*8 / 1788; // 1788Kbps
 			PacketSinkHelper packetSinkHelper_ue("ns3::UdpSocketFactory", InetSocketAddress (Ipv4Address::GetAny (), otherPort1));
-			PacketSinkHelper packetSinkHelper_remote("ns3::UdpSocketFactory", InetSocketAddress(Ipv4Address::GetAny(), otherPort2));
 			serverApps.Add (packetSinkHelper_ue.Install (ues.Get(i)));
-			serverApps.Add (packetSinkHelper_remote.Install(remoteHost));
+			remoteSinks.Install (otherPort2);
 			UdpClientHelper client(ueIpIfaces.GetAddress(i), otherPort1);
 			client.SetAttribute ("Interval", TimeValue (MilliSeconds(interPacketInterval)));
 			client.SetAttribute ("MaxPackets", UintegerValue(maxPackets));
@@ -703,9 +902,8 @@ int main(int argc, char *argv[]) {
 			if (interPacketInterval < 1)
 				interPacketInterval = 1;
 			PacketSinkHelper packetSinkHelper_ue("ns3::UdpSocketFactory", InetSocketAddress (Ipv4Address::GetAny (), otherPort1));
-			PacketSinkHelper packetSinkHelper_remote("ns3::UdpSocketFactory", InetSocketAddress(Ipv4Address::GetAny(), otherPort2));
 			serverApps.Add(packetSinkHelper_ue.Install(ues.Get(i)));
-			serverApps.Add (packetSinkHelper_remote.Install (remoteHost));
+			remoteSinks.Install (otherPort2);
 			UdpClientHelper client_ue(ueIpIfaces.GetAddress(i), otherPort1);
 			client_ue.SetAttribute("MaxPackets", UintegerValue(maxPackets));
 			client_ue.SetAttribute("Interval", TimeValue(MilliSeconds(interPacketInterval)));
@@ -730,9 +928,8 @@ int main(int argc, char *argv[]) {
 			bitRate = 1920;   	// bit rate = 1920 kbps
 			interPacketInterval =  packetSize * 8 / bitRate; // packet size (bits) / bitRate (bits/sec)
 			PacketSinkHelper packetSinkHelper_ue("ns3::UdpSocketFactory", InetSocketAddress (Ipv4Address::GetAny (), otherPort1));
-			PacketSinkHelper packetSinkHelper_remote("ns3::UdpSocketFactory", InetSocketAddress(Ipv4Address::GetAny(), otherPort2));
 			serverApps.Add (packetSinkHelper_ue.Install (ues.Get(i)));
-			serverApps.Add (packetSinkHelper_remote.Install(remoteHost));
+			remoteSinks.Install (otherPort2);
 			UdpClientHelper client(ueIpIfaces.GetAddress(i), otherPort1);
 			client.SetAttribute ("Interval", TimeValue (MilliSeconds(interPacketInterval)));
 			client.SetAttribute ("MaxPackets", UintegerValue(maxPackets));
@@ -758,9 +955,8 @@ int main(int argc, char *argv[]) {
 			if (interPacketInterval < 1)
 				interPacketInterval = 1;
 			PacketSinkHelper packetSinkHelper_ue("ns3::UdpSocketFactory", InetSocketAddress (Ipv4Address::GetAny (), otherPort1));
-			PacketSinkHelper packetSinkHelper_remote("ns3::UdpSocketFactory", InetSocketAddress(Ipv4Address::GetAny(), otherPort2));
 			serverApps.Add(packetSinkHelper_ue.Install(ues.Get(i)));
-			serverApps.Add (packetSinkHelper_remote.Install (remoteHost));
+			remoteSinks.Install (otherPort2);
 			UdpClientHelper client_ue(ueIpIfaces.GetAddress(i), otherPort1);
 			client_ue.SetAttribute("MaxPackets", UintegerValue(maxPackets));
 			client_ue.SetAttribute("Interval", TimeValue(MilliSeconds(interPacketInterval)));
@@ -787,9 +983,8 @@ int main(int argc, char *argv[]) {
 			if (interPacketInterval < 1)
 				interPacketInterval = 1;
 			PacketSinkHelper packetSinkHelper_ue("ns3::UdpSocketFactory", InetSocketAddress (Ipv4Address::GetAny (), otherPort1));
-			PacketSinkHelper packetSinkHelper_remote("ns3::UdpSocketFactory", InetSocketAddress(Ipv4Address::GetAny(), otherPort2));
 			serverApps.Add(packetSinkHelper_ue.Install(ues.Get(i)));
-			serverApps.Add (packetSinkHelper_remote.Install (remoteHost));
+			remoteSinks.Install (otherPort2);
 
 			UdpClientHelper client_ue(ueIpIfaces.GetAddress(i), otherPort1);
 			client_ue.SetAttribute("MaxPackets", UintegerValue(maxPackets));
@@ -816,9 +1011,8 @@ int main(int argc, char *argv[]) {
 			if (interPacketInterval < 1)
 				interPacketInterval = 1;
 			PacketSinkHelper packetSinkHelper_ue("ns3::UdpSocketFactory", InetSocketAddress (Ipv4Address::GetAny (), otherPort1));
-			PacketSinkHelper packetSinkHelper_remote("ns3::UdpSocketFactory", InetSocketAddress(Ipv4Address::GetAny(), otherPort2));
 			serverApps.Add(packetSinkHelper_ue.Install(ues.Get(i)));
-			serverApps.Add (packetSinkHelper_remote.Install (remoteHost));
+			remoteSinks.Install (otherPort2);
 			UdpClientHelper client_ue(ueIpIfaces.GetAddress(i), otherPort1);
 			client_ue.SetAttribute("Interval", TimeValue(MilliSeconds(interPacketInterval)));
 			client_ue.SetAttribute("PacketSize", UintegerValue(packetSize));
@@ -842,9 +1036,8 @@ int main(int argc, char *argv[]) {
 			if (interPacketInterval < 1)
 				interPacketInterval = 1;
 			PacketSinkHelper packetSinkHelper_ue("ns3::UdpSocketFactory", InetSocketAddress (Ipv4Address::GetAny (), otherPort1));
-			PacketSinkHelper packetSinkHelper_remote("ns3::UdpSocketFactory", InetSocketAddress(Ipv4Address::GetAny(), otherPort2));
 			serverApps.Add(packetSinkHelper_ue.Install(ues.Get(i)));
-			serverApps.Add (packetSinkHelper_remote.Install (remoteHost));
+			remoteSinks.Install (otherPort2);
 			UdpClientHelper client_ue(ueIpIfaces.GetAddress(i), otherPort1);
 			client_ue.SetAttribute("Interval", TimeValue(MilliSeconds(interPacketInterval)));
 			client_ue.SetAttribute("PacketSize", UintegerValue(packetSize));
@@ -867,9 +1060,8 @@ int main(int argc, char *argv[]) {
 			if (interPacketInterval < 1)
 				interPacketInterval = 1;
 			PacketSinkHelper packetSinkHelper_ue("ns3::UdpSocketFactory", InetSocketAddress (Ipv4Address::GetAny (), otherPort1));
-			PacketSinkHelper packetSinkHelper_remote("ns3::UdpSocketFactory", InetSocketAddress(Ipv4Address::GetAny(), otherPort2));
 			serverApps.Add(packetSinkHelper_ue.Install(ues.Get(i)));
-			serverApps.Add (packetSinkHelper_remote.Install (remoteHost));
+			remoteSinks.Install (otherPort2);
 			UdpClientHelper client_ue(ueIpIfaces.GetAddress(i), otherPort1);
 			client_ue.SetAttribute("Interval", TimeValue(MilliSeconds(interPacketInterval)));
 			client_ue.SetAttribute("PacketSize", UintegerValue(packetSize));
@@ -902,18 +1094,128 @@ int main(int argc, char *argv[]) {
 		qos.mbrUl = 256000; // Uplink MBR
 		EpsBearer bearer (EpsBearer::NGBR_VIDEO_TCP_DEFAULT, qos);
 		lteHelper->ActivateDedicatedEpsBearer (ueDevs.Get (i), bearer, tft);
+		flowReclaimer.AddFlow (ueDevs.Get (i), i%10, 2, clientApps, serverApps);
+		remoteSinks.SetFlowLabel (ueIpIfaces.GetAddress (i), ueDevs.Get (i)->GetObject<LteUeNetDevice> ()->GetImsi (), i%10);
+		sinrCollector.SetProfile (ueDevs.Get (i), i%10);
+		flowSampler.SetProfile (ueIpIfaces.GetAddress (i), i%10);
+	}
+	if (flowSampleFraction > 0)
+	{
+		flowSampler.Install (remoteHost);
+		flowSampler.Install (ues);
+	}
+	if (capacityEstimate)
+	{
+		CapacityEstimator estimator (unculledPathlossModelType, simTime);
+		estimator.AddCells (macroEnbDevs);
+		estimator.AddCells (homeEnbDevs);
+		for (uint32_t i = 0; i < ueDevs.GetN(); i++)
+		{
+			estimator.AddUe (ueDevs.Get (i), i%10);
+		}
+		estimator.AddTrafficSources (remotehostContainer);
+		estimator.AddTrafficSources (ues);
+		estimator.Estimate ();
+		estimator.Print ("Capacity");
+		Simulator::Destroy();
+		resultCache.Store ();
+		return 0;
+	}
+
+	Config::SetDefault ("ns3::RadioBearerStatsCalculator::DlPdcpOutputFilename", StringValue (AsyncTraceWriter::Get ().Relay ("DlPdcpStats.txt")));
+	Config::SetDefault ("ns3::RadioBearerStatsCalculator::UlPdcpOutputFilename", StringValue (AsyncTraceWriter::Get ().Relay ("UlPdcpStats.txt")));
+	Ptr<RadioBearerStatsCalculator> pdcpStats;
+	if (directTraceConnect)
+	{
+		pdcpStats = traceRegistry.EnablePdcpStats ();
+	}
+	else
+	{
+		lteHelper->EnablePdcpTraces();
+		pdcpStats = lteHelper->GetPdcpStats ();
+	}
+	if (sinrHistograms)
+	{
+		// summaries at the PDCP statistics epochs
+		sinrCollector.Connect (traceRegistry);
+		sinrCollector.Start (pdcpStats->GetStartTime (), pdcpStats->GetEpoch (), "SinrCqiEpochs.txt");
+	}
+	KpiTimeSeries kpiSeries (kpiHistory, kpiDownsample);
+	if (kpiHistory > 0)
+	{
+		kpiSeries.Connect (traceRegistry);
+		kpiSeries.Start (pdcpStats->GetStartTime (), pdcpStats->GetEpoch ());
+	}
+	// binary events of the categories compiled in with EVENT_LOG_CATEGORIES
+	EventLog eventLog;
+	eventLog.Start (traceRegistry, "EventLog.bin");
+	SchedulerLatencyProbe schedulerProbe (Seconds (schedulerLatencyBudget));
+	if (schedulerLatency)
+	{
+		schedulerProbe.Install (traceRegistry);
+	}
+	HandoverStatsCollector handoverCollector (Seconds (handoverPingPongTime));
+	if (handoverStats)
+	{
+		handoverCollector.Connect (traceRegistry);
 	}
-	lteHelper->EnablePdcpTraces();
 
 
 
 	Simulator::Stop(Seconds(simTime));
 
+	if (reclaimFlows)
+	{
+		flowReclaimer.Start ("FlowCompletion.txt");
+	}
+	progress.Start (progressInterval, Seconds (simTime), progressFile);
 	Simulator::Run();
+	progress.Finish ();
+	remoteSinks.PrintStats ("RemoteHostFlowStats.txt");
+	if (flowSampleFraction > 0)
+	{
+		flowSampler.PrintStats ("SampledFlowStats.txt", "SampledFlowProfiles.txt");
+	}
+	if (PACKET_POOL)
+	{
+		PacketPool::PrintStats ("PacketPoolStats.txt");
+	}
+	if (kpiHistory > 0)
+	{
+		kpiSeries.PrintStats ("KpiTimeSeries.txt", "KpiSummary.txt");
+	}
+	if (schedulerLatency)
+	{
+		schedulerProbe.PrintStats ("SchedulerLatency.txt");
+	}
+	if (handoverStats)
+	{
+		handoverCollector.PrintStats ("HandoverStats.txt");
+	}
+	if (sinrHistograms)
+	{
+		sinrCollector.PrintHistograms ("SinrCqiHistograms.txt");
+	}
+	if (directTraceConnect)
+	{
+		traceRegistry.PrintConnectStats ("TraceConnectStats.txt");
+	}
+	if (interferenceCulling)
+	{
+		CullingPropagationLossModel::PrintStats ("CullingStats.txt");
+	}
 
+	// the PDCP statistics write their last epoch when disposed: before the
+	// trace relays are closed and the results are cached
+	pdcpStats->Dispose ();
 	Simulator::Destroy();
+	resultCache.Store ();
 
 	return 0;
 
 
 }
+
+int main(int argc, char *argv[]) {
+	return RunBatch (argc, argv, &RunScenario);
+}
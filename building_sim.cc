@@ -16,112 +16,182 @@
 #include "ns3/buildings-helper.h"
 #include "ns3/buildings-module.h"
 #include "ns3/log.h"
+#include "progress-reporter.h"
+#include "async-trace-writer.h"
+#include "capacity-estimator.h"
+#include "best-server-attach.h"
+#include "flow-reclaimer.h"
+#include "flow-demux-sink.h"
+#include "lte-trace-registry.h"
+#include "sinr-histogram-collector.h"
+#include "event-log.h"
+#include "result-cache.h"
+#include "scene-exporter.h"
+#include "scheduler-latency-probe.h"
+#include "batch-runner.h"
+#include "sampled-flow-monitor.h"
+#include "packet-pool.h"
+#include "kpi-time-series.h"
+#include "fading-trace-bank.h"
 
 using namespace ns3;
 
-void createBuilding(Ptr<Building> build)
+class CampusGenerator
 {
-	double x_min = 0.0;
-	double x_max = 50.0;
-	double y_min = 0.0;
-	double y_max = 50.0;
-	double z_min = 0.0;
-	double z_max = 10.0;
-
-	//build = CreateObject<Building>();
-	build->SetBoundaries(Box(x_min, x_max, y_min, y_max, z_min, z_max));
-	build->SetBuildingType(Building::Residential);
-	build->SetExtWallsType(Building::ConcreteWithWindows);
-	build->SetNFloors(1);
-	build->SetNRoomsX(2);
-	build->SetNRoomsY(2);
+public:
+  CampusGenerator (uint32_t nBuildings, double sizeX, double sizeY, uint32_t nFloors, double floorHeight,
+                   uint32_t nRoomsX, uint32_t nRoomsY, double streetWidth);
+  void Create ();
+  std::vector<Vector> GetEnbPositions (uint32_t enbsPerFloor) const;
+  Box GetBounds () const;
+
+private:
+  uint32_t m_nBuildings;
+  uint32_t m_gridWidth;
+  double m_sizeX;
+  double m_sizeY;
+  uint32_t m_nFloors;
+  double m_floorHeight;
+  uint32_t m_nRoomsX;
+  uint32_t m_nRoomsY;
+  double m_streetWidth;
+  std::vector<Box> m_buildings;
+};
+
+CampusGenerator::CampusGenerator (uint32_t nBuildings, double sizeX, double sizeY, uint32_t nFloors, double floorHeight,
+                                  uint32_t nRoomsX, uint32_t nRoomsY, double streetWidth)
+  : m_nBuildings (nBuildings),
+    m_gridWidth (std::ceil (std::sqrt (nBuildings))),
+    m_sizeX (sizeX),
+    m_sizeY (sizeY),
+    m_nFloors (nFloors),
+    m_floorHeight (floorHeight),
+    m_nRoomsX (nRoomsX),
+    m_nRoomsY (nRoomsY),
+    m_streetWidth (streetWidth)
+{
+  NS_ASSERT_MSG (nBuildings > 0 && nFloors > 0 && nRoomsX > 0 && nRoomsY > 0, "Empty campus");
 }
 
+// Lays the buildings out on a square grid, row by row, separated by streets
 void
-PrintGnuplottableBuildingListToFile (std::string filename)
+CampusGenerator::Create ()
 {
-  std::ofstream outFile;
-  outFile.open (filename.c_str (), std::ios_base::out | std::ios_base::trunc);
-  if (!outFile.is_open ())
-  {
-      return;
-  }
-  uint32_t index = 0;
-  for (BuildingList::Iterator it = BuildingList::Begin (); it != BuildingList::End (); ++it)
+  for (uint32_t i = 0; i < m_nBuildings; ++i)
   {
-      ++index;
-      Box box = (*it)->GetBoundaries ();
-      outFile << "set object " << index
-              << " rect from " << box.xMin  << "," << box.yMin
-              << " to "   << box.xMax  << "," << box.yMax
-              << " front fs empty "
-              << std::endl;
+      double xMin = (i % m_gridWidth) * (m_sizeX + m_streetWidth);
+      double yMin = (i / m_gridWidth) * (m_sizeY + m_streetWidth);
+      Box box (xMin, xMin + m_sizeX, yMin, yMin + m_sizeY, 0.0, m_nFloors * m_floorHeight);
+      m_buildings.push_back (box);
+
+      Ptr<Building> build = CreateObject<Building> ();
+      build->SetBoundaries (box);
+      build->SetBuildingType (Building::Residential);
+      build->SetExtWallsType (Building::ConcreteWithWindows);
+      build->SetNFloors (m_nFloors);
+      build->SetNRoomsX (m_nRoomsX);
+      build->SetNRoomsY (m_nRoomsY);
   }
 }
 
-void
-PrintGnuplottableUeListToFile (std::string filename)
+// One eNB in the middle of every room (enbsPerFloor == 0), or enbsPerFloor eNBs
+// spread evenly over every floor, 3 m above the floor
+std::vector<Vector>
+CampusGenerator::GetEnbPositions (uint32_t enbsPerFloor) const
 {
-  std::ofstream outFile;
-  outFile.open (filename.c_str (), std::ios_base::out | std::ios_base::trunc);
-  if (!outFile.is_open ())
+  uint32_t nx = m_nRoomsX;
+  uint32_t ny = m_nRoomsY;
+  if (enbsPerFloor > 0)
   {
-      return;
+      nx = std::ceil (std::sqrt (enbsPerFloor));
+      ny = (enbsPerFloor + nx - 1) / nx;
   }
-  for (NodeList::Iterator it = NodeList::Begin (); it != NodeList::End (); ++it)
+  uint32_t perFloor = enbsPerFloor > 0 ? enbsPerFloor : nx * ny;
+
+  std::vector<Vector> positions;
+  for (std::vector<Box>::const_iterator it = m_buildings.begin (); it != m_buildings.end (); ++it)
   {
-      Ptr<Node> node = *it;
-      int nDevs = node->GetNDevices ();
-      for (int j = 0; j < nDevs; j++)
+      double dx = (it->xMax - it->xMin) / nx;
+      double dy = (it->yMax - it->yMin) / ny;
+      for (uint32_t floor = 0; floor < m_nFloors; ++floor)
       {
-          Ptr<LteUeNetDevice> uedev = node->GetDevice (j)->GetObject <LteUeNetDevice> ();
-          if (uedev)
+          double z = it->zMin + floor * m_floorHeight + std::min (3.0, m_floorHeight / 2);
+          uint32_t placed = 0;
+          for (uint32_t row = ny; row > 0 && placed < perFloor; --row)
           {
-              Vector pos = node->GetObject<MobilityModel> ()->GetPosition ();
-              outFile << "set label \"" << uedev->GetImsi ()
-                      << "\" at "<< pos.x << "," << pos.y << " left font \"Helvetica,8\" textcolor rgb \"grey\" front point pt 1 ps 0.3 lc rgb \"grey\" offset 0,0"
-                      << std::endl;
+              for (uint32_t col = 0; col < nx && placed < perFloor; ++col, ++placed)
+              {
+                  positions.push_back (Vector (it->xMin + (col + 0.5) * dx, it->yMin + (row - 0.5) * dy, z));
+              }
           }
       }
   }
+  return positions;
 }
 
-void
-PrintGnuplottableEnbListToFile (std::string filename)
+Box
+CampusGenerator::GetBounds () const
 {
-  std::ofstream outFile;
-  outFile.open (filename.c_str (), std::ios_base::out | std::ios_base::trunc);
-  if (!outFile.is_open ())
+  Box bounds = m_buildings.front ();
+  for (std::vector<Box>::const_iterator it = m_buildings.begin (); it != m_buildings.end (); ++it)
   {
-      return;
-  }
-  for (NodeList::Iterator it = NodeList::Begin (); it != NodeList::End (); ++it)
-  {
-      Ptr<Node> node = *it;
-      int nDevs = node->GetNDevices ();
-      for (int j = 0; j < nDevs; j++)
-      {
-          Ptr<LteEnbNetDevice> enbdev = node->GetDevice (j)->GetObject <LteEnbNetDevice> ();
-          if (enbdev)
-          {
-              Vector pos = node->GetObject<MobilityModel> ()->GetPosition ();
-              outFile << "set label \"" << enbdev->GetCellId ()
-                      << "\" at "<< pos.x << "," << pos.y
-                      << " left font \"Helvetica,8\" textcolor rgb \"white\" front  point pt 2 ps 0.3 lc rgb \"white\" offset 0,0"
-                      << std::endl;
-          }
-      }
+      bounds.xMax = std::max (bounds.xMax, it->xMax);
+      bounds.yMax = std::max (bounds.yMax, it->yMax);
+      bounds.zMax = std::max (bounds.zMax, it->zMax);
   }
+  return bounds;
 }
 
-
-
-int main(int argc, char *argv[]) {
-	double power = 20; // 20 Fempto cell (Femtocells_Hamalainen2011 ,p 42)
+static ns3::GlobalValue g_campusBuildings ("campusBuildings",
+                                           "Number of buildings in the campus",
+                                           ns3::UintegerValue (1),
+                                           ns3::MakeUintegerChecker<uint32_t> (1));
+static ns3::GlobalValue g_campusBuildingSizeX ("campusBuildingSizeX",
+                                               "Building footprint along the X axis [m]",
+                                               ns3::DoubleValue (50.0),
+                                               ns3::MakeDoubleChecker<double> ());
+static ns3::GlobalValue g_campusBuildingSizeY ("campusBuildingSizeY",
+                                               "Building footprint along the Y axis [m]",
+                                               ns3::DoubleValue (50.0),
+                                               ns3::MakeDoubleChecker<double> ());
+static ns3::GlobalValue g_campusFloors ("campusFloors",
+                                        "Number of floors per building",
+                                        ns3::UintegerValue (1),
+                                        ns3::MakeUintegerChecker<uint32_t> (1));
+static ns3::GlobalValue g_campusFloorHeight ("campusFloorHeight",
+                                             "Height of one floor [m]",
+                                             ns3::DoubleValue (10.0),
+                                             ns3::MakeDoubleChecker<double> ());
+static ns3::GlobalValue g_campusRoomsX ("campusRoomsX",
+                                        "Number of rooms along the X axis of a building",
+                                        ns3::UintegerValue (2),
+                                        ns3::MakeUintegerChecker<uint32_t> (1));
+static ns3::GlobalValue g_campusRoomsY ("campusRoomsY",
+                                        "Number of rooms along the Y axis of a building",
+                                        ns3::UintegerValue (2),
+                                        ns3::MakeUintegerChecker<uint32_t> (1));
+static ns3::GlobalValue g_campusStreetWidth ("campusStreetWidth",
+                                             "Distance between two neighbouring buildings [m]",
+                                             ns3::DoubleValue (20.0),
+                                             ns3::MakeDoubleChecker<double> ());
+static ns3::GlobalValue g_campusEnbsPerFloor ("campusEnbsPerFloor",
+                                              "eNBs per floor, spread evenly (0: one eNB per room)",
+                                              ns3::UintegerValue (0),
+                                              ns3::MakeUintegerChecker<uint32_t> ());
+static ns3::GlobalValue g_enbTxPowerDbm ("enbTxPowerDbm",
+                                         "TX power [dBm] used by every eNB",
+                                         ns3::DoubleValue (20.0),
+                                         ns3::MakeDoubleChecker<double> ());
+static ns3::GlobalValue g_simTime ("simTime",
+                                   "Simulated time [s]",
+                                   ns3::DoubleValue (100.0),
+                                   ns3::MakeDoubleChecker<double> (0.0));
+
+// one simulation; main () runs it once or for every scenario of the batch file
+static int RunScenario(int argc, char *argv[]) {
+	ProgressReporter progress;
 	uint16_t rb = 6;
-	uint16_t numberOfUes = 10;
-	uint8_t numberOfEnbs = 4;
-	double simTime = 100.0;
+	uint32_t numberOfUes = 10;
 	std::string schedulerType = "rr";
 	bool createRem = false;
 
@@ -155,9 +225,86 @@ int main(int argc, char *argv[]) {
 	Config::SetDefault("ns3::RadioBearerStatsCalculator::EpochDuration",TimeValue (Seconds (1.0)));
 	Config::SetDefault("ns3::RadioEnvironmentMapHelper::StopWhenDone", BooleanValue(true));
 
-	// create building
-	Ptr<Building> build = CreateObject<Building>();
-	createBuilding(build);
+	UintegerValue uintegerValue;
+	DoubleValue doubleValue;
+	StringValue stringValue;
+	BooleanValue booleanValue;
+	GlobalValue::GetValueByName ("campusBuildings", uintegerValue);
+	uint32_t campusBuildings = uintegerValue.Get ();
+	GlobalValue::GetValueByName ("campusBuildingSizeX", doubleValue);
+	double campusBuildingSizeX = doubleValue.Get ();
+	GlobalValue::GetValueByName ("campusBuildingSizeY", doubleValue);
+	double campusBuildingSizeY = doubleValue.Get ();
+	GlobalValue::GetValueByName ("campusFloors", uintegerValue);
+	uint32_t campusFloors = uintegerValue.Get ();
+	GlobalValue::GetValueByName ("campusFloorHeight", doubleValue);
+	double campusFloorHeight = doubleValue.Get ();
+	GlobalValue::GetValueByName ("campusRoomsX", uintegerValue);
+	uint32_t campusRoomsX = uintegerValue.Get ();
+	GlobalValue::GetValueByName ("campusRoomsY", uintegerValue);
+	uint32_t campusRoomsY = uintegerValue.Get ();
+	GlobalValue::GetValueByName ("campusStreetWidth", doubleValue);
+	double campusStreetWidth = doubleValue.Get ();
+	GlobalValue::GetValueByName ("campusEnbsPerFloor", uintegerValue);
+	uint32_t campusEnbsPerFloor = uintegerValue.Get ();
+	GlobalValue::GetValueByName ("enbTxPowerDbm", doubleValue);
+	double power = doubleValue.Get (); // 20 Fempto cell (Femtocells_Hamalainen2011 ,p 42)
+
+	GlobalValue::GetValueByName ("simTime", doubleValue);
+	double simTime = doubleValue.Get ();
+	GlobalValue::GetValueByName ("progressInterval", doubleValue);
+	double progressInterval = doubleValue.Get ();
+	GlobalValue::GetValueByName ("progressFile", stringValue);
+	std::string progressFile = stringValue.Get ();
+	GlobalValue::GetValueByName ("capacityEstimate", booleanValue);
+	bool capacityEstimate = booleanValue.Get ();
+	GlobalValue::GetValueByName ("fastAttach", booleanValue);
+	bool fastAttach = booleanValue.Get ();
+	GlobalValue::GetValueByName ("reclaimFlows", booleanValue);
+	bool reclaimFlows = booleanValue.Get ();
+	GlobalValue::GetValueByName ("flowDrainTime", doubleValue);
+	double flowDrainTime = doubleValue.Get ();
+	GlobalValue::GetValueByName ("directTraceConnect", booleanValue);
+	bool directTraceConnect = booleanValue.Get ();
+	GlobalValue::GetValueByName ("sinrHistograms", booleanValue);
+	bool sinrHistograms = booleanValue.Get ();
+	GlobalValue::GetValueByName ("sinrTDigest", uintegerValue);
+	uint32_t sinrTDigest = uintegerValue.Get ();
+	GlobalValue::GetValueByName ("fadingBank", stringValue);
+	std::string fadingBank = stringValue.Get ();
+	GlobalValue::GetValueByName ("sceneSampleInterval", doubleValue);
+	double sceneSampleInterval = doubleValue.Get ();
+	GlobalValue::GetValueByName ("sceneSampleMinDistance", doubleValue);
+	double sceneSampleMinDistance = doubleValue.Get ();
+	GlobalValue::GetValueByName ("schedulerLatency", booleanValue);
+	bool schedulerLatency = booleanValue.Get ();
+	GlobalValue::GetValueByName ("schedulerLatencyBudget", doubleValue);
+	double schedulerLatencyBudget = doubleValue.Get ();
+	GlobalValue::GetValueByName ("flowSampleFraction", doubleValue);
+	double flowSampleFraction = doubleValue.Get ();
+	GlobalValue::GetValueByName ("flowSamplePacketInterval", uintegerValue);
+	uint32_t flowSamplePacketInterval = uintegerValue.Get ();
+	GlobalValue::GetValueByName ("flowSampleMaxFlows", uintegerValue);
+	uint32_t flowSampleMaxFlows = uintegerValue.Get ();
+	GlobalValue::GetValueByName ("kpiHistory", uintegerValue);
+	uint32_t kpiHistory = uintegerValue.Get ();
+	GlobalValue::GetValueByName ("kpiDownsample", uintegerValue);
+	uint32_t kpiDownsample = uintegerValue.Get ();
+
+	// rerunning an identical configuration restores the results of the previous run
+	ResultCache resultCache (argc, argv);
+	if (resultCache.Restore ())
+	{
+		return 0;
+	}
+
+	// create the campus buildings
+	CampusGenerator campus (campusBuildings, campusBuildingSizeX, campusBuildingSizeY, campusFloors, campusFloorHeight,
+	                        campusRoomsX, campusRoomsY, campusStreetWidth);
+	campus.Create ();
+	Box campusBounds = campus.GetBounds ();
+	std::vector<Vector> enbPositions = campus.GetEnbPositions (campusEnbsPerFloor);
+	uint32_t numberOfEnbs = enbPositions.size ();
 
 
 	Ptr<LteHelper> lteHelper = CreateObject<LteHelper>();
@@ -236,12 +383,10 @@ int main(int argc, char *argv[]) {
 
 	// Set mobility for the enbs.
 	Ptr<ListPositionAllocator> positionAlloc = CreateObject<ListPositionAllocator>();
-
-	// center
-	positionAlloc->Add(Vector(12.5, 37.5, 3));
-	positionAlloc->Add(Vector(37.5, 37.5, 3));
-	positionAlloc->Add(Vector(12.5, 12.5, 3));
-	positionAlloc->Add(Vector(37.5, 12.5, 3));
+	for (uint32_t i = 0; i < numberOfEnbs; i++)
+	{
+		positionAlloc->Add(enbPositions[i]);
+	}
 
 	mobilityEnb.SetPositionAllocator(positionAlloc);
 	mobilityEnb.Install(enbNodes);
@@ -251,10 +396,14 @@ int main(int argc, char *argv[]) {
 	// Install LTE Devices to the nodes
 
 	NetDeviceContainer enbLteDevs = lteHelper->InstallEnbDevice(enbNodes);
+	if (!fadingBank.empty ())
+	{
+		AddFadingBankToChannels (fadingBank);
+	}
 	BuildingsHelper::MakeMobilityModelConsistent();
 
 	// Set the transmitted power from Enb.
-	for (uint8_t i = 0; i < 4; i++)
+	for (uint32_t i = 0; i < enbLteDevs.GetN(); i++)
 	{
 		Ptr<LteEnbPhy> enbPhy = enbLteDevs.Get(i)->GetObject<LteEnbNetDevice> ()->GetPhy ();
 		enbPhy->SetTxPower (power);
@@ -302,7 +451,7 @@ int main(int argc, char *argv[]) {
 	mobility.SetMobilityModel ("ns3::RandomWalk2dMobilityModel", "Mode", StringValue ("Time"),
 							   "Time", StringValue ("2s"),
 							   "Speed", StringValue ("ns3::ConstantRandomVariable[Constant=1.0]"),
-							   "Bounds", StringValue ("0|50|0|50"));
+							   "Bounds", RectangleValue (Rectangle (campusBounds.xMin, campusBounds.xMax, campusBounds.yMin, campusBounds.yMax)));
 
 	mobility.Install(ueNodes);
 
@@ -314,7 +463,23 @@ int main(int argc, char *argv[]) {
 	ueIpIface = epcHelper->AssignUeIpv4Address(NetDeviceContainer(ueLteDevs));
 
 	// Connect ues with enbs
-	lteHelper->Attach(ueLteDevs);
+	if (fastAttach)
+	{
+		BuildingsHelper::MakeMobilityModelConsistent();
+		// the LteHelper default pathloss model
+		BestServerMap bestServerMap ("ns3::FriisPropagationLossModel");
+		bestServerMap.AddCells (enbLteDevs);
+		bestServerMap.Attach (lteHelper, ueLteDevs);
+	}
+	else
+	{
+		lteHelper->Attach(ueLteDevs);
+	}
+
+	// trace sources of the devices, connected through pointers
+	LteTraceRegistry traceRegistry;
+	traceRegistry.AddEnbDevices (enbLteDevs);
+	traceRegistry.AddUeDevices (ueLteDevs);
 
 
 	// routing sta ues
@@ -324,21 +489,25 @@ int main(int argc, char *argv[]) {
 		ueStaticRouting->SetDefaultRoute(epcHelper->GetUeDefaultGatewayAddress(), 1);
 	}
 
+	// buildings, eNBs and UEs, for plotting the REM and replaying mobility and attachment
+	SceneExporter sceneExporter;
+	if (createRem || sceneSampleInterval > 0)
+	{
+		sceneExporter.Start (traceRegistry, "scene.bin", Seconds (sceneSampleInterval), sceneSampleMinDistance);
+	}
+
 	Ptr<RadioEnvironmentMapHelper> remHelper;
 	if (createRem)
 	{
 		//Radio Environment Map
-		PrintGnuplottableBuildingListToFile ("buildings.txt");
-		PrintGnuplottableEnbListToFile ("enbs.txt");
-		PrintGnuplottableUeListToFile ("ues.txt");
 		remHelper = CreateObject<RadioEnvironmentMapHelper> ();
 		remHelper->SetAttribute ("ChannelPath", StringValue ("/ChannelList/0"));
-		remHelper->SetAttribute ("OutputFile", StringValue ("rem.out"));
-		remHelper->SetAttribute ("XMin", DoubleValue (-20.0));
-		remHelper->SetAttribute ("XMax", DoubleValue (100.0));
+		remHelper->SetAttribute ("OutputFile", StringValue (AsyncTraceWriter::Get ().Relay ("rem.out")));
+		remHelper->SetAttribute ("XMin", DoubleValue (campusBounds.xMin - 20.0));
+		remHelper->SetAttribute ("XMax", DoubleValue (campusBounds.xMax + 50.0));
 		remHelper->SetAttribute ("XRes", UintegerValue (800));
-		remHelper->SetAttribute ("YMin", DoubleValue (-20.0));
-		remHelper->SetAttribute ("YMax", DoubleValue (100.0));
+		remHelper->SetAttribute ("YMin", DoubleValue (campusBounds.yMin - 20.0));
+		remHelper->SetAttribute ("YMax", DoubleValue (campusBounds.yMax + 50.0));
 		remHelper->SetAttribute ("YRes", UintegerValue (600));
 		remHelper->SetAttribute ("Z", DoubleValue (1.0));
 		remHelper->SetAttribute ("UseDataChannel", BooleanValue (true));
@@ -349,7 +518,13 @@ int main(int argc, char *argv[]) {
 
 	// install applications
 
-	for (uint16_t i = 0; i < numberOfUes; i++)
+	// one sink per port on the remote host, shared by the flows of all UEs
+	FlowDemuxSinkHelper remoteSinks (remoteHost);
+	SampledFlowMonitor flowSampler (flowSampleFraction, flowSamplePacketInterval, flowSampleMaxFlows);
+	SinrHistogramCollector sinrCollector (sinrTDigest);
+	FlowReclaimer flowReclaimer (lteHelper, flowDrainTime, Seconds (simTime));
+	flowReclaimer.AddCells (enbLteDevs);
+	for (uint32_t i = 0; i < numberOfUes; i++)
 	{
 		double interPacketInterval;
 		double packetSize = 1024;
@@ -370,10 +545,9 @@ int main(int argc, char *argv[]) {
 			if (interPacketInterval < 1)
 				interPacketInterval = 1;
 			PacketSinkHelper packetSinkHelper_ue ("ns3::UdpSocketFactory", InetSocketAddress (Ipv4Address::GetAny (), otherPort1));
-			PacketSinkHelper packetSinkHelper_remote("ns3::UdpSocketFactory", InetSocketAddress(Ipv4Address::GetAny(), otherPort2));
 
 			serverApps.Add(packetSinkHelper_ue.Install(ueNodes.Get(i)));
-			serverApps.Add (packetSinkHelper_remote.Install (remoteHost));
+			remoteSinks.Install (otherPort2);
 
 			UdpClientHelper client_ue(ueIpIface.GetAddress(i), otherPort1);
 			client_ue.SetAttribute("MaxPackets", UintegerValue(maxPackets));
@@ -397,9 +571,8 @@ int main(int argc, char *argv[]) {
 			interPacketInterval = packetSize*8 / 657;
 			maxPackets = 2000;
 			PacketSinkHelper packetSinkHelper_ue("ns3::UdpSocketFactory", InetSocketAddress (Ipv4Address::GetAny (), otherPort1));
-			PacketSinkHelper packetSinkHelper_remote("ns3::UdpSocketFactory", InetSocketAddress(Ipv4Address::GetAny(), otherPort2));
 			serverApps.Add (packetSinkHelper_ue.Install (ueNodes.Get(i)));
-			serverApps.Add (packetSinkHelper_remote.Install (remoteHost));
+			remoteSinks.Install (otherPort2);
 			UdpClientHelper client(ueIpIface.GetAddress(i), otherPort1);
 			client.SetAttribute ("Interval", TimeValue (MilliSeconds(interPacketInterval))); // 657 KBps (http://www.theglobeandmail.com/technology/tech-news/how-much-bandwidth-does-streaming-use/article7365916/)
 			client.SetAttribute ("MaxPackets", UintegerValue(maxPackets));
@@ -423,9 +596,8 @@ int main(int argc, char *argv[]) {
 			maxPackets = fileSize / packetSize + 1;
 			interPacketInterval = packetSize*8 / 1788; // 1788Kbps
 			PacketSinkHelper packetSinkHelper_ue("ns3::UdpSocketFactory", InetSocketAddress (Ipv4Address::GetAny (), otherPort1));
-			PacketSinkHelper packetSinkHelper_remote("ns3::UdpSocketFactory", InetSocketAddress(Ipv4Address::GetAny(), otherPort2));
 			serverApps.Add (packetSinkHelper_ue.Install (ueNodes.Get(i)));
-			serverApps.Add (packetSinkHelper_remote.Install(remoteHost));
+			remoteSinks.Install (otherPort2);
 			UdpClientHelper client(ueIpIface.GetAddress(i), otherPort1);
 			client.SetAttribute ("Interval", TimeValue (MilliSeconds(interPacketInterval)));
 			client.SetAttribute ("MaxPackets", UintegerValue(maxPackets));
@@ -451,9 +623,8 @@ int main(int argc, char *argv[]) {
 			if (interPacketInterval < 1)
 				interPacketInterval = 1;
 			PacketSinkHelper packetSinkHelper_ue("ns3::UdpSocketFactory", InetSocketAddress (Ipv4Address::GetAny (), otherPort1));
-			PacketSinkHelper packetSinkHelper_remote("ns3::UdpSocketFactory", InetSocketAddress(Ipv4Address::GetAny(), otherPort2));
 			serverApps.Add(packetSinkHelper_ue.Install(ueNodes.Get(i)));
-			serverApps.Add (packetSinkHelper_remote.Install (remoteHost));
+			remoteSinks.Install (otherPort2);
 			UdpClientHelper client_ue(ueIpIface.GetAddress(i), otherPort1);
 			client_ue.SetAttribute("MaxPackets", UintegerValue(maxPackets));
 			client_ue.SetAttribute("Interval", TimeValue(MilliSeconds(interPacketInterval)));
@@ -478,9 +649,8 @@ int main(int argc, char *argv[]) {
 			bitRate = 1920;   	// Bit rate = 1920 kbps
 			interPacketInterval =  packetSize * 8 / bitRate; // packet size (bits) / bitRate (bits/sec)
 			PacketSinkHelper packetSinkHelper_ue("ns3::UdpSocketFactory", InetSocketAddress (Ipv4Address::GetAny (), otherPort1));
-			PacketSinkHelper packetSinkHelper_remote("ns3::UdpSocketFactory", InetSocketAddress(Ipv4Address::GetAny(), otherPort2));
 			serverApps.Add (packetSinkHelper_ue.Install (ueNodes.Get(i)));
-			serverApps.Add (packetSinkHelper_remote.Install(remoteHost));
+			remoteSinks.Install (otherPort2);
 			UdpClientHelper client(ueIpIface.GetAddress(i), otherPort1);
 			client.SetAttribute ("Interval", TimeValue (MilliSeconds(interPacketInterval)));
 			client.SetAttribute ("MaxPackets", UintegerValue(maxPackets));
@@ -506,9 +676,8 @@ int main(int argc, char *argv[]) {
 			if (interPacketInterval < 1)
 				interPacketInterval = 1;
 			PacketSinkHelper packetSinkHelper_ue("ns3::UdpSocketFactory", InetSocketAddress (Ipv4Address::GetAny (), otherPort1));
-			PacketSinkHelper packetSinkHelper_remote("ns3::UdpSocketFactory", InetSocketAddress(Ipv4Address::GetAny(), otherPort2));
 			serverApps.Add(packetSinkHelper_ue.Install(ueNodes.Get(i)));
-			serverApps.Add (packetSinkHelper_remote.Install (remoteHost));
+			remoteSinks.Install (otherPort2);
 			UdpClientHelper client_ue(ueIpIface.GetAddress(i), otherPort1);
 			client_ue.SetAttribute("MaxPackets", UintegerValue(maxPackets));
 			client_ue.SetAttribute("Interval", TimeValue(MilliSeconds(interPacketInterval)));
@@ -535,9 +704,8 @@ int main(int argc, char *argv[]) {
 			if (interPacketInterval < 1)
 				interPacketInterval = 1;
 			PacketSinkHelper packetSinkHelper_ue("ns3::UdpSocketFactory", InetSocketAddress (Ipv4Address::GetAny (), otherPort1));
-			PacketSinkHelper packetSinkHelper_remote("ns3::UdpSocketFactory", InetSocketAddress(Ipv4Address::GetAny(), otherPort2));
 			serverApps.Add(packetSinkHelper_ue.Install(ueNodes.Get(i)));
-			serverApps.Add (packetSinkHelper_remote.Install (remoteHost));
+			remoteSinks.Install (otherPort2);
 
 			UdpClientHelper client_ue(ueIpIface.GetAddress(i), otherPort1);
 			client_ue.SetAttribute("MaxPackets", UintegerValue(maxPackets));
@@ -564,9 +732,8 @@ int main(int argc, char *argv[]) {
 			if (interPacketInterval < 1)
 				interPacketInterval = 1;
 			PacketSinkHelper packetSinkHelper_ue("ns3::UdpSocketFactory", InetSocketAddress (Ipv4Address::GetAny (), otherPort1));
-			PacketSinkHelper packetSinkHelper_remote("ns3::UdpSocketFactory", InetSocketAddress(Ipv4Address::GetAny(), otherPort2));
 			serverApps.Add(packetSinkHelper_ue.Install(ueNodes.Get(i)));
-			serverApps.Add (packetSinkHelper_remote.Install (remoteHost));
+			remoteSinks.Install (otherPort2);
 			UdpClientHelper client_ue(ueIpIface.GetAddress(i), otherPort1);
 			client_ue.SetAttribute("Interval", TimeValue(MilliSeconds(interPacketInterval)));
 			client_ue.SetAttribute("PacketSize", UintegerValue(packetSize));
@@ -592,9 +759,8 @@ int main(int argc, char *argv[]) {
 			if (interPacketInterval < 1)
 				interPacketInterval = 1;
 			PacketSinkHelper packetSinkHelper_ue("ns3::UdpSocketFactory", InetSocketAddress (Ipv4Address::GetAny (), otherPort1));
-			PacketSinkHelper packetSinkHelper_remote("ns3::UdpSocketFactory", InetSocketAddress(Ipv4Address::GetAny(), otherPort2));
 			serverApps.Add(packetSinkHelper_ue.Install(ueNodes.Get(i)));
-			serverApps.Add (packetSinkHelper_remote.Install (remoteHost));
+			remoteSinks.Install (otherPort2);
 			UdpClientHelper client_ue(ueIpIface.GetAddress(i), otherPort1);
 			client_ue.SetAttribute("Interval", TimeValue(MilliSeconds(interPacketInterval)));
 			client_ue.SetAttribute("PacketSize", UintegerValue(packetSize));
@@ -617,9 +783,8 @@ int main(int argc, char *argv[]) {
 			if (interPacketInterval < 1)
 				interPacketInterval = 1;
 			PacketSinkHelper packetSinkHelper_ue("ns3::UdpSocketFactory", InetSocketAddress (Ipv4Address::GetAny (), otherPort1));
-			PacketSinkHelper packetSinkHelper_remote("ns3::UdpSocketFactory", InetSocketAddress(Ipv4Address::GetAny(), otherPort2));
 			serverApps.Add(packetSinkHelper_ue.Install(ueNodes.Get(i)));
-			serverApps.Add (packetSinkHelper_remote.Install (remoteHost));
+			remoteSinks.Install (otherPort2);
 			UdpClientHelper client_ue(ueIpIface.GetAddress(i), otherPort1);
 			client_ue.SetAttribute("Interval", TimeValue(MilliSeconds(interPacketInterval)));
 			client_ue.SetAttribute("PacketSize", UintegerValue(packetSize));
@@ -652,17 +817,114 @@ int main(int argc, char *argv[]) {
 		qos.mbrUl = 256000; // Uplink MBR
 		EpsBearer bearer (EpsBearer::NGBR_VIDEO_TCP_DEFAULT, qos);
 		lteHelper->ActivateDedicatedEpsBearer (ueLteDevs.Get (i), bearer, tft);
+		flowReclaimer.AddFlow (ueLteDevs.Get (i), i%10, 2, clientApps, serverApps);
+		remoteSinks.SetFlowLabel (ueIpIface.GetAddress (i), ueLteDevs.Get (i)->GetObject<LteUeNetDevice> ()->GetImsi (), i%10);
+		sinrCollector.SetProfile (ueLteDevs.Get (i), i%10);
+		flowSampler.SetProfile (ueIpIface.GetAddress (i), i%10);
+	}
+	if (flowSampleFraction > 0)
+	{
+		flowSampler.Install (remoteHost);
+		flowSampler.Install (ueNodes);
 	}
 
-	lteHelper->EnablePdcpTraces();
+	if (capacityEstimate)
+	{
+		// the LteHelper default pathloss model
+		CapacityEstimator estimator ("ns3::FriisPropagationLossModel", simTime);
+		estimator.AddCells (enbLteDevs);
+		for (uint32_t i = 0; i < ueLteDevs.GetN(); i++)
+		{
+			estimator.AddUe (ueLteDevs.Get (i), i%10);
+		}
+		estimator.AddTrafficSources (remotehostContainer);
+		estimator.AddTrafficSources (ueNodes);
+		estimator.Estimate ();
+		estimator.Print ("Capacity");
+		Simulator::Destroy();
+		resultCache.Store ();
+		return 0;
+	}
+
+	Config::SetDefault ("ns3::RadioBearerStatsCalculator::DlPdcpOutputFilename", StringValue (AsyncTraceWriter::Get ().Relay ("DlPdcpStats.txt")));
+	Config::SetDefault ("ns3::RadioBearerStatsCalculator::UlPdcpOutputFilename", StringValue (AsyncTraceWriter::Get ().Relay ("UlPdcpStats.txt")));
+	Ptr<RadioBearerStatsCalculator> pdcpStats;
+	if (directTraceConnect)
+	{
+		pdcpStats = traceRegistry.EnablePdcpStats ();
+	}
+	else
+	{
+		lteHelper->EnablePdcpTraces();
+		pdcpStats = lteHelper->GetPdcpStats ();
+	}
+	if (sinrHistograms)
+	{
+		// summaries at the PDCP statistics epochs
+		sinrCollector.Connect (traceRegistry);
+		sinrCollector.Start (pdcpStats->GetStartTime (), pdcpStats->GetEpoch (), "SinrCqiEpochs.txt");
+	}
+	KpiTimeSeries kpiSeries (kpiHistory, kpiDownsample);
+	if (kpiHistory > 0)
+	{
+		kpiSeries.Connect (traceRegistry);
+		kpiSeries.Start (pdcpStats->GetStartTime (), pdcpStats->GetEpoch ());
+	}
+	// binary events of the categories compiled in with EVENT_LOG_CATEGORIES
+	EventLog eventLog;
+	eventLog.Start (traceRegistry, "EventLog.bin");
+	SchedulerLatencyProbe schedulerProbe (Seconds (schedulerLatencyBudget));
+	if (schedulerLatency)
+	{
+		schedulerProbe.Install (traceRegistry);
+	}
 
 	Simulator::Stop(Seconds(simTime));
 
+	if (reclaimFlows)
+	{
+		flowReclaimer.Start ("FlowCompletion.txt");
+	}
+	progress.Start (progressInterval, Seconds (simTime), progressFile);
 	Simulator::Run();
+	progress.Finish ();
+	remoteSinks.PrintStats ("RemoteHostFlowStats.txt");
+	if (flowSampleFraction > 0)
+	{
+		flowSampler.PrintStats ("SampledFlowStats.txt", "SampledFlowProfiles.txt");
+	}
+	if (PACKET_POOL)
+	{
+		PacketPool::PrintStats ("PacketPoolStats.txt");
+	}
+	if (kpiHistory > 0)
+	{
+		kpiSeries.PrintStats ("KpiTimeSeries.txt", "KpiSummary.txt");
+	}
+	if (schedulerLatency)
+	{
+		schedulerProbe.PrintStats ("SchedulerLatency.txt");
+	}
+	if (sinrHistograms)
+	{
+		sinrCollector.PrintHistograms ("SinrCqiHistograms.txt");
+	}
+	if (directTraceConnect)
+	{
+		traceRegistry.PrintConnectStats ("TraceConnectStats.txt");
+	}
 
+	// the PDCP statistics write their last epoch when disposed: before the
+	// trace relays are closed and the results are cached
+	pdcpStats->Dispose ();
 	Simulator::Destroy();
+	resultCache.Store ();
 
 	return 0;
 
 
 }
+
+int main(int argc, char *argv[]) {
+	return RunBatch (argc, argv, &RunScenario);
+}
@@ -0,0 +1,512 @@
+#ifndef CAPACITY_ESTIMATOR_H
+#define CAPACITY_ESTIMATOR_H
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/mobility-module.h"
+#include "ns3/applications-module.h"
+#include "ns3/lte-module.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace ns3 {
+
+static GlobalValue g_capacityEstimate ("capacityEstimate",
+                                       "Estimate the capacity analytically from the scenario and exit instead of running the simulation",
+                                       BooleanValue (false),
+                                       MakeBooleanChecker ());
+
+// Analytical screening of a fully set up scenario, without running it.  Every
+// UE is served by the cell with the best RSRP; the downlink SINR accounts for
+// the co-channel cells weighted by their load, and loads and SINRs are iterated
+// to a fixed point.  SINRs map to CQI, MCS and transport block size with the
+// same LteAmc tables as the simulation.  The offered load of every UE comes
+// from the UdpClient applications installed for it, and the cell resources are
+// shared according to three scheduler families:
+//   resource fair   (rr, pf, tta): equal share of the resource blocks
+//   throughput fair (bet, pss, tbfq): equal throughput
+//   max throughput  (mt): best channels first
+// The uplink is estimated as noise limited, with the UE power spread over an
+// equal share of the uplink resource blocks.
+class CapacityEstimator
+{
+public:
+  CapacityEstimator (std::string pathlossModelType, double simTime);
+
+  void AddCells (NetDeviceContainer enbDevs);
+  void AddUe (Ptr<NetDevice> ueDev, uint32_t profile);
+  // UdpClient applications on these nodes become the offered load of the UE they send to or from
+  void AddTrafficSources (NodeContainer nodes);
+
+  void Estimate ();
+  // writes <prefix>Cells.txt, <prefix>Ues.txt and <prefix>Profiles.txt
+  void Print (std::string prefix) const;
+
+  enum Family
+  {
+    RESOURCE_FAIR = 0,
+    THROUGHPUT_FAIR,
+    MAX_THROUGHPUT,
+    N_FAMILIES
+  };
+
+private:
+  struct Cell
+  {
+    Ptr<LteEnbNetDevice> dev;
+    uint16_t cellId;
+    uint32_t earfcn;
+    uint16_t dlRb;
+    uint16_t ulRb;
+    double txPowerPerRbMw;
+    double noiseFigure;
+    double load;
+    std::vector<uint32_t> ues;
+  };
+  struct Ue
+  {
+    Ptr<LteUeNetDevice> dev;
+    Ptr<Node> node;
+    uint32_t profile;
+    double ulTxPowerDbm;
+    double noiseFigure;
+    std::vector<double> dlRxPerRbMw;
+    std::vector<double> gainDb;
+    uint32_t cell;
+    double dlDemand;
+    double ulDemand;
+    double dlSinrDb;
+    int dlCqi;
+    double dlRate;
+    double ulSnrDb;
+    double ulRate;
+    double dlThroughput[N_FAMILIES];
+    double ulThroughput;
+  };
+
+  Ptr<PropagationLossModel> GetPathloss (uint32_t earfcn);
+  int GetCqi (double sinr) const;
+  double GetRate (double sinr, uint16_t nRb, bool downlink) const;
+  void Share (const Cell &cell, Family family);
+
+  std::string m_pathlossModelType;
+  double m_simTime;
+  Ptr<LteAmc> m_amc;
+  std::map<uint32_t, Ptr<PropagationLossModel> > m_pathloss;
+  std::vector<Cell> m_cells;
+  std::vector<Ue> m_ues;
+  std::map<Ptr<Node>, uint32_t> m_ueByNode;
+  std::map<Ipv4Address, uint32_t> m_ueByAddress;
+};
+
+inline
+CapacityEstimator::CapacityEstimator (std::string pathlossModelType, double simTime)
+  : m_pathlossModelType (pathlossModelType),
+    m_simTime (simTime)
+{
+  m_amc = CreateObject<LteAmc> ();
+}
+
+inline Ptr<PropagationLossModel>
+CapacityEstimator::GetPathloss (uint32_t earfcn)
+{
+  Ptr<PropagationLossModel> &model = m_pathloss[earfcn];
+  if (!model)
+  {
+      ObjectFactory factory;
+      factory.SetTypeId (m_pathlossModelType);
+      model = factory.Create<PropagationLossModel> ();
+      model->SetAttributeFailSafe ("Frequency", DoubleValue (LteSpectrumValueHelper::GetCarrierFrequency (earfcn)));
+  }
+  return model;
+}
+
+inline void
+CapacityEstimator::AddCells (NetDeviceContainer enbDevs)
+{
+  for (uint32_t i = 0; i < enbDevs.GetN (); ++i)
+  {
+      Cell cell;
+      cell.dev = enbDevs.Get (i)->GetObject<LteEnbNetDevice> ();
+      cell.cellId = cell.dev->GetCellId ();
+      cell.earfcn = cell.dev->GetDlEarfcn ();
+      cell.dlRb = cell.dev->GetDlBandwidth ();
+      cell.ulRb = cell.dev->GetUlBandwidth ();
+      cell.txPowerPerRbMw = std::pow (10.0, cell.dev->GetPhy ()->GetTxPower () / 10.0) / cell.dlRb;
+      DoubleValue noiseFigure;
+      cell.dev->GetPhy ()->GetAttribute ("NoiseFigure", noiseFigure);
+      cell.noiseFigure = noiseFigure.Get ();
+      cell.load = 1.0;
+      m_cells.push_back (cell);
+  }
+}
+
+inline void
+CapacityEstimator::AddUe (Ptr<NetDevice> ueDev, uint32_t profile)
+{
+  Ue ue;
+  ue.dev = ueDev->GetObject<LteUeNetDevice> ();
+  ue.node = ueDev->GetNode ();
+  ue.profile = profile;
+  ue.ulTxPowerDbm = ue.dev->GetPhy ()->GetTxPower ();
+  DoubleValue noiseFigure;
+  ue.dev->GetPhy ()->GetAttribute ("NoiseFigure", noiseFigure);
+  ue.noiseFigure = noiseFigure.Get ();
+  ue.cell = 0;
+  ue.dlDemand = 0;
+  ue.ulDemand = 0;
+  m_ueByNode[ue.node] = m_ues.size ();
+  Ptr<Ipv4> ipv4 = ue.node->GetObject<Ipv4> ();
+  if (ipv4 && ipv4->GetInterfaceForDevice (ueDev) >= 0)
+  {
+      m_ueByAddress[ipv4->GetAddress (ipv4->GetInterfaceForDevice (ueDev), 0).GetLocal ()] = m_ues.size ();
+  }
+  m_ues.push_back (ue);
+}
+
+inline void
+CapacityEstimator::AddTrafficSources (NodeContainer nodes)
+{
+  for (uint32_t n = 0; n < nodes.GetN (); ++n)
+  {
+      Ptr<Node> node = nodes.Get (n);
+      for (uint32_t a = 0; a < node->GetNApplications (); ++a)
+      {
+          Ptr<UdpClient> client = DynamicCast<UdpClient> (node->GetApplication (a));
+          if (!client)
+          {
+              continue;
+          }
+          UintegerValue packetSize;
+          UintegerValue maxPackets;
+          TimeValue interval;
+          TimeValue start;
+          AddressValue remote;
+          client->GetAttribute ("PacketSize", packetSize);
+          client->GetAttribute ("MaxPackets", maxPackets);
+          client->GetAttribute ("Interval", interval);
+          client->GetAttribute ("StartTime", start);
+          client->GetAttribute ("RemoteAddress", remote);
+          double duration = m_simTime - start.Get ().GetSeconds ();
+          if (duration <= 0 || interval.Get ().IsZero ())
+          {
+              continue;
+          }
+          double bits = packetSize.Get () * 8.0;
+          double rate = std::min (bits / interval.Get ().GetSeconds (), maxPackets.Get () * bits / duration);
+
+          std::map<Ptr<Node>, uint32_t>::iterator ue = m_ueByNode.find (node);
+          if (ue != m_ueByNode.end ())
+          {
+              m_ues[ue->second].ulDemand += rate;
+              continue;
+          }
+          Address address = remote.Get ();
+          Ipv4Address ip;
+          if (Ipv4Address::IsMatchingType (address))
+          {
+              ip = Ipv4Address::ConvertFrom (address);
+          }
+          else if (InetSocketAddress::IsMatchingType (address))
+          {
+              ip = InetSocketAddress::ConvertFrom (address).GetIpv4 ();
+          }
+          std::map<Ipv4Address, uint32_t>::iterator dst = m_ueByAddress.find (ip);
+          if (dst != m_ueByAddress.end ())
+          {
+              m_ues[dst->second].dlDemand += rate;
+          }
+      }
+  }
+}
+
+// CQI at the given linear SINR, with the spectral efficiency mapping of LteAmc (PiroEW2010)
+inline int
+CapacityEstimator::GetCqi (double sinr) const
+{
+  double ber = 0.00005;
+  double s = std::log (1 + sinr / (-std::log (5.0 * ber) / 1.5)) / std::log (2.0);
+  return m_amc->GetCqiFromSpectralEfficiency (s);
+}
+
+// Rate [bit/s] on nRb resource blocks at the given linear SINR
+inline double
+CapacityEstimator::GetRate (double sinr, uint16_t nRb, bool downlink) const
+{
+  int cqi = GetCqi (sinr);
+  if (cqi == 0 || nRb == 0)
+  {
+      return 0;
+  }
+  int mcs = m_amc->GetMcsFromCqi (cqi);
+  int tbs = downlink ? m_amc->GetDlTbSizeFromMcs (mcs, nRb) : m_amc->GetUlTbSizeFromMcs (mcs, nRb);
+  return tbs * 1000.0;
+}
+
+// Splits one unit of cell resources among its UEs: shares are filled up to the
+// demand, raising either the resource share or the throughput of all unsatisfied
+// UEs together (fair families) or serving the best channels first
+inline void
+CapacityEstimator::Share (const Cell &cell, Family family)
+{
+  std::vector<uint32_t> ues;
+  for (uint32_t i = 0; i < cell.ues.size (); ++i)
+  {
+      Ue &ue = m_ues[cell.ues[i]];
+      ue.dlThroughput[family] = 0;
+      if (ue.dlRate > 0 && ue.dlDemand > 0)
+      {
+          ues.push_back (cell.ues[i]);
+      }
+  }
+  double resources = 1.0;
+  if (family == MAX_THROUGHPUT)
+  {
+      std::vector<std::pair<double, uint32_t> > order;
+      for (uint32_t i = 0; i < ues.size (); ++i)
+      {
+          order.push_back (std::make_pair (-m_ues[ues[i]].dlRate, ues[i]));
+      }
+      std::sort (order.begin (), order.end ());
+      for (uint32_t i = 0; i < order.size () && resources > 0; ++i)
+      {
+          Ue &ue = m_ues[order[i].second];
+          double share = std::min (resources, ue.dlDemand / ue.dlRate);
+          ue.dlThroughput[family] = share * ue.dlRate;
+          resources -= share;
+      }
+      return;
+  }
+  // water filling: satisfy the UEs whose need is below the fair level, repeat
+  while (!ues.empty () && resources > 1e-12)
+  {
+      double level;
+      if (family == RESOURCE_FAIR)
+      {
+          level = resources / ues.size ();
+      }
+      else
+      {
+          double inverseRates = 0;
+          for (uint32_t i = 0; i < ues.size (); ++i)
+          {
+              inverseRates += 1 / m_ues[ues[i]].dlRate;
+          }
+          level = resources / inverseRates;
+      }
+      std::vector<uint32_t> unsatisfied;
+      for (uint32_t i = 0; i < ues.size (); ++i)
+      {
+          Ue &ue = m_ues[ues[i]];
+          double need = family == RESOURCE_FAIR ? ue.dlDemand / ue.dlRate : ue.dlDemand;
+          if (need <= level)
+          {
+              ue.dlThroughput[family] = ue.dlDemand;
+              resources -= ue.dlDemand / ue.dlRate;
+          }
+          else
+          {
+              unsatisfied.push_back (ues[i]);
+          }
+      }
+      if (unsatisfied.size () == ues.size ())
+      {
+          for (uint32_t i = 0; i < ues.size (); ++i)
+          {
+              Ue &ue = m_ues[ues[i]];
+              ue.dlThroughput[family] = family == RESOURCE_FAIR ? level * ue.dlRate : level;
+          }
+          return;
+      }
+      ues.swap (unsatisfied);
+  }
+}
+
+inline void
+CapacityEstimator::Estimate ()
+{
+  if (m_cells.empty ())
+  {
+      return;
+  }
+  // received power per resource block from every cell, and best RSRP server
+  for (uint32_t u = 0; u < m_ues.size (); ++u)
+  {
+      Ue &ue = m_ues[u];
+      Ptr<MobilityModel> ueMobility = ue.node->GetObject<MobilityModel> ();
+      double best = -1;
+      ue.dlRxPerRbMw.resize (m_cells.size ());
+      ue.gainDb.resize (m_cells.size ());
+      for (uint32_t c = 0; c < m_cells.size (); ++c)
+      {
+          Cell &cell = m_cells[c];
+          Ptr<MobilityModel> enbMobility = cell.dev->GetNode ()->GetObject<MobilityModel> ();
+          double gainDb = GetPathloss (cell.earfcn)->CalcRxPower (0, enbMobility, ueMobility);
+          Ptr<AntennaModel> antenna = cell.dev->GetPhy ()->GetDownlinkSpectrumPhy ()->GetRxAntenna ();
+          if (antenna)
+          {
+              gainDb += antenna->GetGainDb (Angles (ueMobility->GetPosition (), enbMobility->GetPosition ()));
+          }
+          ue.gainDb[c] = gainDb;
+          ue.dlRxPerRbMw[c] = cell.txPowerPerRbMw * std::pow (10.0, gainDb / 10.0);
+          if (ue.dlRxPerRbMw[c] > best)
+          {
+              best = ue.dlRxPerRbMw[c];
+              ue.cell = c;
+          }
+      }
+      m_cells[ue.cell].ues.push_back (u);
+  }
+
+  // downlink: interference weighted by the cell loads, iterated to a fixed point
+  for (uint32_t iteration = 0; iteration < 50; ++iteration)
+  {
+      for (uint32_t u = 0; u < m_ues.size (); ++u)
+      {
+          Ue &ue = m_ues[u];
+          const Cell &serving = m_cells[ue.cell];
+          double noise = std::pow (10.0, (-174 + 10 * std::log10 (180e3) + ue.noiseFigure) / 10.0);
+          double interference = 0;
+          for (uint32_t c = 0; c < m_cells.size (); ++c)
+          {
+              if (c != ue.cell && m_cells[c].earfcn == serving.earfcn)
+              {
+                  interference += m_cells[c].load * ue.dlRxPerRbMw[c];
+              }
+          }
+          double sinr = ue.dlRxPerRbMw[ue.cell] / (noise + interference);
+          ue.dlSinrDb = 10 * std::log10 (sinr);
+          ue.dlCqi = GetCqi (sinr);
+          ue.dlRate = GetRate (sinr, serving.dlRb, true);
+      }
+      double change = 0;
+      for (uint32_t c = 0; c < m_cells.size (); ++c)
+      {
+          Cell &cell = m_cells[c];
+          double load = 0;
+          for (uint32_t i = 0; i < cell.ues.size (); ++i)
+          {
+              const Ue &ue = m_ues[cell.ues[i]];
+              if (ue.dlRate > 0)
+              {
+                  load += ue.dlDemand / ue.dlRate;
+              }
+          }
+          load = std::min (load, 1.0);
+          change = std::max (change, std::abs (load - cell.load));
+          cell.load = load;
+      }
+      if (change < 1e-3)
+      {
+          break;
+      }
+  }
+  for (uint32_t c = 0; c < m_cells.size (); ++c)
+  {
+      for (uint32_t f = 0; f < N_FAMILIES; ++f)
+      {
+          Share (m_cells[c], (Family) f);
+      }
+  }
+
+  // uplink: equal share of the resource blocks, time shared beyond one block per UE
+  for (uint32_t c = 0; c < m_cells.size (); ++c)
+  {
+      const Cell &cell = m_cells[c];
+      uint32_t n = std::max<uint32_t> (cell.ues.size (), 1);
+      uint16_t nRb = std::max<uint32_t> (cell.ulRb / n, 1);
+      double timeShare = std::min (1.0, (double) cell.ulRb / n);
+      double noise = std::pow (10.0, (-174 + 10 * std::log10 (180e3 * nRb) + cell.noiseFigure) / 10.0);
+      for (uint32_t i = 0; i < cell.ues.size (); ++i)
+      {
+          Ue &ue = m_ues[cell.ues[i]];
+          double snr = std::pow (10.0, (ue.ulTxPowerDbm + ue.gainDb[c]) / 10.0) / noise;
+          ue.ulSnrDb = 10 * std::log10 (snr);
+          ue.ulRate = GetRate (snr, nRb, false) * timeShare;
+          ue.ulThroughput = std::min (ue.ulDemand, ue.ulRate);
+      }
+  }
+}
+
+inline void
+CapacityEstimator::Print (std::string prefix) const
+{
+  const char *families = "resourceFair\tthroughputFair\tmaxThroughput";
+
+  std::ofstream cells ((prefix + "Cells.txt").c_str ());
+  cells << "% cellId\tearfcn\tnUes\tdlLoad\tdlThroughput(" << families << ")\tulThroughput" << std::endl;
+  for (uint32_t c = 0; c < m_cells.size (); ++c)
+  {
+      const Cell &cell = m_cells[c];
+      double dl[N_FAMILIES] = {0, 0, 0};
+      double ul = 0;
+      for (uint32_t i = 0; i < cell.ues.size (); ++i)
+      {
+          const Ue &ue = m_ues[cell.ues[i]];
+          for (uint32_t f = 0; f < N_FAMILIES; ++f)
+          {
+              dl[f] += ue.dlThroughput[f];
+          }
+          ul += ue.ulThroughput;
+      }
+      cells << cell.cellId << "\t" << cell.earfcn << "\t" << cell.ues.size () << "\t" << cell.load;
+      for (uint32_t f = 0; f < N_FAMILIES; ++f)
+      {
+          cells << "\t" << dl[f];
+      }
+      cells << "\t" << ul << "\n";
+  }
+
+  std::ofstream ues ((prefix + "Ues.txt").c_str ());
+  ues << "% imsi\tcellId\tprofile\tdlSinrDb\tdlCqi\tdlRate\tdlDemand\tdlThroughput(" << families
+      << ")\tulSnrDb\tulRate\tulDemand\tulThroughput" << std::endl;
+  for (uint32_t u = 0; u < m_ues.size (); ++u)
+  {
+      const Ue &ue = m_ues[u];
+      ues << ue.dev->GetImsi () << "\t" << m_cells[ue.cell].cellId << "\t" << ue.profile
+          << "\t" << ue.dlSinrDb << "\t" << ue.dlCqi << "\t" << ue.dlRate << "\t" << ue.dlDemand;
+      for (uint32_t f = 0; f < N_FAMILIES; ++f)
+      {
+          ues << "\t" << ue.dlThroughput[f];
+      }
+      ues << "\t" << ue.ulSnrDb << "\t" << ue.ulRate << "\t" << ue.ulDemand << "\t" << ue.ulThroughput << "\n";
+  }
+
+  std::map<uint32_t, std::vector<double> > sums;
+  for (uint32_t u = 0; u < m_ues.size (); ++u)
+  {
+      const Ue &ue = m_ues[u];
+      std::vector<double> &sum = sums[ue.profile];
+      sum.resize (4 + N_FAMILIES);
+      sum[0] += 1;
+      sum[1] += ue.dlDemand;
+      for (uint32_t f = 0; f < N_FAMILIES; ++f)
+      {
+          sum[2 + f] += ue.dlThroughput[f];
+      }
+      sum[2 + N_FAMILIES] += ue.ulDemand;
+      sum[3 + N_FAMILIES] += ue.ulThroughput;
+  }
+  std::ofstream profiles ((prefix + "Profiles.txt").c_str ());
+  profiles << "% profile\tnUes\tmeanDlDemand\tmeanDlThroughput(" << families
+           << ")\tmeanUlDemand\tmeanUlThroughput" << std::endl;
+  for (std::map<uint32_t, std::vector<double> >::const_iterator it = sums.begin (); it != sums.end (); ++it)
+  {
+      profiles << it->first << "\t" << it->second[0];
+      for (uint32_t i = 1; i < it->second.size (); ++i)
+      {
+          profiles << "\t" << it->second[i] / it->second[0];
+      }
+      profiles << "\n";
+  }
+}
+
+} // namespace ns3
+
+#endif // CAPACITY_ESTIMATOR_H
@@ -0,0 +1,368 @@
+#ifndef CULLING_PROPAGATION_LOSS_MODEL_H
+#define CULLING_PROPAGATION_LOSS_MODEL_H
+
+#include "ns3/core-module.h"
+#include "ns3/mobility-module.h"
+#include "ns3/lte-module.h"
+#include "ns3/propagation-loss-model.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <map>
+#include <vector>
+
+namespace ns3 {
+
+// Culls the links whose received power is below the receiver noise floor by
+// more than a threshold.  Culled links get a loss of CULLED_LOSS_DB, which the
+// spectrum channel drops when its MaxLossDb attribute is below that value, so
+// the receiving PHY never sees the transmission.  The decision is cached per
+// transmitter and receiver and only re-evaluated once either end has moved
+// more than RefreshDistance; links above the threshold are always evaluated
+// exactly by the inner model.  Antenna gains are not included, which is
+// conservative for the (non-positive) LTE antenna models.
+//
+// The interference that culling removes is accumulated per receiver, and
+// PrintStats () reports the resulting upper bound of the SINR error, assuming
+// every culled transmitter is active on the same resource blocks.
+class CullingPropagationLossModel : public PropagationLossModel
+{
+public:
+  static constexpr double CULLED_LOSS_DB = 1000.0;
+
+  static TypeId GetTypeId ();
+  CullingPropagationLossModel ();
+  virtual ~CullingPropagationLossModel ();
+
+  static void PrintStats (std::string filename);
+
+protected:
+  virtual void DoDispose ();
+
+private:
+  struct Link
+  {
+    Vector txPosition;
+    Vector rxPosition;
+    bool culled;
+    // received power spectral density [mW/Hz]
+    double rxPsd;
+  };
+  struct Endpoint
+  {
+    bool known;
+    bool enb;
+    double txPowerDbm;
+    double bandwidthHz;
+    double noiseFigure;
+  };
+  struct Stats
+  {
+    Stats () : links (0), culledLinks (0), calls (0), culledCalls (0) {}
+    uint64_t links;
+    uint64_t culledLinks;
+    uint64_t calls;
+    uint64_t culledCalls;
+  };
+
+  virtual double DoCalcRxPower (double txPowerDbm, Ptr<MobilityModel> a, Ptr<MobilityModel> b) const;
+  virtual int64_t DoAssignStreams (int64_t stream);
+
+  void SetFrequency (double frequency);
+  double GetFrequency () const;
+  Ptr<PropagationLossModel> GetInner () const;
+  const Endpoint &GetEndpoint (Ptr<MobilityModel> node) const;
+  void SetCulled (Link &link, MobilityModel *rx, bool culled, double rxPsd) const;
+
+  static std::vector<CullingPropagationLossModel *> &GetInstances ();
+
+  std::string m_innerModelType;
+  double m_frequency;
+  double m_thresholdDb;
+  double m_noiseFigure;
+  double m_refreshDistance;
+
+  mutable Ptr<PropagationLossModel> m_inner;
+  mutable std::map<MobilityModel *, std::map<MobilityModel *, Link> > m_links;
+  mutable std::map<MobilityModel *, Endpoint> m_endpoints;
+  // culled interference [mW/Hz] and noise figure [dB] per receiver
+  mutable std::map<MobilityModel *, std::pair<double, double> > m_culledPower;
+  mutable Stats m_stats[2];
+};
+
+NS_OBJECT_ENSURE_REGISTERED (CullingPropagationLossModel);
+
+inline TypeId
+CullingPropagationLossModel::GetTypeId ()
+{
+  static TypeId tid = TypeId ("ns3::CullingPropagationLossModel")
+    .SetParent<PropagationLossModel> ()
+    .AddConstructor<CullingPropagationLossModel> ()
+    .AddAttribute ("InnerModelType",
+                   "TypeId of the propagation loss model computing the links that are kept",
+                   StringValue ("ns3::HybridBuildingsPropagationLossModel"),
+                   MakeStringAccessor (&CullingPropagationLossModel::m_innerModelType),
+                   MakeStringChecker ())
+    .AddAttribute ("Frequency",
+                   "Carrier frequency [Hz], forwarded to the inner model",
+                   DoubleValue (2160e6),
+                   MakeDoubleAccessor (&CullingPropagationLossModel::SetFrequency,
+                                       &CullingPropagationLossModel::GetFrequency),
+                   MakeDoubleChecker<double> ())
+    .AddAttribute ("ThresholdDb",
+                   "Links received below the noise floor plus this value [dB] are culled",
+                   DoubleValue (-10),
+                   MakeDoubleAccessor (&CullingPropagationLossModel::m_thresholdDb),
+                   MakeDoubleChecker<double> ())
+    .AddAttribute ("NoiseFigure",
+                   "Noise figure [dB] of receivers without an LTE PHY; LTE receivers use the one of their PHY",
+                   DoubleValue (5),
+                   MakeDoubleAccessor (&CullingPropagationLossModel::m_noiseFigure),
+                   MakeDoubleChecker<double> ())
+    .AddAttribute ("RefreshDistance",
+                   "Movement of either end [m] after which a culled link is evaluated again",
+                   DoubleValue (5),
+                   MakeDoubleAccessor (&CullingPropagationLossModel::m_refreshDistance),
+                   MakeDoubleChecker<double> (0))
+  ;
+  return tid;
+}
+
+inline
+CullingPropagationLossModel::CullingPropagationLossModel ()
+  : m_frequency (2160e6),
+    m_thresholdDb (-10),
+    m_noiseFigure (5),
+    m_refreshDistance (5)
+{
+  GetInstances ().push_back (this);
+}
+
+inline
+CullingPropagationLossModel::~CullingPropagationLossModel ()
+{
+  std::vector<CullingPropagationLossModel *> &instances = GetInstances ();
+  instances.erase (std::remove (instances.begin (), instances.end (), this), instances.end ());
+}
+
+inline void
+CullingPropagationLossModel::DoDispose ()
+{
+  m_inner = 0;
+  m_links.clear ();
+  m_endpoints.clear ();
+  m_culledPower.clear ();
+  PropagationLossModel::DoDispose ();
+}
+
+inline std::vector<CullingPropagationLossModel *> &
+CullingPropagationLossModel::GetInstances ()
+{
+  static std::vector<CullingPropagationLossModel *> instances;
+  return instances;
+}
+
+inline void
+CullingPropagationLossModel::SetFrequency (double frequency)
+{
+  m_frequency = frequency;
+  if (m_inner)
+  {
+      m_inner->SetAttributeFailSafe ("Frequency", DoubleValue (frequency));
+  }
+}
+
+inline double
+CullingPropagationLossModel::GetFrequency () const
+{
+  return m_frequency;
+}
+
+inline Ptr<PropagationLossModel>
+CullingPropagationLossModel::GetInner () const
+{
+  if (!m_inner)
+  {
+      ObjectFactory factory;
+      factory.SetTypeId (m_innerModelType);
+      m_inner = factory.Create<PropagationLossModel> ();
+      m_inner->SetAttributeFailSafe ("Frequency", DoubleValue (m_frequency));
+  }
+  return m_inner;
+}
+
+// Transmit power, bandwidth and noise figure of the LTE device on a node; UEs
+// are assumed to concentrate their power on a single resource block, the
+// worst case for culling
+inline const CullingPropagationLossModel::Endpoint &
+CullingPropagationLossModel::GetEndpoint (Ptr<MobilityModel> node) const
+{
+  std::map<MobilityModel *, Endpoint>::iterator it = m_endpoints.find (PeekPointer (node));
+  if (it != m_endpoints.end ())
+  {
+      return it->second;
+  }
+  Endpoint endpoint;
+  endpoint.known = false;
+  endpoint.enb = false;
+  endpoint.txPowerDbm = 0;
+  endpoint.bandwidthHz = 180e3;
+  endpoint.noiseFigure = m_noiseFigure;
+  DoubleValue noiseFigure;
+  Ptr<Node> n = node->GetObject<Node> ();
+  for (uint32_t i = 0; n && i < n->GetNDevices (); ++i)
+  {
+      Ptr<LteEnbNetDevice> enbDev = DynamicCast<LteEnbNetDevice> (n->GetDevice (i));
+      Ptr<LteUeNetDevice> ueDev = DynamicCast<LteUeNetDevice> (n->GetDevice (i));
+      if (enbDev)
+      {
+          endpoint.known = true;
+          endpoint.enb = true;
+          endpoint.txPowerDbm = enbDev->GetPhy ()->GetTxPower ();
+          endpoint.bandwidthHz = enbDev->GetDlBandwidth () * 180e3;
+          enbDev->GetPhy ()->GetAttribute ("NoiseFigure", noiseFigure);
+          endpoint.noiseFigure = noiseFigure.Get ();
+      }
+      else if (ueDev)
+      {
+          endpoint.known = true;
+          endpoint.txPowerDbm = ueDev->GetPhy ()->GetTxPower ();
+          ueDev->GetPhy ()->GetAttribute ("NoiseFigure", noiseFigure);
+          endpoint.noiseFigure = noiseFigure.Get ();
+      }
+  }
+  return m_endpoints[PeekPointer (node)] = endpoint;
+}
+
+inline void
+CullingPropagationLossModel::SetCulled (Link &link, MobilityModel *rx, bool culled, double rxPsd) const
+{
+  if (link.culled)
+  {
+      m_culledPower[rx].first -= link.rxPsd;
+  }
+  if (culled)
+  {
+      m_culledPower[rx].first += rxPsd;
+  }
+  link.culled = culled;
+  link.rxPsd = rxPsd;
+}
+
+inline double
+CullingPropagationLossModel::DoCalcRxPower (double txPowerDbm, Ptr<MobilityModel> a, Ptr<MobilityModel> b) const
+{
+  const Endpoint &tx = GetEndpoint (a);
+  if (!tx.known)
+  {
+      return GetInner ()->CalcRxPower (txPowerDbm, a, b);
+  }
+  Stats &stats = m_stats[tx.enb ? 0 : 1];
+  ++stats.calls;
+
+  Vector txPosition = a->GetPosition ();
+  Vector rxPosition = b->GetPosition ();
+  std::map<MobilityModel *, Link> &links = m_links[PeekPointer (a)];
+  std::map<MobilityModel *, Link>::iterator it = links.find (PeekPointer (b));
+  if (it != links.end () && it->second.culled
+      && CalculateDistance (txPosition, it->second.txPosition) <= m_refreshDistance
+      && CalculateDistance (rxPosition, it->second.rxPosition) <= m_refreshDistance)
+  {
+      ++stats.culledCalls;
+      return txPowerDbm - CULLED_LOSS_DB;
+  }
+  if (it == links.end ())
+  {
+      Link link;
+      link.culled = false;
+      link.rxPsd = 0;
+      it = links.insert (std::make_pair (PeekPointer (b), link)).first;
+      ++stats.links;
+  }
+
+  double gainDb = GetInner ()->CalcRxPower (0, a, b);
+  double rxPowerDbm = tx.txPowerDbm + gainDb;
+  const Endpoint &rx = GetEndpoint (b);
+  double noiseDbm = -174 + 10 * std::log10 (tx.bandwidthHz) + rx.noiseFigure;
+  bool culled = rxPowerDbm < noiseDbm + m_thresholdDb;
+  if (culled != it->second.culled)
+  {
+      if (culled)
+      {
+          ++stats.culledLinks;
+      }
+      else
+      {
+          --stats.culledLinks;
+      }
+  }
+  SetCulled (it->second, PeekPointer (b), culled, std::pow (10.0, rxPowerDbm / 10.0) / tx.bandwidthHz);
+  m_culledPower[PeekPointer (b)].second = rx.noiseFigure;
+  it->second.txPosition = txPosition;
+  it->second.rxPosition = rxPosition;
+  if (culled)
+  {
+      ++stats.culledCalls;
+      return txPowerDbm - CULLED_LOSS_DB;
+  }
+  return txPowerDbm + gainDb;
+}
+
+inline int64_t
+CullingPropagationLossModel::DoAssignStreams (int64_t stream)
+{
+  return GetInner ()->AssignStreams (stream);
+}
+
+// One line per direction: links and deliveries culled, and the maximum and mean
+// over receivers of the SINR error bound 10 log10 (1 + culled interference / noise)
+inline void
+CullingPropagationLossModel::PrintStats (std::string filename)
+{
+  std::ofstream outFile;
+  outFile.open (filename.c_str (), std::ios_base::out | std::ios_base::trunc);
+  if (!outFile.is_open ())
+  {
+      NS_LOG_UNCOND ("Can't open file " << filename);
+      return;
+  }
+  outFile << "% direction\tlinks\tculledLinks\tdeliveries\tculledDeliveries\tmaxSinrErrorDb\tmeanSinrErrorDb" << std::endl;
+  std::vector<CullingPropagationLossModel *> &instances = GetInstances ();
+  for (uint32_t direction = 0; direction < 2; ++direction)
+  {
+      Stats total;
+      double maxError = 0;
+      double sumError = 0;
+      uint32_t receivers = 0;
+      for (std::vector<CullingPropagationLossModel *>::iterator it = instances.begin (); it != instances.end (); ++it)
+      {
+          const Stats &stats = (*it)->m_stats[direction];
+          total.links += stats.links;
+          total.culledLinks += stats.culledLinks;
+          total.calls += stats.calls;
+          total.culledCalls += stats.culledCalls;
+          if (stats.calls == 0)
+          {
+              continue;
+          }
+          std::map<MobilityModel *, std::pair<double, double> >::const_iterator rx;
+          for (rx = (*it)->m_culledPower.begin (); rx != (*it)->m_culledPower.end (); ++rx)
+          {
+              double noisePsd = std::pow (10.0, (-174 + rx->second.second) / 10.0);
+              double error = 10 * std::log10 (1 + std::max (rx->second.first, 0.0) / noisePsd);
+              maxError = std::max (maxError, error);
+              sumError += error;
+              ++receivers;
+          }
+      }
+      outFile << (direction == 0 ? "DL" : "UL") << "\t" << total.links << "\t" << total.culledLinks
+              << "\t" << total.calls << "\t" << total.culledCalls
+              << "\t" << maxError << "\t" << (receivers > 0 ? sumError / receivers : 0.0) << std::endl;
+  }
+  outFile.close ();
+}
+
+} // namespace ns3
+
+#endif // CULLING_PROPAGATION_LOSS_MODEL_H
@@ -0,0 +1,280 @@
+#ifndef EVENT_LOG_H
+#define EVENT_LOG_H
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/lte-module.h"
+
+#include "async-trace-writer.h"
+#include "lte-trace-registry.h"
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Categories compiled into the event log, a mask of EventCategory values,
+// e.g. CXXFLAGS="-DEVENT_LOG_CATEGORIES=0x1f" for all of them.  The default
+// compiles the log out entirely.
+#ifndef EVENT_LOG_CATEGORIES
+#define EVENT_LOG_CATEGORIES 0
+#endif
+
+namespace ns3 {
+
+enum EventCategory
+{
+  EVENT_ATTACH = 1 << 0,
+  EVENT_HANDOVER = 1 << 1,
+  EVENT_BEARER = 1 << 2,
+  EVENT_RLC_DROP = 1 << 3,
+  EVENT_SCHEDULING = 1 << 4
+};
+
+template <uint32_t Category>
+struct EventCategoryEnabled
+{
+  static const bool value = (EVENT_LOG_CATEGORIES & Category) != 0;
+};
+
+// Binary log of typed LTE events, decoded offline by utils/decode-event-log.py.
+// The file is a 16-byte header ("LTEV", then uint32 version, record size and
+// category mask) followed by fixed 40-byte little-endian records:
+//
+//   double time; uint32 type; uint16 cellId; uint16 rnti; uint64 imsi; uint32 fields[4]
+//
+// with the fields of each type listed in EventLog::Type.  Sinks are only
+// connected for the compiled-in categories, and Log () of a category that is
+// not compiled in is empty, so disabled categories cost nothing at run time.
+// Records go through the AsyncTraceWriter like the text traces.
+class EventLog
+{
+public:
+  enum Type
+  {
+    ATTACH,            // -
+    HANDOVER_START,    // targetCellId
+    HANDOVER_END_OK,   // -
+    BEARER_SETUP,      // lcid, epsBearerId (0 for SRB1)
+    RLC_TX_DROP,       // lcid, size, uplink
+    DL_SCHEDULING,     // mcsTb1, sizeTb1, mcsTb2, sizeTb2
+    UL_SCHEDULING,     // mcs, size
+    HEADER = 0xff
+  };
+  static const uint32_t RECORD_SIZE = 40;
+
+  EventLog ();
+
+  // opens filename and connects the sinks of the compiled-in categories
+  void Start (LteTraceRegistry &registry, std::string filename);
+
+  template <uint32_t Category>
+  void Log (Type type, uint16_t cellId, uint16_t rnti, uint64_t imsi,
+            uint32_t f0 = 0, uint32_t f1 = 0, uint32_t f2 = 0, uint32_t f3 = 0);
+
+private:
+  struct Bearer
+  {
+    uint16_t cellId;
+    uint16_t rnti;
+    uint64_t imsi;
+    uint8_t lcid;
+    Ptr<LteUeRrc> ueRrc;
+  };
+
+  static void Attach (EventLog *log, uint64_t imsi, uint16_t cellId, uint16_t rnti);
+  static void HandoverStart (EventLog *log, uint64_t imsi, uint16_t cellId, uint16_t rnti, uint16_t targetCellId);
+  static void HandoverEndOk (EventLog *log, uint64_t imsi, uint16_t cellId, uint16_t rnti);
+  void NotifyBearer (Ptr<LteRadioBearerInfo> bearer, Ptr<LteUeRrc> ueRrc, uint16_t cellId, uint64_t imsi, uint16_t rnti);
+  static void RlcTxDrop (EventLog *log, uint32_t bearer, Ptr<const Packet> packet);
+  static void DlScheduling (EventLog *log, uint16_t cellId, DlSchedulingCallbackInfo info);
+  static void UlScheduling (EventLog *log, uint16_t cellId, uint32_t frameNo, uint32_t subframeNo,
+                            uint16_t rnti, uint8_t mcs, uint16_t size, uint8_t componentCarrierId);
+  static void Format (std::string &out, const AsyncTraceWriter::Record &record);
+
+  std::vector<Bearer> m_bearers;
+  int32_t m_stream;
+};
+
+inline
+EventLog::EventLog ()
+  : m_stream (-1)
+{
+}
+
+inline void
+EventLog::Start (LteTraceRegistry &registry, std::string filename)
+{
+  if (EVENT_LOG_CATEGORIES == 0)
+  {
+      return;
+  }
+  m_stream = AsyncTraceWriter::Get ().Open (filename, &EventLog::Format);
+  AsyncTraceWriter::Record header = AsyncTraceWriter::Record ();
+  header.stream = m_stream;
+  header.type = HEADER;
+  AsyncTraceWriter::Get ().Write (header);
+
+  const std::vector<Ptr<LteUeNetDevice> > &ueDevs = registry.GetUeDevices ();
+  const std::vector<Ptr<LteEnbNetDevice> > &enbDevs = registry.GetEnbDevices ();
+  for (uint32_t i = 0; i < ueDevs.size (); ++i)
+  {
+      Ptr<LteUeRrc> rrc = ueDevs[i]->GetRrc ();
+      if (EventCategoryEnabled<EVENT_ATTACH>::value)
+      {
+          rrc->TraceConnectWithoutContext ("ConnectionEstablished", MakeBoundCallback (&EventLog::Attach, this));
+          registry.CountConnections (1);
+      }
+      if (EventCategoryEnabled<EVENT_HANDOVER>::value)
+      {
+          rrc->TraceConnectWithoutContext ("HandoverStart", MakeBoundCallback (&EventLog::HandoverStart, this));
+          rrc->TraceConnectWithoutContext ("HandoverEndOk", MakeBoundCallback (&EventLog::HandoverEndOk, this));
+          registry.CountConnections (2);
+      }
+  }
+  if (EventCategoryEnabled<EVENT_SCHEDULING>::value)
+  {
+      for (uint32_t i = 0; i < enbDevs.size (); ++i)
+      {
+          Ptr<LteEnbMac> mac = enbDevs[i]->GetMac ();
+          mac->TraceConnectWithoutContext ("DlScheduling",
+            MakeBoundCallback (&EventLog::DlScheduling, this, enbDevs[i]->GetCellId ()));
+          mac->TraceConnectWithoutContext ("UlScheduling",
+            MakeBoundCallback (&EventLog::UlScheduling, this, enbDevs[i]->GetCellId ()));
+          registry.CountConnections (2);
+      }
+  }
+  if (EventCategoryEnabled<EVENT_BEARER>::value || EventCategoryEnabled<EVENT_RLC_DROP>::value)
+  {
+      registry.ConnectBearers (MakeCallback (&EventLog::NotifyBearer, this));
+  }
+}
+
+template <uint32_t Category>
+inline void
+EventLog::Log (Type type, uint16_t cellId, uint16_t rnti, uint64_t imsi,
+               uint32_t f0, uint32_t f1, uint32_t f2, uint32_t f3)
+{
+  if (!EventCategoryEnabled<Category>::value)
+  {
+      return;
+  }
+  AsyncTraceWriter::Record record = AsyncTraceWriter::Record ();
+  record.stream = m_stream;
+  record.type = type;
+  record.id = imsi;
+  record.values[0] = Simulator::Now ().GetSeconds ();
+  record.values[1] = ((uint32_t) cellId << 16) | rnti;
+  record.values[2] = f0;
+  record.values[3] = f1;
+  record.values[4] = f2;
+  record.values[5] = f3;
+  AsyncTraceWriter::Get ().Write (record);
+}
+
+inline void
+EventLog::Attach (EventLog *log, uint64_t imsi, uint16_t cellId, uint16_t rnti)
+{
+  log->Log<EVENT_ATTACH> (ATTACH, cellId, rnti, imsi);
+}
+
+inline void
+EventLog::HandoverStart (EventLog *log, uint64_t imsi, uint16_t cellId, uint16_t rnti, uint16_t targetCellId)
+{
+  log->Log<EVENT_HANDOVER> (HANDOVER_START, cellId, rnti, imsi, targetCellId);
+}
+
+inline void
+EventLog::HandoverEndOk (EventLog *log, uint64_t imsi, uint16_t cellId, uint16_t rnti)
+{
+  log->Log<EVENT_HANDOVER> (HANDOVER_END_OK, cellId, rnti, imsi);
+}
+
+// bearer setup is logged on the eNB side, RLC drops on both
+inline void
+EventLog::NotifyBearer (Ptr<LteRadioBearerInfo> bearer, Ptr<LteUeRrc> ueRrc, uint16_t cellId, uint64_t imsi, uint16_t rnti)
+{
+  uint8_t lcid = 1;
+  uint8_t epsBearerId = 0;
+  Ptr<LteDataRadioBearerInfo> drb = DynamicCast<LteDataRadioBearerInfo> (bearer);
+  if (drb)
+  {
+      lcid = drb->m_logicalChannelIdentity;
+      epsBearerId = drb->m_epsBearerIdentity;
+  }
+  if (!ueRrc)
+  {
+      Log<EVENT_BEARER> (BEARER_SETUP, cellId, rnti, imsi, lcid, epsBearerId);
+  }
+  if (EventCategoryEnabled<EVENT_RLC_DROP>::value && bearer->m_rlc)
+  {
+      Bearer label;
+      label.cellId = cellId;
+      label.rnti = rnti;
+      label.imsi = imsi;
+      label.lcid = lcid;
+      label.ueRrc = ueRrc;
+      m_bearers.push_back (label);
+      bearer->m_rlc->TraceConnectWithoutContext ("TxDrop",
+        MakeBoundCallback (&EventLog::RlcTxDrop, this, (uint32_t) m_bearers.size () - 1));
+  }
+}
+
+inline void
+EventLog::RlcTxDrop (EventLog *log, uint32_t bearer, Ptr<const Packet> packet)
+{
+  const Bearer &label = log->m_bearers[bearer];
+  // the UE side follows its RRC through handovers
+  uint16_t cellId = label.ueRrc ? label.ueRrc->GetCellId () : label.cellId;
+  uint16_t rnti = label.ueRrc ? label.ueRrc->GetRnti () : label.rnti;
+  log->Log<EVENT_RLC_DROP> (RLC_TX_DROP, cellId, rnti, label.imsi, label.lcid, packet->GetSize (), label.ueRrc ? 1 : 0);
+}
+
+inline void
+EventLog::DlScheduling (EventLog *log, uint16_t cellId, DlSchedulingCallbackInfo info)
+{
+  log->Log<EVENT_SCHEDULING> (DL_SCHEDULING, cellId, info.rnti, 0,
+                              info.mcsTb1, info.sizeTb1, info.mcsTb2, info.sizeTb2);
+}
+
+inline void
+EventLog::UlScheduling (EventLog *log, uint16_t cellId, uint32_t frameNo, uint32_t subframeNo,
+                        uint16_t rnti, uint8_t mcs, uint16_t size, uint8_t componentCarrierId)
+{
+  log->Log<EVENT_SCHEDULING> (UL_SCHEDULING, cellId, rnti, 0, mcs, size);
+}
+
+inline void
+EventLog::Format (std::string &out, const AsyncTraceWriter::Record &record)
+{
+  char buffer[RECORD_SIZE];
+  if (record.type == HEADER)
+  {
+      uint32_t words[] = { 1, RECORD_SIZE, EVENT_LOG_CATEGORIES };
+      std::memcpy (buffer, "LTEV", 4);
+      std::memcpy (buffer + 4, words, sizeof (words));
+      out.append (buffer, 16);
+      return;
+  }
+  double time = record.values[0];
+  uint32_t type = record.type;
+  uint32_t cellRnti = record.values[1];
+  uint16_t cellId = cellRnti >> 16;
+  uint16_t rnti = cellRnti & 0xffff;
+  uint64_t imsi = record.id;
+  uint32_t fields[4];
+  for (uint32_t f = 0; f < 4; ++f)
+  {
+      fields[f] = record.values[2 + f];
+  }
+  std::memcpy (buffer, &time, 8);
+  std::memcpy (buffer + 8, &type, 4);
+  std::memcpy (buffer + 12, &cellId, 2);
+  std::memcpy (buffer + 14, &rnti, 2);
+  std::memcpy (buffer + 16, &imsi, 8);
+  std::memcpy (buffer + 24, fields, 16);
+  out.append (buffer, RECORD_SIZE);
+}
+
+} // namespace ns3
+
+#endif // EVENT_LOG_H
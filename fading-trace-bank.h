@@ -0,0 +1,231 @@
+#ifndef FADING_TRACE_BANK_H
+#define FADING_TRACE_BANK_H
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/mobility-module.h"
+#include "ns3/spectrum-module.h"
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace ns3 {
+
+static GlobalValue g_fadingBank ("fadingBank",
+                                 "Fading trace bank generated by utils/generate-fading-bank.py (empty: no fast fading)",
+                                 StringValue (""),
+                                 MakeStringChecker ());
+
+// Read-only view of a fading trace bank file, mapped once per process with
+// MAP_SHARED so that every run on a machine shares the same page cache copy
+// instead of loading its own.  The file holds one block per RB count:
+//
+//   char magic[4] = "FADB"; uint32 version = 1; uint32 blocks; float samplePeriod [s]
+//   blocks x { uint32 rbCount; uint32 samples; uint64 offset }
+//   per block, at offset: float gain[samples][rbCount], linear power gain
+class FadingTraceBank
+{
+public:
+  // the bank mapped from filename, mapped on first use; fatal error if it is not a valid bank
+  static const FadingTraceBank &Get (std::string filename);
+
+  // samples of the block for rbCount RBs, 0 if the bank has none
+  const float *GetBlock (uint32_t rbCount, uint32_t &samples) const;
+  double GetSamplePeriod () const;
+
+private:
+  struct Block
+  {
+    const float *data;
+    uint32_t samples;
+  };
+
+  FadingTraceBank (std::string filename);
+
+  double m_samplePeriod;
+  std::map<uint32_t, Block> m_blocks;
+};
+
+inline const FadingTraceBank &
+FadingTraceBank::Get (std::string filename)
+{
+  static std::map<std::string, FadingTraceBank *> banks;
+  FadingTraceBank *&bank = banks[filename];
+  if (!bank)
+  {
+      bank = new FadingTraceBank (filename);
+  }
+  return *bank;
+}
+
+inline
+FadingTraceBank::FadingTraceBank (std::string filename)
+{
+  int fd = open (filename.c_str (), O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat (fd, &st) != 0 || st.st_size < 16)
+  {
+      NS_FATAL_ERROR ("Can't open fading trace bank " << filename);
+  }
+  void *map = mmap (0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close (fd);
+  if (map == MAP_FAILED)
+  {
+      NS_FATAL_ERROR ("Can't map fading trace bank " << filename);
+  }
+  const char *base = static_cast<const char *> (map);
+  uint32_t version;
+  uint32_t blocks;
+  float samplePeriod;
+  std::memcpy (&version, base + 4, 4);
+  std::memcpy (&blocks, base + 8, 4);
+  std::memcpy (&samplePeriod, base + 12, 4);
+  if (std::memcmp (base, "FADB", 4) != 0 || version != 1 || 16 + 16 * (uint64_t) blocks > (uint64_t) st.st_size)
+  {
+      NS_FATAL_ERROR (filename << " is not a version 1 fading trace bank");
+  }
+  m_samplePeriod = samplePeriod;
+  for (uint32_t b = 0; b < blocks; ++b)
+  {
+      uint32_t rbCount;
+      uint64_t offset;
+      Block block;
+      std::memcpy (&rbCount, base + 16 + 16 * b, 4);
+      std::memcpy (&block.samples, base + 20 + 16 * b, 4);
+      std::memcpy (&offset, base + 24 + 16 * b, 8);
+      if (offset % 4 != 0 || offset + 4ULL * rbCount * block.samples > (uint64_t) st.st_size)
+      {
+          NS_FATAL_ERROR (filename << ": block of " << rbCount << " RBs is truncated");
+      }
+      block.data = reinterpret_cast<const float *> (base + offset);
+      m_blocks[rbCount] = block;
+  }
+}
+
+inline const float *
+FadingTraceBank::GetBlock (uint32_t rbCount, uint32_t &samples) const
+{
+  std::map<uint32_t, Block>::const_iterator it = m_blocks.find (rbCount);
+  if (it == m_blocks.end ())
+  {
+      return 0;
+  }
+  samples = it->second.samples;
+  return it->second.data;
+}
+
+inline double
+FadingTraceBank::GetSamplePeriod () const
+{
+  return m_samplePeriod;
+}
+
+// Frequency-selective fast fading read from a FadingTraceBank, the shared
+// counterpart of TraceFadingLossModel.  Each eNB-UE link reads the block of
+// its RB count from a deterministic start offset, a hash of the two node ids
+// and the RNG run, and advances one sample per sample period of simulated
+// time, wrapping at the end of the block.  DL and UL of a link share the
+// offset.
+class BankFadingLossModel : public SpectrumPropagationLossModel
+{
+public:
+  static TypeId GetTypeId ();
+  BankFadingLossModel ();
+
+private:
+  virtual Ptr<SpectrumValue> DoCalcRxPowerSpectralDensity (Ptr<const SpectrumValue> txPsd,
+                                                           Ptr<const MobilityModel> a,
+                                                           Ptr<const MobilityModel> b) const;
+
+  std::string m_filename;
+  mutable const FadingTraceBank *m_bank;
+};
+
+NS_OBJECT_ENSURE_REGISTERED (BankFadingLossModel);
+
+inline TypeId
+BankFadingLossModel::GetTypeId ()
+{
+  static TypeId tid = TypeId ("ns3::BankFadingLossModel")
+    .SetParent<SpectrumPropagationLossModel> ()
+    .AddConstructor<BankFadingLossModel> ()
+    .AddAttribute ("BankFile",
+                   "Fading trace bank file",
+                   StringValue (""),
+                   MakeStringAccessor (&BankFadingLossModel::m_filename),
+                   MakeStringChecker ())
+  ;
+  return tid;
+}
+
+inline
+BankFadingLossModel::BankFadingLossModel ()
+  : m_bank (0)
+{
+}
+
+inline Ptr<SpectrumValue>
+BankFadingLossModel::DoCalcRxPowerSpectralDensity (Ptr<const SpectrumValue> txPsd,
+                                                   Ptr<const MobilityModel> a,
+                                                   Ptr<const MobilityModel> b) const
+{
+  Ptr<SpectrumValue> rxPsd = Copy<SpectrumValue> (txPsd);
+  if (!m_bank)
+  {
+      m_bank = &FadingTraceBank::Get (m_filename);
+  }
+  const FadingTraceBank &bank = *m_bank;
+  uint32_t rbCount = txPsd->GetSpectrumModel ()->GetNumBands ();
+  uint32_t samples = 0;
+  const float *block = bank.GetBlock (rbCount, samples);
+  if (!block)
+  {
+      NS_FATAL_ERROR ("Fading trace bank " << m_filename << " has no block for " << rbCount << " RBs");
+  }
+  uint32_t idA = a->GetObject<Node> ()->GetId ();
+  uint32_t idB = b->GetObject<Node> ()->GetId ();
+  uint64_t key = ((uint64_t) std::min (idA, idB) << 32) | std::max (idA, idB);
+  // splitmix64 of the link and the run
+  uint64_t h = key + RngSeedManager::GetRun () * 0x9e3779b97f4a7c15ULL;
+  h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+  h ^= h >> 31;
+  uint64_t sample = (h + (uint64_t) (Simulator::Now ().GetSeconds () / bank.GetSamplePeriod ())) % samples;
+  const float *gain = block + sample * rbCount;
+  Values::iterator value = rxPsd->ValuesBegin ();
+  for (uint32_t rb = 0; rb < rbCount; ++rb, ++value)
+  {
+      *value *= gain[rb];
+  }
+  return rxPsd;
+}
+
+// Adds a BankFadingLossModel reading filename to every spectrum channel
+// created so far, i.e. the LTE DL and UL channels once an eNB is installed.
+// LteHelper::SetFadingModel () only installs TraceFadingLossModel.
+inline void
+AddFadingBankToChannels (std::string filename)
+{
+  Ptr<BankFadingLossModel> fading = CreateObject<BankFadingLossModel> ();
+  fading->SetAttribute ("BankFile", StringValue (filename));
+  FadingTraceBank::Get (filename);
+  for (uint32_t c = 0; c < ChannelList::GetNChannels (); ++c)
+  {
+      Ptr<SpectrumChannel> channel = DynamicCast<SpectrumChannel> (ChannelList::GetChannel (c));
+      if (channel)
+      {
+          channel->AddSpectrumPropagationLossModel (fading);
+      }
+  }
+}
+
+} // namespace ns3
+
+#endif // FADING_TRACE_BANK_H
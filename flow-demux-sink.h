@@ -0,0 +1,256 @@
+#ifndef FLOW_DEMUX_SINK_H
+#define FLOW_DEMUX_SINK_H
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/applications-module.h"
+
+#include <fstream>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace ns3 {
+
+// One UDP sink per port that keeps per-source counters in a flat array instead
+// of one PacketSink (and socket) per flow.  The delay is taken from the SeqTs
+// header written by UdpClient, into power-of-two bins: bin 0 below 1 ms, bin k
+// in [2^(k-1), 2^k) ms, the last bin above that.
+class FlowDemuxSink : public Application
+{
+public:
+  static const uint32_t DELAY_BINS = 13;
+
+  struct Flow
+  {
+    Ipv4Address source;
+    uint64_t packets;
+    uint64_t bytes;
+    Time first;
+    Time last;
+    Time delaySum;
+    uint32_t delayHistogram[DELAY_BINS];
+  };
+
+  static TypeId GetTypeId ();
+  FlowDemuxSink ();
+
+  uint16_t GetPort () const;
+  const std::vector<Flow> &GetFlows () const;
+
+protected:
+  virtual void DoDispose ();
+
+private:
+  virtual void StartApplication ();
+  virtual void StopApplication ();
+  void HandleRead (Ptr<Socket> socket);
+
+  uint16_t m_port;
+  Ptr<Socket> m_socket;
+  std::vector<Flow> m_flows;
+  std::unordered_map<uint32_t, uint32_t> m_index;
+};
+
+NS_OBJECT_ENSURE_REGISTERED (FlowDemuxSink);
+
+inline TypeId
+FlowDemuxSink::GetTypeId ()
+{
+  static TypeId tid = TypeId ("ns3::FlowDemuxSink")
+    .SetParent<Application> ()
+    .AddConstructor<FlowDemuxSink> ()
+    .AddAttribute ("Port",
+                   "UDP port the sink listens on",
+                   UintegerValue (9),
+                   MakeUintegerAccessor (&FlowDemuxSink::m_port),
+                   MakeUintegerChecker<uint16_t> ())
+  ;
+  return tid;
+}
+
+inline
+FlowDemuxSink::FlowDemuxSink ()
+  : m_port (9)
+{
+}
+
+inline void
+FlowDemuxSink::DoDispose ()
+{
+  m_socket = 0;
+  Application::DoDispose ();
+}
+
+inline uint16_t
+FlowDemuxSink::GetPort () const
+{
+  return m_port;
+}
+
+inline const std::vector<FlowDemuxSink::Flow> &
+FlowDemuxSink::GetFlows () const
+{
+  return m_flows;
+}
+
+inline void
+FlowDemuxSink::StartApplication ()
+{
+  if (!m_socket)
+  {
+      m_socket = Socket::CreateSocket (GetNode (), UdpSocketFactory::GetTypeId ());
+      if (m_socket->Bind (InetSocketAddress (Ipv4Address::GetAny (), m_port)) == -1)
+      {
+          NS_FATAL_ERROR ("Failed to bind socket");
+      }
+  }
+  m_socket->SetRecvCallback (MakeCallback (&FlowDemuxSink::HandleRead, this));
+}
+
+inline void
+FlowDemuxSink::StopApplication ()
+{
+  if (m_socket)
+  {
+      m_socket->Close ();
+      m_socket->SetRecvCallback (MakeNullCallback<void, Ptr<Socket> > ());
+      m_socket = 0;
+  }
+}
+
+inline void
+FlowDemuxSink::HandleRead (Ptr<Socket> socket)
+{
+  Ptr<Packet> packet;
+  Address from;
+  while ((packet = socket->RecvFrom (from)))
+  {
+      if (!InetSocketAddress::IsMatchingType (from))
+      {
+          continue;
+      }
+      Ipv4Address source = InetSocketAddress::ConvertFrom (from).GetIpv4 ();
+      std::unordered_map<uint32_t, uint32_t>::iterator it = m_index.find (source.Get ());
+      if (it == m_index.end ())
+      {
+          Flow flow;
+          flow.source = source;
+          flow.packets = 0;
+          flow.bytes = 0;
+          flow.first = Simulator::Now ();
+          for (uint32_t k = 0; k < DELAY_BINS; ++k)
+          {
+              flow.delayHistogram[k] = 0;
+          }
+          it = m_index.insert (std::make_pair (source.Get (), m_flows.size ())).first;
+          m_flows.push_back (flow);
+      }
+      Flow &flow = m_flows[it->second];
+      ++flow.packets;
+      flow.bytes += packet->GetSize ();
+      flow.last = Simulator::Now ();
+      SeqTsHeader seqTs;
+      if (packet->GetSize () >= seqTs.GetSerializedSize ())
+      {
+          packet->PeekHeader (seqTs);
+          Time delay = Simulator::Now () - seqTs.GetTs ();
+          flow.delaySum += delay;
+          uint32_t bin = 0;
+          for (int64_t ms = delay.GetMilliSeconds (); ms > 0 && bin < DELAY_BINS - 1; ms >>= 1)
+          {
+              ++bin;
+          }
+          ++flow.delayHistogram[bin];
+      }
+  }
+}
+
+// Installs one FlowDemuxSink per port on a node, and writes their counters
+// labelled with the IMSI and traffic profile of the sending UE
+class FlowDemuxSinkHelper
+{
+public:
+  FlowDemuxSinkHelper (Ptr<Node> node);
+
+  // the sink of port, created and started on first use
+  ApplicationContainer Install (uint16_t port);
+  void SetFlowLabel (Ipv4Address source, uint64_t imsi, uint32_t profile);
+  void PrintStats (std::string filename) const;
+
+private:
+  Ptr<Node> m_node;
+  std::map<uint16_t, Ptr<FlowDemuxSink> > m_sinks;
+  std::map<Ipv4Address, std::pair<uint64_t, uint32_t> > m_labels;
+};
+
+inline
+FlowDemuxSinkHelper::FlowDemuxSinkHelper (Ptr<Node> node)
+  : m_node (node)
+{
+}
+
+inline ApplicationContainer
+FlowDemuxSinkHelper::Install (uint16_t port)
+{
+  Ptr<FlowDemuxSink> &sink = m_sinks[port];
+  if (!sink)
+  {
+      sink = CreateObject<FlowDemuxSink> ();
+      sink->SetAttribute ("Port", UintegerValue (port));
+      m_node->AddApplication (sink);
+  }
+  return ApplicationContainer (sink);
+}
+
+inline void
+FlowDemuxSinkHelper::SetFlowLabel (Ipv4Address source, uint64_t imsi, uint32_t profile)
+{
+  m_labels[source] = std::make_pair (imsi, profile);
+}
+
+inline void
+FlowDemuxSinkHelper::PrintStats (std::string filename) const
+{
+  std::ofstream outFile;
+  outFile.open (filename.c_str (), std::ios_base::out | std::ios_base::trunc);
+  if (!outFile.is_open ())
+  {
+      NS_LOG_UNCOND ("Can't open file " << filename);
+      return;
+  }
+  outFile << "% port\timsi\tprofile\tsource\tpackets\tbytes\tfirst\tlast\tmeanDelay\tdelayHistogram" << std::endl;
+  for (std::map<uint16_t, Ptr<FlowDemuxSink> >::const_iterator sink = m_sinks.begin (); sink != m_sinks.end (); ++sink)
+  {
+      const std::vector<FlowDemuxSink::Flow> &flows = sink->second->GetFlows ();
+      for (uint32_t i = 0; i < flows.size (); ++i)
+      {
+          const FlowDemuxSink::Flow &flow = flows[i];
+          std::map<Ipv4Address, std::pair<uint64_t, uint32_t> >::const_iterator label = m_labels.find (flow.source);
+          outFile << sink->first << "\t";
+          if (label != m_labels.end ())
+          {
+              outFile << label->second.first << "\t" << label->second.second;
+          }
+          else
+          {
+              outFile << "0\t-1";
+          }
+          outFile << "\t" << flow.source << "\t" << flow.packets << "\t" << flow.bytes
+                  << "\t" << flow.first.GetSeconds () << "\t" << flow.last.GetSeconds ()
+                  << "\t" << (flow.packets > 0 ? flow.delaySum.GetSeconds () / flow.packets : 0.0);
+          for (uint32_t k = 0; k < FlowDemuxSink::DELAY_BINS; ++k)
+          {
+              outFile << "\t" << flow.delayHistogram[k];
+          }
+          outFile << "\n";
+      }
+  }
+  outFile.close ();
+}
+
+} // namespace ns3
+
+#endif // FLOW_DEMUX_SINK_H
@@ -0,0 +1,224 @@
+#ifndef FLOW_RECLAIMER_H
+#define FLOW_RECLAIMER_H
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/applications-module.h"
+#include "ns3/lte-module.h"
+
+#include "async-trace-writer.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace ns3 {
+
+static GlobalValue g_reclaimFlows ("reclaimFlows",
+                                   "Stop the applications and release the dedicated bearer of every flow once it has finished",
+                                   BooleanValue (false),
+                                   MakeBooleanChecker ());
+static GlobalValue g_flowDrainTime ("flowDrainTime",
+                                    "Time [s] after the last packet of a flow is sent until its sinks and bearer are released",
+                                    DoubleValue (1.0),
+                                    MakeDoubleChecker<double> (0.0));
+
+// Releases the flows of the traffic profiles that finish before the end of the
+// run.  The end of a UdpClient is known in advance (start + (MaxPackets - 1)
+// * Interval, or its stop time, the only end of an unlimited client with
+// MaxPackets 0), so the clients are stopped there and the sinks
+// a drain time later, which closes their sockets and cancels their events.
+// The dedicated bearer of the UE is then deactivated, which removes its RLC
+// and PDCP entities and its scheduler state, and a completion record is
+// written.  Flows that run until the end of the simulation are left alone.
+class FlowReclaimer
+{
+public:
+  FlowReclaimer (Ptr<LteHelper> lteHelper, double drainTime, Time stopTime);
+
+  void AddCells (NetDeviceContainer enbDevs);
+  // clients and sinks of the flow of ueDev, carried by its dedicated bearer bearerId
+  void AddFlow (Ptr<NetDevice> ueDev, uint32_t profile, uint8_t bearerId,
+                ApplicationContainer clients, ApplicationContainer sinks);
+  // writes one completion record per reclaimed flow to filename
+  void Start (std::string filename);
+
+private:
+  struct Flow
+  {
+    Ptr<LteUeNetDevice> ueDev;
+    uint32_t profile;
+    uint8_t bearerId;
+    ApplicationContainer clients;
+    ApplicationContainer sinks;
+    double start;
+    double end;
+  };
+
+  void Reclaim (uint32_t flow);
+  static void Format (std::string &out, const AsyncTraceWriter::Record &record);
+
+  Ptr<LteHelper> m_lteHelper;
+  double m_drainTime;
+  double m_stopTime;
+  std::vector<Ptr<LteEnbNetDevice> > m_cells;
+  std::vector<Flow> m_flows;
+  int32_t m_stream;
+};
+
+inline
+FlowReclaimer::FlowReclaimer (Ptr<LteHelper> lteHelper, double drainTime, Time stopTime)
+  : m_lteHelper (lteHelper),
+    m_drainTime (drainTime),
+    m_stopTime (stopTime.GetSeconds ()),
+    m_stream (-1)
+{
+}
+
+inline void
+FlowReclaimer::AddCells (NetDeviceContainer enbDevs)
+{
+  for (uint32_t i = 0; i < enbDevs.GetN (); ++i)
+  {
+      m_cells.push_back (enbDevs.Get (i)->GetObject<LteEnbNetDevice> ());
+  }
+}
+
+inline void
+FlowReclaimer::AddFlow (Ptr<NetDevice> ueDev, uint32_t profile, uint8_t bearerId,
+                        ApplicationContainer clients, ApplicationContainer sinks)
+{
+  Flow flow;
+  flow.ueDev = ueDev->GetObject<LteUeNetDevice> ();
+  flow.profile = profile;
+  flow.bearerId = bearerId;
+  flow.clients = clients;
+  flow.sinks = sinks;
+  flow.start = m_stopTime;
+  flow.end = 0;
+  if (clients.GetN () == 0)
+  {
+      return;
+  }
+  for (uint32_t i = 0; i < clients.GetN (); ++i)
+  {
+      Ptr<UdpClient> client = DynamicCast<UdpClient> (clients.Get (i));
+      if (!client)
+      {
+          return;
+      }
+      UintegerValue maxPackets;
+      TimeValue interval;
+      TimeValue start;
+      TimeValue stop;
+      client->GetAttribute ("MaxPackets", maxPackets);
+      client->GetAttribute ("Interval", interval);
+      client->GetAttribute ("StartTime", start);
+      client->GetAttribute ("StopTime", stop);
+      // MaxPackets 0 is unlimited: the client runs until its stop time
+      double end = m_stopTime;
+      if (maxPackets.Get () > 0)
+      {
+          end = start.Get ().GetSeconds () + (maxPackets.Get () - 1.0) * interval.Get ().GetSeconds ();
+      }
+      if (stop.Get ().IsStrictlyPositive ())
+      {
+          end = std::min (end, stop.Get ().GetSeconds ());
+      }
+      flow.start = std::min (flow.start, start.Get ().GetSeconds ());
+      flow.end = std::max (flow.end, end);
+  }
+  if (flow.end + m_drainTime < m_stopTime)
+  {
+      m_flows.push_back (flow);
+  }
+}
+
+inline void
+FlowReclaimer::Start (std::string filename)
+{
+  m_stream = AsyncTraceWriter::Get ().Open (filename, &FlowReclaimer::Format);
+  AsyncTraceWriter::Record header = AsyncTraceWriter::Record ();
+  header.stream = m_stream;
+  header.type = 1;
+  AsyncTraceWriter::Get ().Write (header);
+  for (uint32_t f = 0; f < m_flows.size (); ++f)
+  {
+      Flow &flow = m_flows[f];
+      // a microsecond after the last packet, so that it is still sent
+      flow.clients.Stop (Seconds (flow.end + 1e-6));
+      flow.sinks.Stop (Seconds (flow.end + m_drainTime));
+      Simulator::Schedule (Seconds (flow.end + m_drainTime) - Simulator::Now () + NanoSeconds (1),
+                           &FlowReclaimer::Reclaim, this, f);
+  }
+}
+
+inline void
+FlowReclaimer::Reclaim (uint32_t f)
+{
+  Flow &flow = m_flows[f];
+  uint64_t txBytes = 0;
+  uint64_t rxBytes = 0;
+  for (uint32_t i = 0; i < flow.clients.GetN (); ++i)
+  {
+      txBytes += DynamicCast<UdpClient> (flow.clients.Get (i))->GetTotalTx ();
+  }
+  for (uint32_t i = 0; i < flow.sinks.GetN (); ++i)
+  {
+      Ptr<PacketSink> sink = DynamicCast<PacketSink> (flow.sinks.Get (i));
+      if (sink)
+      {
+          rxBytes += sink->GetTotalRx ();
+      }
+  }
+
+  bool released = false;
+  Ptr<LteUeRrc> rrc = flow.ueDev->GetRrc ();
+  if (rrc->GetState () == LteUeRrc::CONNECTED_NORMALLY)
+  {
+      for (uint32_t c = 0; c < m_cells.size (); ++c)
+      {
+          if (m_cells[c]->GetCellId () == rrc->GetCellId ())
+          {
+              m_lteHelper->DeActivateDedicatedEpsBearer (flow.ueDev, m_cells[c], flow.bearerId);
+              released = true;
+              break;
+          }
+      }
+  }
+
+  AsyncTraceWriter::Record record = AsyncTraceWriter::Record ();
+  record.stream = m_stream;
+  record.type = 0;
+  record.id = flow.ueDev->GetImsi ();
+  record.values[0] = flow.profile;
+  record.values[1] = flow.start;
+  record.values[2] = flow.end;
+  record.values[3] = txBytes;
+  record.values[4] = rxBytes;
+  // -1 if the UE was not connected and its bearer could not be released
+  record.values[5] = released ? Simulator::Now ().GetSeconds () : -1;
+  AsyncTraceWriter::Get ().Write (record);
+  flow.clients = ApplicationContainer ();
+  flow.sinks = ApplicationContainer ();
+}
+
+inline void
+FlowReclaimer::Format (std::string &out, const AsyncTraceWriter::Record &record)
+{
+  if (record.type == 1)
+  {
+      out += "% imsi\tprofile\tstart\tend\ttxBytes\trxBytes\treleased\n";
+      return;
+  }
+  char line[256];
+  std::snprintf (line, sizeof (line), "%lld\t%.0f\t%g\t%g\t%.0f\t%.0f\t%g\n",
+                 (long long) record.id, record.values[0], record.values[1], record.values[2],
+                 record.values[3], record.values[4], record.values[5]);
+  out += line;
+}
+
+} // namespace ns3
+
+#endif // FLOW_RECLAIMER_H
@@ -0,0 +1,230 @@
+#ifndef HANDOVER_STATS_COLLECTOR_H
+#define HANDOVER_STATS_COLLECTOR_H
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/lte-module.h"
+
+#include "lte-trace-registry.h"
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace ns3 {
+
+static GlobalValue g_handoverStats ("handoverStats",
+                                    "Count handovers per source and target cell pair",
+                                    BooleanValue (false),
+                                    MakeBooleanChecker ());
+static GlobalValue g_handoverPingPongTime ("handoverPingPongTime",
+                                           "Time [s] within which a handover back to the previous cell counts as a ping-pong",
+                                           DoubleValue (1.0),
+                                           MakeDoubleChecker<double> (0.0));
+
+// Counts handovers per (source, target) cell pair in a sparse map, from the
+// RRC trace sources instead of RRC logging.  The source eNB reports the
+// preparation (HandoverStart), the UE the execution: its HandoverStart when
+// it receives the mobility reconfiguration, then HandoverEndOk once it is
+// connected to the target, or HandoverEndError.  The interruption time is the
+// time between the two UE events.  A successful handover back to the cell the
+// UE left less than the ping-pong time earlier is counted as a ping-pong of
+// the first handover.  Handovers still running at the end are incomplete.
+class HandoverStatsCollector
+{
+public:
+  HandoverStatsCollector (Time pingPongTime);
+
+  void Connect (const LteTraceRegistry &registry);
+  void PrintStats (std::string filename) const;
+
+private:
+  struct Pair
+  {
+    uint64_t prepared;
+    uint64_t started;
+    uint64_t succeeded;
+    uint64_t failed;
+    uint64_t pingPongs;
+    Time interruptionSum;
+    Time interruptionMax;
+  };
+  struct Ue
+  {
+    bool running;
+    Time start;
+    uint16_t source;
+    uint16_t target;
+    Time lastEnd;
+    uint16_t lastSource;
+    uint16_t lastTarget;
+  };
+
+  static void EnbStart (HandoverStatsCollector *collector,
+                        uint64_t imsi, uint16_t cellId, uint16_t rnti, uint16_t targetCellId);
+  static void UeStart (HandoverStatsCollector *collector, uint32_t ue,
+                       uint64_t imsi, uint16_t cellId, uint16_t rnti, uint16_t targetCellId);
+  static void UeEndOk (HandoverStatsCollector *collector, uint32_t ue,
+                       uint64_t imsi, uint16_t cellId, uint16_t rnti);
+  static void UeEndError (HandoverStatsCollector *collector, uint32_t ue,
+                          uint64_t imsi, uint16_t cellId, uint16_t rnti);
+
+  Pair &GetPair (uint16_t source, uint16_t target);
+
+  Time m_pingPongTime;
+  std::vector<Ue> m_ues;
+  std::unordered_map<uint32_t, Pair> m_pairs;
+};
+
+inline
+HandoverStatsCollector::HandoverStatsCollector (Time pingPongTime)
+  : m_pingPongTime (pingPongTime)
+{
+}
+
+inline void
+HandoverStatsCollector::Connect (const LteTraceRegistry &registry)
+{
+  const std::vector<Ptr<LteEnbNetDevice> > &enbDevs = registry.GetEnbDevices ();
+  for (uint32_t i = 0; i < enbDevs.size (); ++i)
+  {
+      enbDevs[i]->GetRrc ()->TraceConnectWithoutContext ("HandoverStart",
+        MakeBoundCallback (&HandoverStatsCollector::EnbStart, this));
+  }
+  const std::vector<Ptr<LteUeNetDevice> > &ueDevs = registry.GetUeDevices ();
+  Ue idle;
+  idle.running = false;
+  idle.source = 0;
+  idle.target = 0;
+  idle.lastSource = 0;
+  idle.lastTarget = 0;
+  m_ues.assign (ueDevs.size (), idle);
+  for (uint32_t i = 0; i < ueDevs.size (); ++i)
+  {
+      Ptr<LteUeRrc> rrc = ueDevs[i]->GetRrc ();
+      rrc->TraceConnectWithoutContext ("HandoverStart", MakeBoundCallback (&HandoverStatsCollector::UeStart, this, i));
+      rrc->TraceConnectWithoutContext ("HandoverEndOk", MakeBoundCallback (&HandoverStatsCollector::UeEndOk, this, i));
+      rrc->TraceConnectWithoutContext ("HandoverEndError", MakeBoundCallback (&HandoverStatsCollector::UeEndError, this, i));
+  }
+}
+
+inline HandoverStatsCollector::Pair &
+HandoverStatsCollector::GetPair (uint16_t source, uint16_t target)
+{
+  uint32_t key = ((uint32_t) source << 16) | target;
+  std::unordered_map<uint32_t, Pair>::iterator it = m_pairs.find (key);
+  if (it == m_pairs.end ())
+  {
+      Pair pair;
+      pair.prepared = 0;
+      pair.started = 0;
+      pair.succeeded = 0;
+      pair.failed = 0;
+      pair.pingPongs = 0;
+      it = m_pairs.insert (std::make_pair (key, pair)).first;
+  }
+  return it->second;
+}
+
+inline void
+HandoverStatsCollector::EnbStart (HandoverStatsCollector *collector,
+                                  uint64_t imsi, uint16_t cellId, uint16_t rnti, uint16_t targetCellId)
+{
+  ++collector->GetPair (cellId, targetCellId).prepared;
+}
+
+inline void
+HandoverStatsCollector::UeStart (HandoverStatsCollector *collector, uint32_t ue,
+                                 uint64_t imsi, uint16_t cellId, uint16_t rnti, uint16_t targetCellId)
+{
+  Ue &state = collector->m_ues[ue];
+  if (state.running)
+  {
+      // superseded before it ended
+      ++collector->GetPair (state.source, state.target).failed;
+  }
+  state.running = true;
+  state.start = Simulator::Now ();
+  state.source = cellId;
+  state.target = targetCellId;
+  ++collector->GetPair (cellId, targetCellId).started;
+}
+
+inline void
+HandoverStatsCollector::UeEndOk (HandoverStatsCollector *collector, uint32_t ue,
+                                 uint64_t imsi, uint16_t cellId, uint16_t rnti)
+{
+  Ue &state = collector->m_ues[ue];
+  if (!state.running)
+  {
+      return;
+  }
+  state.running = false;
+  Pair &pair = collector->GetPair (state.source, state.target);
+  ++pair.succeeded;
+  Time interruption = Simulator::Now () - state.start;
+  pair.interruptionSum += interruption;
+  pair.interruptionMax = std::max (pair.interruptionMax, interruption);
+  if (state.lastEnd.IsStrictlyPositive () && state.lastSource == state.target && state.lastTarget == state.source
+      && state.start - state.lastEnd < collector->m_pingPongTime)
+  {
+      ++collector->GetPair (state.lastSource, state.lastTarget).pingPongs;
+  }
+  state.lastEnd = Simulator::Now ();
+  state.lastSource = state.source;
+  state.lastTarget = state.target;
+}
+
+inline void
+HandoverStatsCollector::UeEndError (HandoverStatsCollector *collector, uint32_t ue,
+                                    uint64_t imsi, uint16_t cellId, uint16_t rnti)
+{
+  Ue &state = collector->m_ues[ue];
+  if (!state.running)
+  {
+      return;
+  }
+  state.running = false;
+  ++collector->GetPair (state.source, state.target).failed;
+}
+
+inline void
+HandoverStatsCollector::PrintStats (std::string filename) const
+{
+  std::map<uint32_t, uint64_t> incomplete;
+  for (uint32_t i = 0; i < m_ues.size (); ++i)
+  {
+      if (m_ues[i].running)
+      {
+          ++incomplete[((uint32_t) m_ues[i].source << 16) | m_ues[i].target];
+      }
+  }
+  std::ofstream outFile;
+  outFile.open (filename.c_str (), std::ios_base::out | std::ios_base::trunc);
+  if (!outFile.is_open ())
+  {
+      NS_LOG_UNCOND ("Can't open file " << filename);
+      return;
+  }
+  outFile << "% sourceCellId\ttargetCellId\tprepared\tstarted\tsucceeded\tfailed\tincomplete\tpingPongs"
+          << "\tmeanInterruption\tmaxInterruption" << std::endl;
+  std::map<uint32_t, Pair> sorted (m_pairs.begin (), m_pairs.end ());
+  for (std::map<uint32_t, Pair>::const_iterator it = sorted.begin (); it != sorted.end (); ++it)
+  {
+      const Pair &pair = it->second;
+      std::map<uint32_t, uint64_t>::const_iterator running = incomplete.find (it->first);
+      outFile << (it->first >> 16) << "\t" << (it->first & 0xffff)
+              << "\t" << pair.prepared << "\t" << pair.started << "\t" << pair.succeeded << "\t" << pair.failed
+              << "\t" << (running != incomplete.end () ? running->second : 0) << "\t" << pair.pingPongs
+              << "\t" << (pair.succeeded > 0 ? pair.interruptionSum.GetSeconds () / pair.succeeded : 0.0)
+              << "\t" << pair.interruptionMax.GetSeconds () << "\n";
+  }
+  outFile.close ();
+}
+
+} // namespace ns3
+
+#endif // HANDOVER_STATS_COLLECTOR_H
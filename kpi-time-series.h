@@ -0,0 +1,379 @@
+#ifndef KPI_TIME_SERIES_H
+#define KPI_TIME_SERIES_H
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/lte-module.h"
+
+#include "lte-trace-registry.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace ns3 {
+
+static GlobalValue g_kpiHistory ("kpiHistory",
+                                 "Epochs of PDCP throughput and delay kept per UE and direction (0: disabled)",
+                                 UintegerValue (0),
+                                 MakeUintegerChecker<uint32_t> ());
+static GlobalValue g_kpiDownsample ("kpiDownsample",
+                                    "Epochs merged into one sample of the older KPI history (1: older epochs are dropped)",
+                                    UintegerValue (8),
+                                    MakeUintegerChecker<uint32_t> (1));
+
+// Per-UE, per-direction time series of the PDCP throughput and delay, in
+// memory bounded by the history length whatever the simulated time.  Every
+// epoch of the PDCP statistics closes one sample (bytes, PDUs and summed
+// delay received) into a ring of the last kpiHistory epochs; the epochs that
+// fall out of it are merged kpiDownsample at a time into a second ring of as
+// many coarse samples, so the history covers kpiHistory * (1 + kpiDownsample)
+// epochs.  The running mean and variance of the epoch throughput and mean
+// delay (Welford) cover every epoch of the run.  Dump () writes the current
+// rings at any time; PrintStats () writes them and the running statistics at
+// the end.
+class KpiTimeSeries
+{
+public:
+  enum Direction
+  {
+    DL,
+    UL
+  };
+
+  KpiTimeSeries (uint32_t history, uint32_t downsample);
+
+  // connects the PDCP of the bearers of the registered devices
+  void Connect (LteTraceRegistry &registry);
+  // closes a sample every epoch, aligned with a RadioBearerStatsCalculator
+  void Start (Time startTime, Time epoch);
+  void Dump (std::string filename) const;
+  void PrintStats (std::string samplesFilename, std::string summaryFilename) const;
+
+private:
+  struct Sample
+  {
+    double start;
+    double end;
+    uint64_t bytes;
+    uint64_t packets;
+    double delaySum;
+  };
+  struct Ring
+  {
+    std::vector<Sample> slots;
+    uint32_t head;
+    uint32_t size;
+  };
+  struct Welford
+  {
+    uint64_t n;
+    double mean;
+    double m2;
+  };
+  struct Series
+  {
+    uint64_t imsi;
+    Direction direction;
+    Sample current;
+    Sample merging;
+    uint32_t merged;
+    Ring recent;
+    Ring older;
+    Welford throughput;
+    Welford delay;
+  };
+
+  static void DlRxPdu (KpiTimeSeries *series, uint32_t index,
+                       uint16_t rnti, uint8_t lcid, uint32_t size, uint64_t delay);
+  static void UlRxPdu (KpiTimeSeries *series, uint32_t index,
+                       uint16_t rnti, uint8_t lcid, uint32_t size, uint64_t delay);
+  void ConnectPdcp (Ptr<LteRadioBearerInfo> bearer, Ptr<LteUeRrc> ueRrc, uint16_t cellId, uint64_t imsi, uint16_t rnti);
+  uint32_t GetSeries (uint64_t imsi, Direction direction);
+  void Add (uint32_t index, uint32_t size, uint64_t delay);
+  void EndEpoch ();
+
+  static Sample EmptySample (double start);
+  static bool Push (Ring &ring, const Sample &sample, Sample &evicted);
+  static void Update (Welford &welford, double value);
+  void WriteSamples (std::ofstream &outFile) const;
+
+  uint32_t m_history;
+  uint32_t m_downsample;
+  Time m_startTime;
+  Time m_epoch;
+  std::vector<Series> m_series;
+  std::unordered_map<uint64_t, uint32_t> m_index;
+};
+
+inline
+KpiTimeSeries::KpiTimeSeries (uint32_t history, uint32_t downsample)
+  : m_history (history),
+    m_downsample (downsample)
+{
+}
+
+inline void
+KpiTimeSeries::Connect (LteTraceRegistry &registry)
+{
+  registry.ConnectBearers (MakeCallback (&KpiTimeSeries::ConnectPdcp, this));
+}
+
+inline void
+KpiTimeSeries::ConnectPdcp (Ptr<LteRadioBearerInfo> bearer, Ptr<LteUeRrc> ueRrc, uint16_t cellId, uint64_t imsi, uint16_t rnti)
+{
+  if (!bearer->m_pdcp)
+  {
+      return;
+  }
+  if (ueRrc)
+  {
+      bearer->m_pdcp->TraceConnectWithoutContext ("RxPDU",
+        MakeBoundCallback (&KpiTimeSeries::DlRxPdu, this, GetSeries (imsi, DL)));
+  }
+  else
+  {
+      bearer->m_pdcp->TraceConnectWithoutContext ("RxPDU",
+        MakeBoundCallback (&KpiTimeSeries::UlRxPdu, this, GetSeries (imsi, UL)));
+  }
+}
+
+inline void
+KpiTimeSeries::Start (Time startTime, Time epoch)
+{
+  m_startTime = startTime;
+  m_epoch = epoch;
+  for (uint32_t i = 0; i < m_series.size (); ++i)
+  {
+      m_series[i].current = EmptySample (startTime.GetSeconds ());
+  }
+  Simulator::Schedule (startTime + epoch - Simulator::Now (), &KpiTimeSeries::EndEpoch, this);
+}
+
+inline KpiTimeSeries::Sample
+KpiTimeSeries::EmptySample (double start)
+{
+  Sample sample;
+  sample.start = start;
+  sample.end = start;
+  sample.bytes = 0;
+  sample.packets = 0;
+  sample.delaySum = 0;
+  return sample;
+}
+
+// the rings are allocated once, when the UE first connects
+inline uint32_t
+KpiTimeSeries::GetSeries (uint64_t imsi, Direction direction)
+{
+  uint64_t key = imsi * 2 + direction;
+  std::unordered_map<uint64_t, uint32_t>::iterator it = m_index.find (key);
+  if (it != m_index.end ())
+  {
+      return it->second;
+  }
+  Series series;
+  series.imsi = imsi;
+  series.direction = direction;
+  double now = std::max (Simulator::Now (), m_startTime).GetSeconds ();
+  series.current = EmptySample (now);
+  series.merging = EmptySample (now);
+  series.merged = 0;
+  series.recent.slots.resize (m_history);
+  series.recent.head = 0;
+  series.recent.size = 0;
+  series.older.slots.resize (m_downsample > 1 ? m_history : 0);
+  series.older.head = 0;
+  series.older.size = 0;
+  series.throughput.n = 0;
+  series.throughput.mean = 0;
+  series.throughput.m2 = 0;
+  series.delay = series.throughput;
+  m_index[key] = m_series.size ();
+  m_series.push_back (series);
+  return m_series.size () - 1;
+}
+
+inline void
+KpiTimeSeries::DlRxPdu (KpiTimeSeries *series, uint32_t index,
+                        uint16_t rnti, uint8_t lcid, uint32_t size, uint64_t delay)
+{
+  series->Add (index, size, delay);
+}
+
+inline void
+KpiTimeSeries::UlRxPdu (KpiTimeSeries *series, uint32_t index,
+                        uint16_t rnti, uint8_t lcid, uint32_t size, uint64_t delay)
+{
+  series->Add (index, size, delay);
+}
+
+inline void
+KpiTimeSeries::Add (uint32_t index, uint32_t size, uint64_t delay)
+{
+  if (Simulator::Now () < m_startTime)
+  {
+      return;
+  }
+  Sample &current = m_series[index].current;
+  current.bytes += size;
+  ++current.packets;
+  current.delaySum += delay * 1e-9;
+}
+
+// Stores the sample and returns true with the evicted oldest one if the ring
+// was full
+inline bool
+KpiTimeSeries::Push (Ring &ring, const Sample &sample, Sample &evicted)
+{
+  if (ring.slots.empty ())
+  {
+      evicted = sample;
+      return true;
+  }
+  bool full = ring.size == ring.slots.size ();
+  if (full)
+  {
+      evicted = ring.slots[ring.head];
+  }
+  else
+  {
+      ++ring.size;
+  }
+  ring.slots[ring.head] = sample;
+  ring.head = (ring.head + 1) % ring.slots.size ();
+  return full;
+}
+
+inline void
+KpiTimeSeries::Update (Welford &welford, double value)
+{
+  ++welford.n;
+  double delta = value - welford.mean;
+  welford.mean += delta / welford.n;
+  welford.m2 += delta * (value - welford.mean);
+}
+
+inline void
+KpiTimeSeries::EndEpoch ()
+{
+  double now = Simulator::Now ().GetSeconds ();
+  for (uint32_t i = 0; i < m_series.size (); ++i)
+  {
+      Series &series = m_series[i];
+      Sample sample = series.current;
+      sample.end = now;
+      series.current = EmptySample (now);
+      if (sample.end <= sample.start)
+      {
+          continue;
+      }
+      Update (series.throughput, sample.bytes * 8.0 / (sample.end - sample.start));
+      if (sample.packets > 0)
+      {
+          Update (series.delay, sample.delaySum / sample.packets);
+      }
+      Sample evicted;
+      if (!Push (series.recent, sample, evicted) || m_downsample <= 1)
+      {
+          continue;
+      }
+      if (series.merged == 0)
+      {
+          series.merging = evicted;
+      }
+      else
+      {
+          series.merging.end = evicted.end;
+          series.merging.bytes += evicted.bytes;
+          series.merging.packets += evicted.packets;
+          series.merging.delaySum += evicted.delaySum;
+      }
+      if (++series.merged == m_downsample)
+      {
+          Push (series.older, series.merging, evicted);
+          series.merged = 0;
+      }
+  }
+  Simulator::Schedule (m_epoch, &KpiTimeSeries::EndEpoch, this);
+}
+
+// oldest first: the coarse samples, the one being merged, then the last epochs
+inline void
+KpiTimeSeries::WriteSamples (std::ofstream &outFile) const
+{
+  outFile << "% imsi\tdirection\tstart\tend\tthroughputBps\tdelay\tpackets" << std::endl;
+  for (uint32_t i = 0; i < m_series.size (); ++i)
+  {
+      const Series &series = m_series[i];
+      std::vector<const Sample *> samples;
+      for (uint32_t k = 0; k < series.older.size; ++k)
+      {
+          samples.push_back (&series.older.slots[(series.older.head + m_history - series.older.size + k) % m_history]);
+      }
+      if (series.merged > 0)
+      {
+          samples.push_back (&series.merging);
+      }
+      for (uint32_t k = 0; k < series.recent.size; ++k)
+      {
+          samples.push_back (&series.recent.slots[(series.recent.head + m_history - series.recent.size + k) % m_history]);
+      }
+      for (uint32_t k = 0; k < samples.size (); ++k)
+      {
+          const Sample &sample = *samples[k];
+          outFile << series.imsi << "\t" << (series.direction == DL ? "DL" : "UL")
+                  << "\t" << sample.start << "\t" << sample.end
+                  << "\t" << sample.bytes * 8.0 / (sample.end - sample.start)
+                  << "\t" << (sample.packets > 0 ? sample.delaySum / sample.packets : 0.0)
+                  << "\t" << sample.packets << "\n";
+      }
+  }
+}
+
+inline void
+KpiTimeSeries::Dump (std::string filename) const
+{
+  std::ofstream outFile;
+  outFile.open (filename.c_str (), std::ios_base::out | std::ios_base::trunc);
+  if (!outFile.is_open ())
+  {
+      NS_LOG_UNCOND ("Can't open file " << filename);
+      return;
+  }
+  WriteSamples (outFile);
+  outFile.close ();
+}
+
+inline void
+KpiTimeSeries::PrintStats (std::string samplesFilename, std::string summaryFilename) const
+{
+  Dump (samplesFilename);
+  std::ofstream outFile;
+  outFile.open (summaryFilename.c_str (), std::ios_base::out | std::ios_base::trunc);
+  if (!outFile.is_open ())
+  {
+      NS_LOG_UNCOND ("Can't open file " << summaryFilename);
+      return;
+  }
+  outFile << "% imsi\tdirection\tepochs\tmeanThroughputBps\tstdThroughputBps\tdelayEpochs\tmeanDelay\tstdDelay" << std::endl;
+  for (uint32_t i = 0; i < m_series.size (); ++i)
+  {
+      const Series &series = m_series[i];
+      const Welford &throughput = series.throughput;
+      const Welford &delay = series.delay;
+      outFile << series.imsi << "\t" << (series.direction == DL ? "DL" : "UL")
+              << "\t" << throughput.n << "\t" << throughput.mean
+              << "\t" << (throughput.n > 1 ? std::sqrt (throughput.m2 / (throughput.n - 1)) : 0.0)
+              << "\t" << delay.n << "\t" << delay.mean
+              << "\t" << (delay.n > 1 ? std::sqrt (delay.m2 / (delay.n - 1)) : 0.0) << "\n";
+  }
+  outFile.close ();
+}
+
+} // namespace ns3
+
+#endif // KPI_TIME_SERIES_H
@@ -0,0 +1,339 @@
+#ifndef LTE_TRACE_REGISTRY_H
+#define LTE_TRACE_REGISTRY_H
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/lte-module.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace ns3 {
+
+static GlobalValue g_directTraceConnect ("directTraceConnect",
+                                         "Connect the statistics through the LTE devices directly instead of Config paths",
+                                         BooleanValue (true),
+                                         MakeBooleanChecker ());
+
+// Keeps the LTE devices of the scenario as they are installed, so trace sinks
+// are connected through pointers instead of Config paths, each of which walks
+// the node list to resolve.  Bearer callbacks are given every signalling and
+// data radio bearer once, when the RRC reports the connection, its
+// reconfiguration or a completed handover.  Each report rescans the bearers
+// of that UE context, so bearers are identified by their address only while
+// they are still listed by it and are never held by the registry; the
+// contexts an eNB no longer has are dropped.  EnablePdcpStats () is the
+// equivalent of LteHelper::EnablePdcpTraces () built on them.
+class LteTraceRegistry
+{
+public:
+  LteTraceRegistry ();
+
+  void AddEnbDevices (NetDeviceContainer enbDevs);
+  void AddUeDevices (NetDeviceContainer ueDevs);
+
+  const std::vector<Ptr<LteEnbNetDevice> > &GetEnbDevices () const;
+  const std::vector<Ptr<LteUeNetDevice> > &GetUeDevices () const;
+
+  // bearer, UE RRC (0 on the eNB side), cellId, imsi, rnti
+  typedef Callback<void, Ptr<LteRadioBearerInfo>, Ptr<LteUeRrc>, uint16_t, uint64_t, uint16_t> BearerCallback;
+  void ConnectBearers (BearerCallback callback);
+  // for sinks connected outside of the registry in place of a Config path
+  void CountConnections (uint32_t connections);
+
+  Ptr<RadioBearerStatsCalculator> EnablePdcpStats ();
+
+  // wall time spent connecting, and the time the connections that replace a
+  // Config path would take through it, extrapolated from resolving a sample
+  // of them; the RRC hookups that find the bearers have no Config equivalent
+  void PrintConnectStats (std::string filename) const;
+
+private:
+  static void DlTxPdu (Ptr<RadioBearerStatsCalculator> stats, uint16_t cellId, uint64_t imsi,
+                       uint16_t rnti, uint8_t lcid, uint32_t size);
+  static void UlRxPdu (Ptr<RadioBearerStatsCalculator> stats, uint16_t cellId, uint64_t imsi,
+                       uint16_t rnti, uint8_t lcid, uint32_t size, uint64_t delay);
+  static void UlTxPdu (Ptr<RadioBearerStatsCalculator> stats, Ptr<LteUeRrc> rrc,
+                       uint16_t rnti, uint8_t lcid, uint32_t size);
+  static void DlRxPdu (Ptr<RadioBearerStatsCalculator> stats, Ptr<LteUeRrc> rrc,
+                       uint16_t rnti, uint8_t lcid, uint32_t size, uint64_t delay);
+
+  // the bearers of a UE context seen at its last report
+  struct KnownBearers
+  {
+    KnownBearers () : imsi (0) {}
+    uint64_t imsi;
+    std::set<const LteRadioBearerInfo *> bearers;
+  };
+
+  static void NotifyEnbRrc (LteTraceRegistry *registry, uint32_t enbIndex,
+                            uint64_t imsi, uint16_t cellId, uint16_t rnti);
+  static void NotifyUeRrc (LteTraceRegistry *registry, uint32_t ueIndex,
+                           uint64_t imsi, uint16_t cellId, uint16_t rnti);
+  void NotifyBearers (KnownBearers &known, const std::vector<Ptr<LteRadioBearerInfo> > &current,
+                      Ptr<LteUeRrc> ueRrc, uint16_t cellId, uint64_t imsi, uint16_t rnti);
+  static std::vector<Ptr<LteRadioBearerInfo> > GetBearers (Ptr<Object> rrc);
+  void ConnectPdcp (Ptr<LteRadioBearerInfo> bearer, Ptr<LteUeRrc> ueRrc, uint16_t cellId, uint64_t imsi, uint16_t rnti);
+
+  typedef std::chrono::steady_clock Clock;
+
+  std::vector<Ptr<LteEnbNetDevice> > m_enbDevs;
+  std::vector<Ptr<LteUeNetDevice> > m_ueDevs;
+  std::vector<BearerCallback> m_bearerCallbacks;
+  Ptr<RadioBearerStatsCalculator> m_pdcpStats;
+  // by eNB index and rnti, and by UE index
+  std::map<std::pair<uint32_t, uint16_t>, KnownBearers> m_enbBearers;
+  std::map<uint32_t, KnownBearers> m_ueBearers;
+  // connections made in place of a Config path
+  uint64_t m_connections;
+  uint64_t m_rrcHookups;
+  double m_connectWall;
+};
+
+inline
+LteTraceRegistry::LteTraceRegistry ()
+  : m_connections (0),
+    m_rrcHookups (0),
+    m_connectWall (0)
+{
+}
+
+inline void
+LteTraceRegistry::AddEnbDevices (NetDeviceContainer enbDevs)
+{
+  for (uint32_t i = 0; i < enbDevs.GetN (); ++i)
+  {
+      m_enbDevs.push_back (enbDevs.Get (i)->GetObject<LteEnbNetDevice> ());
+  }
+}
+
+inline void
+LteTraceRegistry::AddUeDevices (NetDeviceContainer ueDevs)
+{
+  for (uint32_t i = 0; i < ueDevs.GetN (); ++i)
+  {
+      m_ueDevs.push_back (ueDevs.Get (i)->GetObject<LteUeNetDevice> ());
+  }
+}
+
+inline const std::vector<Ptr<LteEnbNetDevice> > &
+LteTraceRegistry::GetEnbDevices () const
+{
+  return m_enbDevs;
+}
+
+inline const std::vector<Ptr<LteUeNetDevice> > &
+LteTraceRegistry::GetUeDevices () const
+{
+  return m_ueDevs;
+}
+
+inline void
+LteTraceRegistry::CountConnections (uint32_t connections)
+{
+  m_connections += connections;
+}
+
+inline void
+LteTraceRegistry::ConnectBearers (BearerCallback callback)
+{
+  m_bearerCallbacks.push_back (callback);
+  if (m_bearerCallbacks.size () > 1)
+  {
+      return;
+  }
+  Clock::time_point start = Clock::now ();
+  const char *events[] = { "ConnectionEstablished", "ConnectionReconfiguration", "HandoverEndOk" };
+  for (uint32_t e = 0; e < 3; ++e)
+  {
+      for (uint32_t i = 0; i < m_enbDevs.size (); ++i)
+      {
+          m_enbDevs[i]->GetRrc ()->TraceConnectWithoutContext (events[e],
+            MakeBoundCallback (&LteTraceRegistry::NotifyEnbRrc, this, i));
+      }
+      for (uint32_t i = 0; i < m_ueDevs.size (); ++i)
+      {
+          m_ueDevs[i]->GetRrc ()->TraceConnectWithoutContext (events[e],
+            MakeBoundCallback (&LteTraceRegistry::NotifyUeRrc, this, i));
+      }
+  }
+  m_rrcHookups += 3 * (m_enbDevs.size () + m_ueDevs.size ());
+  m_connectWall += std::chrono::duration<double> (Clock::now () - start).count ();
+}
+
+inline std::vector<Ptr<LteRadioBearerInfo> >
+LteTraceRegistry::GetBearers (Ptr<Object> rrc)
+{
+  std::vector<Ptr<LteRadioBearerInfo> > bearers;
+  PointerValue srb1;
+  rrc->GetAttribute ("Srb1", srb1);
+  if (srb1.Get<LteRadioBearerInfo> ())
+  {
+      bearers.push_back (srb1.Get<LteRadioBearerInfo> ());
+  }
+  ObjectMapValue drbs;
+  rrc->GetAttribute ("DataRadioBearerMap", drbs);
+  for (ObjectMapValue::Iterator it = drbs.Begin (); it != drbs.End (); ++it)
+  {
+      bearers.push_back (DynamicCast<LteRadioBearerInfo> (it->second));
+  }
+  return bearers;
+}
+
+inline void
+LteTraceRegistry::NotifyEnbRrc (LteTraceRegistry *registry, uint32_t enbIndex,
+                                uint64_t imsi, uint16_t cellId, uint16_t rnti)
+{
+  Clock::time_point start = Clock::now ();
+  Ptr<LteEnbRrc> rrc = registry->m_enbDevs[enbIndex]->GetRrc ();
+  // forget the contexts released or handed over since the last report
+  std::map<std::pair<uint32_t, uint16_t>, KnownBearers>::iterator it
+    = registry->m_enbBearers.lower_bound (std::make_pair (enbIndex, 0));
+  while (it != registry->m_enbBearers.end () && it->first.first == enbIndex)
+  {
+      if (it->first.second != rnti && !rrc->HasUeManager (it->first.second))
+      {
+          registry->m_enbBearers.erase (it++);
+      }
+      else
+      {
+          ++it;
+      }
+  }
+  registry->NotifyBearers (registry->m_enbBearers[std::make_pair (enbIndex, rnti)],
+                           GetBearers (rrc->GetUeManager (rnti)), 0, cellId, imsi, rnti);
+  registry->m_connectWall += std::chrono::duration<double> (Clock::now () - start).count ();
+}
+
+inline void
+LteTraceRegistry::NotifyUeRrc (LteTraceRegistry *registry, uint32_t ueIndex,
+                               uint64_t imsi, uint16_t cellId, uint16_t rnti)
+{
+  Clock::time_point start = Clock::now ();
+  Ptr<LteUeRrc> rrc = registry->m_ueDevs[ueIndex]->GetRrc ();
+  registry->NotifyBearers (registry->m_ueBearers[ueIndex], GetBearers (rrc), rrc, cellId, imsi, rnti);
+  registry->m_connectWall += std::chrono::duration<double> (Clock::now () - start).count ();
+}
+
+// a bearer is new unless the context listed it at its last report; a context
+// taken over by another UE starts afresh
+inline void
+LteTraceRegistry::NotifyBearers (KnownBearers &known, const std::vector<Ptr<LteRadioBearerInfo> > &current,
+                                 Ptr<LteUeRrc> ueRrc, uint16_t cellId, uint64_t imsi, uint16_t rnti)
+{
+  if (known.imsi != imsi)
+  {
+      known.bearers.clear ();
+      known.imsi = imsi;
+  }
+  std::set<const LteRadioBearerInfo *> listed;
+  for (uint32_t b = 0; b < current.size (); ++b)
+  {
+      listed.insert (PeekPointer (current[b]));
+      if (known.bearers.count (PeekPointer (current[b])))
+      {
+          continue;
+      }
+      for (uint32_t c = 0; c < m_bearerCallbacks.size (); ++c)
+      {
+          m_bearerCallbacks[c] (current[b], ueRrc, cellId, imsi, rnti);
+      }
+  }
+  known.bearers.swap (listed);
+}
+
+inline Ptr<RadioBearerStatsCalculator>
+LteTraceRegistry::EnablePdcpStats ()
+{
+  m_pdcpStats = CreateObject<RadioBearerStatsCalculator> ("PDCP");
+  ConnectBearers (MakeCallback (&LteTraceRegistry::ConnectPdcp, this));
+  return m_pdcpStats;
+}
+
+inline void
+LteTraceRegistry::ConnectPdcp (Ptr<LteRadioBearerInfo> bearer, Ptr<LteUeRrc> ueRrc, uint16_t cellId, uint64_t imsi, uint16_t rnti)
+{
+  if (!bearer->m_pdcp)
+  {
+      return;
+  }
+  if (ueRrc)
+  {
+      bearer->m_pdcp->TraceConnectWithoutContext ("TxPDU", MakeBoundCallback (&LteTraceRegistry::UlTxPdu, m_pdcpStats, ueRrc));
+      bearer->m_pdcp->TraceConnectWithoutContext ("RxPDU", MakeBoundCallback (&LteTraceRegistry::DlRxPdu, m_pdcpStats, ueRrc));
+  }
+  else
+  {
+      bearer->m_pdcp->TraceConnectWithoutContext ("TxPDU", MakeBoundCallback (&LteTraceRegistry::DlTxPdu, m_pdcpStats, cellId, imsi));
+      bearer->m_pdcp->TraceConnectWithoutContext ("RxPDU", MakeBoundCallback (&LteTraceRegistry::UlRxPdu, m_pdcpStats, cellId, imsi));
+  }
+  m_connections += 2;
+}
+
+inline void
+LteTraceRegistry::DlTxPdu (Ptr<RadioBearerStatsCalculator> stats, uint16_t cellId, uint64_t imsi,
+                           uint16_t rnti, uint8_t lcid, uint32_t size)
+{
+  stats->DlTxPdu (cellId, imsi, rnti, lcid, size);
+}
+
+inline void
+LteTraceRegistry::UlRxPdu (Ptr<RadioBearerStatsCalculator> stats, uint16_t cellId, uint64_t imsi,
+                           uint16_t rnti, uint8_t lcid, uint32_t size, uint64_t delay)
+{
+  stats->UlRxPdu (cellId, imsi, rnti, lcid, size, delay);
+}
+
+// the UE side takes the cell from the RRC, which follows handovers
+inline void
+LteTraceRegistry::UlTxPdu (Ptr<RadioBearerStatsCalculator> stats, Ptr<LteUeRrc> rrc,
+                           uint16_t rnti, uint8_t lcid, uint32_t size)
+{
+  stats->UlTxPdu (rrc->GetCellId (), rrc->GetImsi (), rnti, lcid, size);
+}
+
+inline void
+LteTraceRegistry::DlRxPdu (Ptr<RadioBearerStatsCalculator> stats, Ptr<LteUeRrc> rrc,
+                           uint16_t rnti, uint8_t lcid, uint32_t size, uint64_t delay)
+{
+  stats->DlRxPdu (rrc->GetCellId (), rrc->GetImsi (), rnti, lcid, size, delay);
+}
+
+inline void
+LteTraceRegistry::PrintConnectStats (std::string filename) const
+{
+  // resolve the UE RRC path of a sample of UEs, as RadioBearerStatsConnector
+  // does for every bearer it connects
+  uint32_t samples = std::min<uint32_t> (m_ueDevs.size (), 100);
+  Clock::time_point start = Clock::now ();
+  for (uint32_t i = 0; i < samples; ++i)
+  {
+      Ptr<LteUeNetDevice> ueDev = m_ueDevs[i * m_ueDevs.size () / samples];
+      std::ostringstream path;
+      path << "/NodeList/" << ueDev->GetNode ()->GetId () << "/DeviceList/" << ueDev->GetIfIndex () << "/LteUeRrc";
+      Config::LookupMatches (path.str ());
+  }
+  double perPath = samples > 0 ? std::chrono::duration<double> (Clock::now () - start).count () / samples : 0;
+
+  std::ofstream outFile;
+  outFile.open (filename.c_str (), std::ios_base::out | std::ios_base::trunc);
+  if (!outFile.is_open ())
+  {
+      NS_LOG_UNCOND ("Can't open file " << filename);
+      return;
+  }
+  outFile << "% pathConnections\trrcHookups\tdirectWall\tconfigPathWall(estimated, pathConnections)\tsampledPaths" << std::endl;
+  outFile << m_connections << "\t" << m_rrcHookups << "\t" << m_connectWall << "\t" << perPath * m_connections
+          << "\t" << samples << std::endl;
+  outFile.close ();
+}
+
+} // namespace ns3
+
+#endif // LTE_TRACE_REGISTRY_H
@@ -0,0 +1,312 @@
+#ifndef PACKET_POOL_H
+#define PACKET_POOL_H
+
+#include "ns3/core-module.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <string>
+
+// Replaces the global operator new and delete of the program with pooled
+// size classes, e.g. CXXFLAGS="-DPACKET_POOL=1".  The default leaves the
+// allocator alone.
+#ifndef PACKET_POOL
+#define PACKET_POOL 0
+#endif
+
+namespace ns3 {
+
+// Per-size free lists for the small, short-lived allocations of the data
+// path: every packet sent through EPC, GTP, PDCP and RLC allocates a Packet,
+// its buffer data, metadata and tag lists, and frees them a few
+// milliseconds later.  Sizes up to MAX_SIZE are rounded up to a multiple of
+// GRANULARITY; each class has a free list per thread, refilled by carving
+// 64 kB chunks, and freed blocks go back to the thread that allocated them
+// instead of the heap: onto its list when it frees them itself, else onto a
+// lock-free stack it takes over when its list runs dry, so blocks freed by
+// the trace writer thread are reused by the simulation thread.  A 16-byte
+// header in front of each block records its class (0: larger than MAX_SIZE,
+// from malloc) and its owner.  Memory is never returned to
+// the system, so the footprint is what each class has carved.  Each thread
+// counts in its own arena, which outlives it, and PrintStats adds up the
+// arenas of all threads, the trace writer thread included, since the start
+// of the process (of the batch, in batch mode).
+class PacketPool
+{
+public:
+  enum
+  {
+    HEADER = 16,
+    GRANULARITY = 32,
+    MAX_SIZE = 4096,
+    CLASSES = MAX_SIZE / GRANULARITY + 1,
+    CHUNK = 64 * 1024
+  };
+
+  static void *Allocate (std::size_t size);
+  static void Free (void *p);
+  static void PrintStats (std::string filename);
+
+private:
+  struct Block
+  {
+    Block *next;
+  };
+  // written by its thread only, so counting is a plain load and store; the
+  // atomics let PrintStats read them from another thread
+  struct Counters
+  {
+    std::atomic<uint64_t> allocations[CLASSES];
+    std::atomic<uint64_t> reused[CLASSES];
+    std::atomic<uint64_t> frees[CLASSES];
+    std::atomic<uint64_t> carved[CLASSES];
+  };
+  struct Arena
+  {
+    Block *freeLists[CLASSES];
+    // freed by other threads
+    std::atomic<Block *> remoteFrees[CLASSES];
+    Counters counters;
+    Arena *next;
+  };
+
+  static Arena *GetArena ();
+  static std::atomic<Arena *> &GetArenas ();
+  static void Count (std::atomic<uint64_t> &counter, uint64_t n = 1);
+};
+
+inline std::atomic<PacketPool::Arena *> &
+PacketPool::GetArenas ()
+{
+  static std::atomic<Arena *> arenas (0);
+  return arenas;
+}
+
+// taken from malloc and never freed, so that the counters of a thread that
+// has exited are still printed
+inline PacketPool::Arena *
+PacketPool::GetArena ()
+{
+  static thread_local Arena *arena = 0;
+  if (!arena)
+  {
+      void *p = std::malloc (sizeof (Arena));
+      if (!p)
+      {
+          throw std::bad_alloc ();
+      }
+      arena = new (p) Arena ();
+      arena->next = GetArenas ().load ();
+      while (!GetArenas ().compare_exchange_weak (arena->next, arena))
+      {
+      }
+  }
+  return arena;
+}
+
+inline void
+PacketPool::Count (std::atomic<uint64_t> &counter, uint64_t n)
+{
+  counter.store (counter.load (std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+inline void *
+PacketPool::Allocate (std::size_t size)
+{
+  Arena *arena = GetArena ();
+  uint32_t sizeClass = size <= MAX_SIZE ? (size + GRANULARITY - 1) / GRANULARITY : 0;
+  if (sizeClass == 0 && size > 0)
+  {
+      char *p = static_cast<char *> (std::malloc (size + HEADER));
+      if (!p)
+      {
+          throw std::bad_alloc ();
+      }
+      *reinterpret_cast<uint32_t *> (p) = 0;
+      Count (arena->counters.allocations[0]);
+      return p + HEADER;
+  }
+  sizeClass = sizeClass == 0 ? 1 : sizeClass;
+  Count (arena->counters.allocations[sizeClass]);
+  Block *&freeList = arena->freeLists[sizeClass];
+  if (!freeList && arena->remoteFrees[sizeClass].load (std::memory_order_relaxed))
+  {
+      freeList = arena->remoteFrees[sizeClass].exchange (0, std::memory_order_acquire);
+  }
+  if (freeList)
+  {
+      Count (arena->counters.reused[sizeClass]);
+  }
+  else
+  {
+      std::size_t blockSize = HEADER + sizeClass * GRANULARITY;
+      char *chunk = static_cast<char *> (std::malloc (CHUNK));
+      if (!chunk)
+      {
+          throw std::bad_alloc ();
+      }
+      for (std::size_t offset = 0; offset + blockSize <= CHUNK; offset += blockSize)
+      {
+          *reinterpret_cast<uint32_t *> (chunk + offset) = sizeClass;
+          *reinterpret_cast<Arena **> (chunk + offset + sizeof (Arena *)) = arena;
+          Block *block = reinterpret_cast<Block *> (chunk + offset + HEADER);
+          block->next = freeList;
+          freeList = block;
+      }
+      Count (arena->counters.carved[sizeClass], CHUNK / blockSize);
+  }
+  Block *block = freeList;
+  freeList = block->next;
+  return block;
+}
+
+inline void
+PacketPool::Free (void *p)
+{
+  if (!p)
+  {
+      return;
+  }
+  char *header = static_cast<char *> (p) - HEADER;
+  uint32_t sizeClass = *reinterpret_cast<uint32_t *> (header);
+  Arena *arena = GetArena ();
+  Count (arena->counters.frees[sizeClass]);
+  if (sizeClass == 0)
+  {
+      std::free (header);
+      return;
+  }
+  Block *block = static_cast<Block *> (p);
+  Arena *owner = *reinterpret_cast<Arena **> (header + sizeof (Arena *));
+  if (owner == arena)
+  {
+      block->next = arena->freeLists[sizeClass];
+      arena->freeLists[sizeClass] = block;
+      return;
+  }
+  block->next = owner->remoteFrees[sizeClass].load (std::memory_order_relaxed);
+  while (!owner->remoteFrees[sizeClass].compare_exchange_weak (block->next, block, std::memory_order_release,
+                                                               std::memory_order_relaxed))
+  {
+  }
+}
+
+inline void
+PacketPool::PrintStats (std::string filename)
+{
+  std::ofstream outFile;
+  outFile.open (filename.c_str (), std::ios_base::out | std::ios_base::trunc);
+  if (!outFile.is_open ())
+  {
+      NS_LOG_UNCOND ("Can't open file " << filename);
+      return;
+  }
+  uint64_t allocations[CLASSES] = {};
+  uint64_t reused[CLASSES] = {};
+  uint64_t frees[CLASSES] = {};
+  uint64_t carved[CLASSES] = {};
+  for (Arena *arena = GetArenas ().load (); arena; arena = arena->next)
+  {
+      for (uint32_t c = 0; c < CLASSES; ++c)
+      {
+          allocations[c] += arena->counters.allocations[c].load (std::memory_order_relaxed);
+          reused[c] += arena->counters.reused[c].load (std::memory_order_relaxed);
+          frees[c] += arena->counters.frees[c].load (std::memory_order_relaxed);
+          carved[c] += arena->counters.carved[c].load (std::memory_order_relaxed);
+      }
+  }
+  outFile << "% maxSize\tallocations\treused\tfrees\tlive\tcarved\t(all threads; maxSize 0: larger than " << MAX_SIZE
+          << ", from malloc)" << std::endl;
+  for (uint32_t c = 0; c < CLASSES; ++c)
+  {
+      if (allocations[c] == 0)
+      {
+          continue;
+      }
+      outFile << c * GRANULARITY << "\t" << allocations[c] << "\t" << reused[c] << "\t" << frees[c]
+              << "\t" << (int64_t) (allocations[c] - frees[c]) << "\t" << carved[c] << "\n";
+  }
+  outFile.close ();
+}
+
+} // namespace ns3
+
+#if PACKET_POOL
+void *
+operator new (std::size_t size)
+{
+  return ns3::PacketPool::Allocate (size);
+}
+
+void *
+operator new[] (std::size_t size)
+{
+  return ns3::PacketPool::Allocate (size);
+}
+
+void *
+operator new (std::size_t size, const std::nothrow_t &) noexcept
+{
+  try
+  {
+      return ns3::PacketPool::Allocate (size);
+  }
+  catch (const std::bad_alloc &)
+  {
+      return 0;
+  }
+}
+
+void *
+operator new[] (std::size_t size, const std::nothrow_t &) noexcept
+{
+  try
+  {
+      return ns3::PacketPool::Allocate (size);
+  }
+  catch (const std::bad_alloc &)
+  {
+      return 0;
+  }
+}
+
+void
+operator delete (void *p) noexcept
+{
+  ns3::PacketPool::Free (p);
+}
+
+void
+operator delete[] (void *p) noexcept
+{
+  ns3::PacketPool::Free (p);
+}
+
+void
+operator delete (void *p, const std::nothrow_t &) noexcept
+{
+  ns3::PacketPool::Free (p);
+}
+
+void
+operator delete[] (void *p, const std::nothrow_t &) noexcept
+{
+  ns3::PacketPool::Free (p);
+}
+
+void
+operator delete (void *p, std::size_t) noexcept
+{
+  ns3::PacketPool::Free (p);
+}
+
+void
+operator delete[] (void *p, std::size_t) noexcept
+{
+  ns3::PacketPool::Free (p);
+}
+#endif
+
+#endif // PACKET_POOL_H
@@ -0,0 +1,244 @@
+#ifndef PROGRESS_REPORTER_H
+#define PROGRESS_REPORTER_H
+
+#include "ns3/core-module.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace ns3 {
+
+static GlobalValue g_progressInterval ("progressInterval",
+                                       "Wall-clock seconds between two progress reports (0 disables the reporter)",
+                                       DoubleValue (0.0),
+                                       MakeDoubleChecker<double> (0.0));
+static GlobalValue g_progressFile ("progressFile",
+                                   "File receiving the progress reports as JSON lines (empty: human readable on stderr)",
+                                   StringValue (""),
+                                   MakeStringChecker ());
+
+// Current (VmRSS) or peak (VmHWM) resident set size of this process in kB
+inline uint64_t
+GetProcessRssKb (bool peak = false)
+{
+  std::ifstream status ("/proc/self/status");
+  std::string key = peak ? "VmHWM:" : "VmRSS:";
+  std::string line;
+  while (std::getline (status, line))
+  {
+      if (line.compare (0, key.size (), key) == 0)
+      {
+          return std::strtoull (line.c_str () + key.size (), 0, 10);
+      }
+  }
+  return 0;
+}
+
+// Periodically reports how far Simulator::Run () got.  A cheap event sampling the
+// simulator state is scheduled every 10 ms of simulated time; the reports are
+// written by a separate thread on a wall-clock period, so a run whose simulated
+// time stops advancing is still reported (as stalled) instead of going quiet.
+class ProgressReporter
+{
+public:
+  ProgressReporter ();
+  ~ProgressReporter ();
+
+  void Start (double wallInterval, Time stopTime, std::string filename);
+  void Finish ();
+
+private:
+  typedef std::chrono::steady_clock Clock;
+
+  void Sample ();
+  void Run ();
+  void Report (bool final);
+  double WallSince (Clock::time_point t) const;
+
+  Clock::time_point m_created;
+  Clock::time_point m_started;
+  double m_wallInterval;
+  double m_stopTime;
+  std::string m_filename;
+  std::ofstream m_outFile;
+  bool m_running;
+  EventId m_sampleEvent;
+
+  std::atomic<double> m_simTime;
+  std::atomic<uint64_t> m_events;
+  double m_lastSimTime;
+  uint64_t m_lastEvents;
+  double m_lastWall;
+
+  std::thread m_thread;
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+  bool m_stop;
+};
+
+inline
+ProgressReporter::ProgressReporter ()
+  : m_created (Clock::now ()),
+    m_wallInterval (0),
+    m_stopTime (0),
+    m_running (false),
+    m_simTime (0),
+    m_events (0),
+    m_lastSimTime (0),
+    m_lastEvents (0),
+    m_lastWall (0),
+    m_stop (false)
+{
+}
+
+inline
+ProgressReporter::~ProgressReporter ()
+{
+  Finish ();
+}
+
+inline void
+ProgressReporter::Start (double wallInterval, Time stopTime, std::string filename)
+{
+  if (wallInterval <= 0 || m_running)
+  {
+      return;
+  }
+  m_wallInterval = wallInterval;
+  m_stopTime = stopTime.GetSeconds ();
+  m_filename = filename;
+  if (!m_filename.empty ())
+  {
+      m_outFile.open (m_filename.c_str (), std::ios_base::out | std::ios_base::trunc);
+      if (!m_outFile.is_open ())
+      {
+          std::cerr << "Can't open progress file " << m_filename << ", reporting on stderr\n";
+          m_filename.clear ();
+      }
+  }
+  m_started = Clock::now ();
+  m_running = true;
+  m_stop = false;
+  Sample ();
+  m_thread = std::thread (&ProgressReporter::Run, this);
+}
+
+inline void
+ProgressReporter::Finish ()
+{
+  if (!m_running)
+  {
+      return;
+  }
+  {
+    std::lock_guard<std::mutex> lock (m_mutex);
+    m_stop = true;
+  }
+  m_cv.notify_one ();
+  m_thread.join ();
+  m_sampleEvent.Cancel ();
+  m_simTime = Simulator::Now ().GetSeconds ();
+  m_events = Simulator::GetEventCount ();
+  Report (true);
+  m_outFile.close ();
+  m_running = false;
+}
+
+inline void
+ProgressReporter::Sample ()
+{
+  m_simTime = Simulator::Now ().GetSeconds ();
+  m_events = Simulator::GetEventCount ();
+  m_sampleEvent = Simulator::Schedule (MilliSeconds (10), &ProgressReporter::Sample, this);
+}
+
+inline void
+ProgressReporter::Run ()
+{
+  std::unique_lock<std::mutex> lock (m_mutex);
+  while (!m_stop)
+  {
+      m_cv.wait_for (lock, std::chrono::duration<double> (m_wallInterval));
+      if (!m_stop)
+      {
+          Report (false);
+      }
+  }
+}
+
+inline double
+ProgressReporter::WallSince (Clock::time_point t) const
+{
+  return std::chrono::duration<double> (Clock::now () - t).count ();
+}
+
+inline void
+ProgressReporter::Report (bool final)
+{
+  double wall = WallSince (m_started);
+  double simTime = m_simTime;
+  uint64_t events = m_events;
+
+  double dWall = wall - m_lastWall;
+  double simRate = dWall > 0 ? (simTime - m_lastSimTime) / dWall : 0;
+  double eventRate = dWall > 0 ? (events - m_lastEvents) / dWall : 0;
+  if (final)
+  {
+      simRate = wall > 0 ? simTime / wall : 0;
+      eventRate = wall > 0 ? events / wall : 0;
+  }
+  bool stalled = !final && simTime == m_lastSimTime;
+  double eta = simRate > 0 ? (m_stopTime - simTime) / simRate : -1;
+  m_lastWall = wall;
+  m_lastSimTime = simTime;
+  m_lastEvents = events;
+
+  if (m_filename.empty ())
+  {
+      char line[256];
+      std::snprintf (line, sizeof (line),
+                     "[%s] sim %.3f s / %.3f s, wall %.1f s, %llu events (%.0f/s), %.3f sim-s/s, RSS %llu kB, ETA %.0f s%s",
+                     final ? "done" : "progress", simTime, m_stopTime, wall,
+                     (unsigned long long) events, eventRate, simRate,
+                     (unsigned long long) GetProcessRssKb (), final ? 0.0 : eta,
+                     stalled ? " STALLED" : "");
+      std::cerr << line;
+      if (final)
+      {
+          std::snprintf (line, sizeof (line), ", setup %.1f s, peak RSS %llu kB",
+                         std::chrono::duration<double> (m_started - m_created).count (),
+                         (unsigned long long) GetProcessRssKb (true));
+          std::cerr << line;
+      }
+      std::cerr << "\n";
+      return;
+  }
+  m_outFile << "{\"type\":\"" << (final ? "done" : "progress") << "\""
+            << ",\"sim_s\":" << simTime
+            << ",\"stop_s\":" << m_stopTime
+            << ",\"wall_s\":" << wall
+            << ",\"events\":" << events
+            << ",\"events_per_s\":" << eventRate
+            << ",\"sim_rate\":" << simRate
+            << ",\"rss_kb\":" << GetProcessRssKb ()
+            << ",\"eta_s\":" << (final ? 0.0 : eta)
+            << ",\"stalled\":" << (stalled ? "true" : "false");
+  if (final)
+  {
+      m_outFile << ",\"setup_wall_s\":" << std::chrono::duration<double> (m_started - m_created).count ()
+                << ",\"peak_rss_kb\":" << GetProcessRssKb (true);
+  }
+  m_outFile << "}\n";
+  m_outFile.flush ();
+}
+
+} // namespace ns3
+
+#endif // PROGRESS_REPORTER_H
@@ -0,0 +1,300 @@
+#ifndef RESULT_CACHE_H
+#define RESULT_CACHE_H
+
+#include "ns3/core-module.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace ns3 {
+
+static GlobalValue g_resultCache ("resultCache",
+                                  "Directory of the result cache keyed by the scenario configuration (empty: disabled)",
+                                  StringValue (""),
+                                  MakeStringChecker ());
+
+// Skips reruns of a configuration that was already simulated.  The key is the
+// canonical text of everything a run depends on: argv, every GlobalValue (RNG
+// seed and run included) except the ones that only change reporting, the
+// default value of every attribute of every registered TypeId,
+// NS_ATTRIBUTE_DEFAULT, and the binary (contents of the program, size and
+// modification time of the ns-3 libraries it loaded).  Its 64-bit FNV-1a
+// hash names the entry directory, which holds the key and a copy of every
+// file the run created or changed in the working directory.  On a hit these
+// files are copied back and the program can return at once.
+class ResultCache
+{
+public:
+  ResultCache (int argc, char *argv[]);
+
+  bool IsEnabled () const;
+  std::string GetHash () const;
+  // copies the stored results of this configuration to the working directory
+  bool Restore ();
+  // stores the files written by this run; call after Simulator::Destroy (),
+  // once the objects writing on disposal (PDCP statistics) are disposed
+  void Store ();
+
+private:
+  struct FileState
+  {
+    off_t size;
+    time_t mtime;
+    long mtimeNs;
+  };
+
+  static void AddFileHash (std::ostringstream &key, std::string path, bool contents);
+  static std::map<std::string, FileState> ListFiles (std::string dir);
+  static bool CopyFile (std::string from, std::string to);
+  static uint64_t Fnv1a (const std::string &text);
+  std::string GetEntry () const;
+
+  std::string m_dir;
+  std::string m_key;
+  std::string m_hash;
+  std::map<std::string, FileState> m_before;
+};
+
+inline
+ResultCache::ResultCache (int argc, char *argv[])
+{
+  StringValue dir;
+  GlobalValue::GetValueByName ("resultCache", dir);
+  m_dir = dir.Get ();
+  if (m_dir.empty ())
+  {
+      return;
+  }
+
+  std::ostringstream key;
+  key << "argv";
+  for (int i = 0; i < argc; ++i)
+  {
+      key << " " << argv[i];
+  }
+  key << "\n";
+  // sorted, so that the key does not depend on the registration order
+  std::vector<std::string> settings;
+  for (GlobalValue::Iterator it = GlobalValue::Begin (); it != GlobalValue::End (); ++it)
+  {
+      std::string name = (*it)->GetName ();
+      if (name == "resultCache" || name == "batchFile" || name == "progressInterval" || name == "progressFile")
+      {
+          continue;
+      }
+      Ptr<AttributeValue> value = (*it)->GetChecker ()->Create ();
+      (*it)->GetValue (*value);
+      settings.push_back ("global " + name + "=" + value->SerializeToString ((*it)->GetChecker ()));
+  }
+  for (uint32_t t = 0; t < TypeId::GetRegisteredN (); ++t)
+  {
+      TypeId tid = TypeId::GetRegistered (t);
+      for (uint32_t a = 0; a < tid.GetAttributeN (); ++a)
+      {
+          TypeId::AttributeInformation info = tid.GetAttribute (a);
+          settings.push_back ("default " + tid.GetName () + "::" + info.name + "="
+                              + info.initialValue->SerializeToString (info.checker));
+      }
+  }
+  std::sort (settings.begin (), settings.end ());
+  for (uint32_t i = 0; i < settings.size (); ++i)
+  {
+      key << settings[i] << "\n";
+  }
+  const char *envDefaults = std::getenv ("NS_ATTRIBUTE_DEFAULT");
+  key << "env NS_ATTRIBUTE_DEFAULT=" << (envDefaults ? envDefaults : "") << "\n";
+  AddFileHash (key, "/proc/self/exe", true);
+  std::ifstream maps ("/proc/self/maps");
+  std::string line;
+  std::map<std::string, bool> libraries;
+  while (std::getline (maps, line))
+  {
+      std::string::size_type path = line.find ('/');
+      if (path != std::string::npos && line.find ("libns3", path) != std::string::npos)
+      {
+          libraries[line.substr (path)] = true;
+      }
+  }
+  for (std::map<std::string, bool>::const_iterator it = libraries.begin (); it != libraries.end (); ++it)
+  {
+      AddFileHash (key, it->first, false);
+  }
+  m_key = key.str ();
+
+  char hash[17];
+  std::snprintf (hash, sizeof (hash), "%016llx", (unsigned long long) Fnv1a (m_key));
+  m_hash = hash;
+  m_before = ListFiles (".");
+}
+
+inline bool
+ResultCache::IsEnabled () const
+{
+  return !m_dir.empty ();
+}
+
+inline std::string
+ResultCache::GetHash () const
+{
+  return m_hash;
+}
+
+inline std::string
+ResultCache::GetEntry () const
+{
+  return m_dir + "/" + m_hash;
+}
+
+inline uint64_t
+ResultCache::Fnv1a (const std::string &text)
+{
+  uint64_t hash = 14695981039346656037ULL;
+  for (std::string::size_type i = 0; i < text.size (); ++i)
+  {
+      hash ^= (unsigned char) text[i];
+      hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+inline void
+ResultCache::AddFileHash (std::ostringstream &key, std::string path, bool contents)
+{
+  struct stat st;
+  if (stat (path.c_str (), &st) != 0)
+  {
+      return;
+  }
+  key << "binary " << path << " " << st.st_size << " " << st.st_mtime;
+  if (contents)
+  {
+      std::ifstream file (path.c_str (), std::ios_base::binary);
+      std::ostringstream data;
+      data << file.rdbuf ();
+      key << " " << Fnv1a (data.str ());
+  }
+  key << "\n";
+}
+
+inline std::map<std::string, ResultCache::FileState>
+ResultCache::ListFiles (std::string dir)
+{
+  std::map<std::string, FileState> files;
+  DIR *d = opendir (dir.c_str ());
+  if (!d)
+  {
+      return files;
+  }
+  struct dirent *entry;
+  while ((entry = readdir (d)) != 0)
+  {
+      struct stat st;
+      std::string path = dir + "/" + entry->d_name;
+      if (stat (path.c_str (), &st) == 0 && S_ISREG (st.st_mode))
+      {
+          FileState state;
+          state.size = st.st_size;
+          state.mtime = st.st_mtim.tv_sec;
+          state.mtimeNs = st.st_mtim.tv_nsec;
+          files[entry->d_name] = state;
+      }
+  }
+  closedir (d);
+  return files;
+}
+
+inline bool
+ResultCache::CopyFile (std::string from, std::string to)
+{
+  std::ifstream in (from.c_str (), std::ios_base::binary);
+  std::ofstream out (to.c_str (), std::ios_base::binary | std::ios_base::trunc);
+  if (!in.is_open () || !out.is_open ())
+  {
+      return false;
+  }
+  out << in.rdbuf ();
+  return out.good ();
+}
+
+inline bool
+ResultCache::Restore ()
+{
+  if (m_dir.empty ())
+  {
+      return false;
+  }
+  std::ifstream storedKey ((GetEntry () + "/.key").c_str ());
+  std::ostringstream stored;
+  stored << storedKey.rdbuf ();
+  if (!storedKey.is_open () || stored.str () != m_key)
+  {
+      return false;
+  }
+  std::map<std::string, FileState> files = ListFiles (GetEntry ());
+  for (std::map<std::string, FileState>::const_iterator it = files.begin (); it != files.end (); ++it)
+  {
+      if (it->first != ".key" && !CopyFile (GetEntry () + "/" + it->first, it->first))
+      {
+          NS_LOG_UNCOND ("Result cache: can't restore " << it->first << ", running the simulation");
+          return false;
+      }
+  }
+  NS_LOG_UNCOND ("Result cache hit " << m_hash << ": restored " << files.size () - 1 << " files");
+  return true;
+}
+
+inline void
+ResultCache::Store ()
+{
+  if (m_dir.empty ())
+  {
+      return;
+  }
+  // written next to the entry and renamed, so a concurrent run never sees half of it
+  std::ostringstream tmp;
+  tmp << GetEntry () << ".tmp" << getpid ();
+  mkdir (m_dir.c_str (), 0755);
+  if (mkdir (tmp.str ().c_str (), 0755) != 0)
+  {
+      NS_LOG_UNCOND ("Result cache: can't create " << tmp.str ());
+      return;
+  }
+  std::map<std::string, FileState> after = ListFiles (".");
+  for (std::map<std::string, FileState>::const_iterator it = after.begin (); it != after.end (); ++it)
+  {
+      std::map<std::string, FileState>::const_iterator before = m_before.find (it->first);
+      if (before != m_before.end () && before->second.size == it->second.size
+          && before->second.mtime == it->second.mtime && before->second.mtimeNs == it->second.mtimeNs)
+      {
+          continue;
+      }
+      CopyFile (it->first, tmp.str () + "/" + it->first);
+  }
+  std::ofstream key ((tmp.str () + "/.key").c_str ());
+  key << m_key;
+  key.close ();
+  if (rename (tmp.str ().c_str (), GetEntry ().c_str ()) != 0)
+  {
+      // an identical run stored it first
+      std::map<std::string, FileState> stored = ListFiles (tmp.str ());
+      for (std::map<std::string, FileState>::const_iterator it = stored.begin (); it != stored.end (); ++it)
+      {
+          unlink ((tmp.str () + "/" + it->first).c_str ());
+      }
+      rmdir (tmp.str ().c_str ());
+  }
+}
+
+} // namespace ns3
+
+#endif // RESULT_CACHE_H
@@ -0,0 +1,427 @@
+#ifndef ROOM_TABLE_PROPAGATION_LOSS_MODEL_H
+#define ROOM_TABLE_PROPAGATION_LOSS_MODEL_H
+
+#include "ns3/core-module.h"
+#include "ns3/mobility-module.h"
+#include "ns3/network-module.h"
+#include "ns3/propagation-module.h"
+#include "ns3/buildings-module.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <map>
+#include <vector>
+
+namespace ns3 {
+
+// The HybridBuildingsPropagationLossModel with the wall losses taken from
+// tables instead of being derived on every call.  The first evaluation, once
+// the buildings and nodes are placed, builds
+//
+//  - per room of every building: the external wall loss of the building and
+//    the height gain of the floor, which are the penetration losses between
+//    the room and any outdoor or other-building end;
+//  - per room holding a node (the possible transmitters): the internal wall
+//    loss towards every room of the same building.
+//
+// The indoor/outdoor classification, building and room of each end are
+// cached and only looked up again once the end has moved, so a call costs
+// the distance-dependent ITU-R/Okumura-Hata term plus a few table reads.  The
+// branches, attributes and wall values are those of the hybrid model, and the
+// losses are identical to it; rooms of nodes placed after the first
+// evaluation get their table row on first use.
+class RoomTablePropagationLossModel : public BuildingsPropagationLossModel
+{
+public:
+  static TypeId GetTypeId ();
+  RoomTablePropagationLossModel ();
+
+  virtual double GetLoss (Ptr<MobilityModel> a, Ptr<MobilityModel> b) const;
+
+protected:
+  virtual void DoDispose ();
+
+private:
+  struct Room
+  {
+    Building *building;
+    uint32_t firstRoom;
+    uint32_t roomX;
+    uint32_t roomY;
+    double externalWallLoss;
+    double heightLoss;
+  };
+  struct Endpoint
+  {
+    Vector position;
+    int32_t room;  // -1: outdoor
+    const std::vector<double> *internalWallLoss;
+  };
+
+  void SetFrequency (double frequency);
+  double GetFrequency () const;
+  void SetEnvironment (EnvironmentType environment);
+  EnvironmentType GetEnvironment () const;
+  void SetCitySize (CitySize citySize);
+  CitySize GetCitySize () const;
+  void SetRooftopHeight (double rooftopHeight);
+  double GetRooftopHeight () const;
+
+  double OkumuraHata (Ptr<MobilityModel> a, Ptr<MobilityModel> b) const;
+  double ItuR1411 (Ptr<MobilityModel> a, Ptr<MobilityModel> b) const;
+  void BuildTables () const;
+  const std::vector<double> &GetInternalWallLoss (uint32_t room) const;
+  const Endpoint &GetEndpoint (Ptr<MobilityModel> node) const;
+
+  Ptr<OkumuraHataPropagationLossModel> m_okumuraHata;
+  Ptr<ItuR1411LosPropagationLossModel> m_ituR1411Los;
+  Ptr<ItuR1411NlosOverRooftopPropagationLossModel> m_ituR1411NlosOverRooftop;
+  Ptr<ItuR1238PropagationLossModel> m_ituR1238;
+  Ptr<Kun2600MhzPropagationLossModel> m_kun2600Mhz;
+
+  double m_itu1411NlosThreshold;
+  double m_rooftopHeight;
+  double m_frequency;
+  EnvironmentType m_environment;
+  CitySize m_citySize;
+
+  mutable bool m_tablesBuilt;
+  mutable std::vector<Room> m_rooms;
+  mutable std::map<Building *, uint32_t> m_firstRooms;
+  // internal wall loss from a room to the rooms of its building, in room order
+  mutable std::map<uint32_t, std::vector<double> > m_internalWallLoss;
+  mutable std::map<MobilityModel *, Endpoint> m_endpoints;
+};
+
+NS_OBJECT_ENSURE_REGISTERED (RoomTablePropagationLossModel);
+
+inline TypeId
+RoomTablePropagationLossModel::GetTypeId ()
+{
+  static TypeId tid = TypeId ("ns3::RoomTablePropagationLossModel")
+    .SetParent<BuildingsPropagationLossModel> ()
+    .AddConstructor<RoomTablePropagationLossModel> ()
+    .AddAttribute ("Frequency",
+                   "Carrier frequency [Hz]",
+                   DoubleValue (2160e6),
+                   MakeDoubleAccessor (&RoomTablePropagationLossModel::SetFrequency,
+                                       &RoomTablePropagationLossModel::GetFrequency),
+                   MakeDoubleChecker<double> ())
+    .AddAttribute ("Los2NlosThr",
+                   "Threshold from LoS to NLoS in ITU 1411 [m]",
+                   DoubleValue (200.0),
+                   MakeDoubleAccessor (&RoomTablePropagationLossModel::m_itu1411NlosThreshold),
+                   MakeDoubleChecker<double> ())
+    .AddAttribute ("Environment",
+                   "Environment scenario",
+                   EnumValue (UrbanEnvironment),
+                   MakeEnumAccessor (&RoomTablePropagationLossModel::SetEnvironment,
+                                     &RoomTablePropagationLossModel::GetEnvironment),
+                   MakeEnumChecker (UrbanEnvironment, "Urban",
+                                    SubUrbanEnvironment, "SubUrban",
+                                    OpenAreasEnvironment, "OpenAreas"))
+    .AddAttribute ("CitySize",
+                   "Dimension of the city",
+                   EnumValue (LargeCity),
+                   MakeEnumAccessor (&RoomTablePropagationLossModel::SetCitySize,
+                                     &RoomTablePropagationLossModel::GetCitySize),
+                   MakeEnumChecker (SmallCity, "Small",
+                                    MediumCity, "Medium",
+                                    LargeCity, "Large"))
+    .AddAttribute ("RooftopLevel",
+                   "Height of the rooftop level [m]",
+                   DoubleValue (20.0),
+                   MakeDoubleAccessor (&RoomTablePropagationLossModel::SetRooftopHeight,
+                                       &RoomTablePropagationLossModel::GetRooftopHeight),
+                   MakeDoubleChecker<double> (0.0, 90.0))
+  ;
+  return tid;
+}
+
+inline
+RoomTablePropagationLossModel::RoomTablePropagationLossModel ()
+  : m_itu1411NlosThreshold (200.0),
+    m_rooftopHeight (20.0),
+    m_frequency (2160e6),
+    m_environment (UrbanEnvironment),
+    m_citySize (LargeCity),
+    m_tablesBuilt (false)
+{
+  m_okumuraHata = CreateObject<OkumuraHataPropagationLossModel> ();
+  m_ituR1411Los = CreateObject<ItuR1411LosPropagationLossModel> ();
+  m_ituR1411NlosOverRooftop = CreateObject<ItuR1411NlosOverRooftopPropagationLossModel> ();
+  m_ituR1238 = CreateObject<ItuR1238PropagationLossModel> ();
+  m_kun2600Mhz = CreateObject<Kun2600MhzPropagationLossModel> ();
+}
+
+inline void
+RoomTablePropagationLossModel::DoDispose ()
+{
+  m_okumuraHata = 0;
+  m_ituR1411Los = 0;
+  m_ituR1411NlosOverRooftop = 0;
+  m_ituR1238 = 0;
+  m_kun2600Mhz = 0;
+  m_rooms.clear ();
+  m_firstRooms.clear ();
+  m_internalWallLoss.clear ();
+  m_endpoints.clear ();
+  BuildingsPropagationLossModel::DoDispose ();
+}
+
+inline void
+RoomTablePropagationLossModel::SetFrequency (double frequency)
+{
+  m_frequency = frequency;
+  m_okumuraHata->SetAttribute ("Frequency", DoubleValue (frequency));
+  m_ituR1411Los->SetAttribute ("Frequency", DoubleValue (frequency));
+  m_ituR1411NlosOverRooftop->SetAttribute ("Frequency", DoubleValue (frequency));
+  m_ituR1238->SetAttribute ("Frequency", DoubleValue (frequency));
+}
+
+inline double
+RoomTablePropagationLossModel::GetFrequency () const
+{
+  return m_frequency;
+}
+
+inline void
+RoomTablePropagationLossModel::SetEnvironment (EnvironmentType environment)
+{
+  m_environment = environment;
+  m_okumuraHata->SetAttribute ("Environment", EnumValue (environment));
+  m_ituR1411NlosOverRooftop->SetAttribute ("Environment", EnumValue (environment));
+}
+
+inline EnvironmentType
+RoomTablePropagationLossModel::GetEnvironment () const
+{
+  return m_environment;
+}
+
+inline void
+RoomTablePropagationLossModel::SetCitySize (CitySize citySize)
+{
+  m_citySize = citySize;
+  m_okumuraHata->SetAttribute ("CitySize", EnumValue (citySize));
+  m_ituR1411NlosOverRooftop->SetAttribute ("CitySize", EnumValue (citySize));
+}
+
+inline CitySize
+RoomTablePropagationLossModel::GetCitySize () const
+{
+  return m_citySize;
+}
+
+inline void
+RoomTablePropagationLossModel::SetRooftopHeight (double rooftopHeight)
+{
+  m_rooftopHeight = rooftopHeight;
+  m_ituR1411NlosOverRooftop->SetAttribute ("RooftopLevel", DoubleValue (rooftopHeight));
+}
+
+inline double
+RoomTablePropagationLossModel::GetRooftopHeight () const
+{
+  return m_rooftopHeight;
+}
+
+inline double
+RoomTablePropagationLossModel::OkumuraHata (Ptr<MobilityModel> a, Ptr<MobilityModel> b) const
+{
+  if (m_frequency <= 2.3e9)
+  {
+      return m_okumuraHata->GetLoss (a, b);
+  }
+  return m_kun2600Mhz->GetLoss (a, b);
+}
+
+inline double
+RoomTablePropagationLossModel::ItuR1411 (Ptr<MobilityModel> a, Ptr<MobilityModel> b) const
+{
+  if (a->GetDistanceFrom (b) < m_itu1411NlosThreshold)
+  {
+      return m_ituR1411Los->GetLoss (a, b);
+  }
+  return m_ituR1411NlosOverRooftop->GetLoss (a, b);
+}
+
+// Room tables of all buildings, and internal wall rows for the rooms of all
+// nodes; wall values as in BuildingsPropagationLossModel
+inline void
+RoomTablePropagationLossModel::BuildTables () const
+{
+  m_tablesBuilt = true;
+  for (BuildingList::Iterator it = BuildingList::Begin (); it != BuildingList::End (); ++it)
+  {
+      Ptr<Building> building = *it;
+      double externalWallLoss = 0;
+      switch (building->GetExtWallsType ())
+      {
+        case Building::Wood:
+          externalWallLoss = 4;
+          break;
+        case Building::ConcreteWithWindows:
+          externalWallLoss = 7;
+          break;
+        case Building::ConcreteWithoutWindows:
+          externalWallLoss = 15;
+          break;
+        case Building::StoneBlocks:
+          externalWallLoss = 12;
+          break;
+      }
+      uint32_t firstRoom = m_rooms.size ();
+      m_firstRooms[PeekPointer (building)] = firstRoom;
+      for (uint32_t floor = 1; floor <= building->GetNFloors (); ++floor)
+      {
+          for (uint32_t roomY = 1; roomY <= building->GetNRoomsY (); ++roomY)
+          {
+              for (uint32_t roomX = 1; roomX <= building->GetNRoomsX (); ++roomX)
+              {
+                  Room room;
+                  room.building = PeekPointer (building);
+                  room.firstRoom = firstRoom;
+                  room.roomX = roomX;
+                  room.roomY = roomY;
+                  room.externalWallLoss = externalWallLoss;
+                  room.heightLoss = -2.0 * (int32_t) (floor - 1);
+                  m_rooms.push_back (room);
+              }
+          }
+      }
+  }
+  for (NodeList::Iterator it = NodeList::Begin (); it != NodeList::End (); ++it)
+  {
+      Ptr<MobilityModel> mobility = (*it)->GetObject<MobilityModel> ();
+      if (mobility && mobility->GetObject<MobilityBuildingInfo> ())
+      {
+          const Endpoint &endpoint = GetEndpoint (mobility);
+          if (endpoint.room >= 0)
+          {
+              GetInternalWallLoss (endpoint.room);
+          }
+      }
+  }
+}
+
+inline const std::vector<double> &
+RoomTablePropagationLossModel::GetInternalWallLoss (uint32_t room) const
+{
+  std::map<uint32_t, std::vector<double> >::iterator it = m_internalWallLoss.find (room);
+  if (it != m_internalWallLoss.end ())
+  {
+      return it->second;
+  }
+  DoubleValue internalWallLoss;
+  GetAttribute ("InternalWallLoss", internalWallLoss);
+  const Room &from = m_rooms[room];
+  std::vector<double> &row = m_internalWallLoss[room];
+  for (uint32_t r = from.firstRoom; r < m_rooms.size () && m_rooms[r].building == from.building; ++r)
+  {
+      double dx = std::abs ((int32_t) from.roomX - (int32_t) m_rooms[r].roomX);
+      double dy = std::abs ((int32_t) from.roomY - (int32_t) m_rooms[r].roomY);
+      row.push_back (internalWallLoss.Get () * (dx + dy));
+  }
+  return row;
+}
+
+inline const RoomTablePropagationLossModel::Endpoint &
+RoomTablePropagationLossModel::GetEndpoint (Ptr<MobilityModel> node) const
+{
+  Vector position = node->GetPosition ();
+  std::map<MobilityModel *, Endpoint>::iterator it = m_endpoints.find (PeekPointer (node));
+  if (it != m_endpoints.end () && it->second.position.x == position.x
+      && it->second.position.y == position.y && it->second.position.z == position.z)
+  {
+      return it->second;
+  }
+  Ptr<MobilityBuildingInfo> info = node->GetObject<MobilityBuildingInfo> ();
+  NS_ASSERT_MSG (info, "RoomTablePropagationLossModel only works with MobilityBuildingInfo");
+  Endpoint endpoint;
+  endpoint.position = position;
+  endpoint.room = -1;
+  endpoint.internalWallLoss = 0;
+  if (info->IsIndoor ())
+  {
+      Ptr<Building> building = info->GetBuilding ();
+      std::map<Building *, uint32_t>::const_iterator first = m_firstRooms.find (PeekPointer (building));
+      NS_ASSERT_MSG (first != m_firstRooms.end (), "Building created after the room tables");
+      endpoint.room = first->second
+        + ((info->GetFloorNumber () - 1) * building->GetNRoomsY () + info->GetRoomNumberY () - 1) * building->GetNRoomsX ()
+        + info->GetRoomNumberX () - 1;
+  }
+  return m_endpoints[PeekPointer (node)] = endpoint;
+}
+
+inline double
+RoomTablePropagationLossModel::GetLoss (Ptr<MobilityModel> a, Ptr<MobilityModel> b) const
+{
+  if (!m_tablesBuilt)
+  {
+      BuildTables ();
+  }
+  const Endpoint &ea = GetEndpoint (a);
+  const Endpoint &eb = GetEndpoint (b);
+  NS_ASSERT_MSG ((ea.position.z >= 0) && (eb.position.z >= 0),
+                 "RoomTablePropagationLossModel does not support underground nodes (placed at z < 0)");
+  double distance = a->GetDistanceFrom (b);
+  // ITU-R 1411 only when both ends are strictly below the rooftop, as in the
+  // hybrid model; an end at rooftop height takes Okumura-Hata
+  bool belowRooftop = ea.position.z < m_rooftopHeight && eb.position.z < m_rooftopHeight;
+
+  double loss = 0.0;
+  if (ea.room < 0)
+  {
+      if (eb.room < 0)
+      {
+          loss = distance > 1000 && !belowRooftop ? OkumuraHata (a, b) : ItuR1411 (a, b);
+      }
+      else
+      {
+          const Room &rb = m_rooms[eb.room];
+          if (distance > 1000 && !belowRooftop)
+          {
+              loss = OkumuraHata (a, b) + rb.externalWallLoss;
+          }
+          else
+          {
+              loss = ItuR1411 (a, b) + rb.externalWallLoss + rb.heightLoss;
+          }
+      }
+  }
+  else
+  {
+      const Room &ra = m_rooms[ea.room];
+      if (eb.room >= 0)
+      {
+          const Room &rb = m_rooms[eb.room];
+          if (ra.building == rb.building)
+          {
+              if (!ea.internalWallLoss)
+              {
+                  m_endpoints[PeekPointer (a)].internalWallLoss = &GetInternalWallLoss (ea.room);
+              }
+              loss = m_ituR1238->GetLoss (a, b) + (*ea.internalWallLoss)[eb.room - ra.firstRoom];
+          }
+          else
+          {
+              loss = ItuR1411 (a, b) + ra.externalWallLoss + rb.externalWallLoss;
+          }
+      }
+      else if (distance > 1000 && !belowRooftop)
+      {
+          loss = OkumuraHata (a, b) + ra.externalWallLoss;
+      }
+      else
+      {
+          loss = ItuR1411 (a, b) + ra.externalWallLoss + ra.heightLoss;
+      }
+  }
+  return std::max (loss, 0.0);
+}
+
+} // namespace ns3
+
+#endif // ROOM_TABLE_PROPAGATION_LOSS_MODEL_H
@@ -0,0 +1,461 @@
+#ifndef SAMPLED_FLOW_MONITOR_H
+#define SAMPLED_FLOW_MONITOR_H
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+
+#include <cmath>
+#include <fstream>
+#include <map>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace ns3 {
+
+static GlobalValue g_flowSampleFraction ("flowSampleFraction",
+                                         "Fraction of the IP flows tracked by the sampled flow monitor (0: disabled)",
+                                         DoubleValue (0.0),
+                                         MakeDoubleChecker<double> (0.0, 1.0));
+static GlobalValue g_flowSamplePacketInterval ("flowSamplePacketInterval",
+                                               "Sampled flow monitor: measure the delay of 1 in N packets of a tracked flow",
+                                               UintegerValue (1),
+                                               MakeUintegerChecker<uint32_t> (1));
+static GlobalValue g_flowSampleMaxFlows ("flowSampleMaxFlows",
+                                         "Sampled flow monitor: number of flow slots; flows beyond it are not tracked",
+                                         UintegerValue (65536),
+                                         MakeUintegerChecker<uint32_t> (1));
+
+// Carries the flow slot and send time of a probe packet from the source to
+// the destination node, as a byte tag so that it survives RLC segmentation.
+class SampledFlowTag : public Tag
+{
+public:
+  static TypeId GetTypeId ();
+  SampledFlowTag ();
+  SampledFlowTag (uint32_t slot, Time txTime);
+
+  uint32_t GetSlot () const;
+  Time GetTxTime () const;
+
+  virtual TypeId GetInstanceTypeId () const;
+  virtual uint32_t GetSerializedSize () const;
+  virtual void Serialize (TagBuffer buffer) const;
+  virtual void Deserialize (TagBuffer buffer);
+  virtual void Print (std::ostream &os) const;
+
+private:
+  uint32_t m_slot;
+  int64_t m_txTime;
+};
+
+NS_OBJECT_ENSURE_REGISTERED (SampledFlowTag);
+
+inline TypeId
+SampledFlowTag::GetTypeId ()
+{
+  static TypeId tid = TypeId ("ns3::SampledFlowTag")
+    .SetParent<Tag> ()
+    .AddConstructor<SampledFlowTag> ()
+  ;
+  return tid;
+}
+
+inline
+SampledFlowTag::SampledFlowTag ()
+  : m_slot (0),
+    m_txTime (0)
+{
+}
+
+inline
+SampledFlowTag::SampledFlowTag (uint32_t slot, Time txTime)
+  : m_slot (slot),
+    m_txTime (txTime.GetTimeStep ())
+{
+}
+
+inline uint32_t
+SampledFlowTag::GetSlot () const
+{
+  return m_slot;
+}
+
+inline Time
+SampledFlowTag::GetTxTime () const
+{
+  return TimeStep (m_txTime);
+}
+
+inline TypeId
+SampledFlowTag::GetInstanceTypeId () const
+{
+  return GetTypeId ();
+}
+
+inline uint32_t
+SampledFlowTag::GetSerializedSize () const
+{
+  return 12;
+}
+
+inline void
+SampledFlowTag::Serialize (TagBuffer buffer) const
+{
+  buffer.WriteU32 (m_slot);
+  buffer.WriteU64 (m_txTime);
+}
+
+inline void
+SampledFlowTag::Deserialize (TagBuffer buffer)
+{
+  m_slot = buffer.ReadU32 ();
+  m_txTime = buffer.ReadU64 ();
+}
+
+inline void
+SampledFlowTag::Print (std::ostream &os) const
+{
+  os << "slot=" << m_slot << " txTime=" << m_txTime;
+}
+
+// A FlowMonitor that only looks at a sample of the traffic.  Every packet
+// leaving a monitored node is classified by its 5-tuple, whose hash decides
+// whether the flow is tracked, so a fraction f of the flows is tracked
+// without any per-flow state for the others.  Of a tracked flow, every
+// packet is counted and 1 in N is a probe: it is tagged with the send time
+// and its delay, the jitter against the previous probe and its loss are
+// measured at the destination.  Each tracked flow has a fixed-size slot with
+// delay and jitter histograms in power-of-two bins of microseconds (bin 0
+// below 1 us, bin k in [2^(k-1), 2^k) us).  Probes lost are the probes sent
+// minus the ones received, so they include the ones still in flight at the
+// end.  Flows are labelled with the traffic profile of their UE address.
+class SampledFlowMonitor
+{
+public:
+  SampledFlowMonitor (double flowFraction, uint32_t packetInterval, uint32_t maxFlows);
+
+  // monitors the traffic sent and received by the nodes
+  void Install (NodeContainer nodes);
+  void Install (Ptr<Node> node);
+  void SetProfile (Ipv4Address address, uint32_t profile);
+  // one line per tracked flow, and the flows of every profile merged
+  void PrintStats (std::string flowsFilename, std::string profilesFilename) const;
+
+private:
+  enum
+  {
+    BINS = 24,
+    NO_PROFILE = 0xffffffff
+  };
+  struct Flow
+  {
+    Ipv4Address source;
+    Ipv4Address destination;
+    uint8_t protocol;
+    uint16_t sourcePort;
+    uint16_t destinationPort;
+    uint64_t packets;
+    uint64_t bytes;
+    uint64_t probes;
+    uint64_t received;
+    uint64_t dropped;
+    Time delaySum;
+    Time jitterSum;
+    Time lastDelay;
+    uint32_t delayHistogram[BINS];
+    uint32_t jitterHistogram[BINS];
+  };
+
+  static void SendOutgoing (SampledFlowMonitor *monitor, const Ipv4Header &header, Ptr<const Packet> packet,
+                            uint32_t interface);
+  static void LocalDeliver (SampledFlowMonitor *monitor, const Ipv4Header &header, Ptr<const Packet> packet,
+                            uint32_t interface);
+  static void Drop (SampledFlowMonitor *monitor, const Ipv4Header &header, Ptr<const Packet> packet,
+                    Ipv4L3Protocol::DropReason reason, Ptr<Ipv4> ipv4, uint32_t interface);
+  static uint32_t GetBin (Time time);
+  static void GetQuantiles (const uint32_t histogram[BINS], uint64_t count, double values[3]);
+  uint32_t GetProfile (const Flow &flow) const;
+
+  uint64_t m_threshold;
+  uint32_t m_packetInterval;
+  uint32_t m_maxFlows;
+  std::vector<Flow> m_flows;
+  // 5-tuple hash -> slot
+  std::unordered_map<uint64_t, uint32_t> m_slots;
+  uint64_t m_untrackedPackets;
+  std::map<uint32_t, uint32_t> m_profiles;
+  std::set<uint32_t> m_nodes;
+};
+
+inline
+SampledFlowMonitor::SampledFlowMonitor (double flowFraction, uint32_t packetInterval, uint32_t maxFlows)
+  : m_threshold (flowFraction >= 1.0 ? ~0ULL : (uint64_t) std::ldexp (flowFraction, 64)),
+    m_packetInterval (packetInterval),
+    m_maxFlows (maxFlows),
+    m_untrackedPackets (0)
+{
+}
+
+inline void
+SampledFlowMonitor::Install (NodeContainer nodes)
+{
+  for (uint32_t i = 0; i < nodes.GetN (); ++i)
+  {
+      Install (nodes.Get (i));
+  }
+}
+
+inline void
+SampledFlowMonitor::Install (Ptr<Node> node)
+{
+  Ptr<Ipv4L3Protocol> ipv4 = node->GetObject<Ipv4L3Protocol> ();
+  if (!ipv4 || !m_nodes.insert (node->GetId ()).second)
+  {
+      return;
+  }
+  ipv4->TraceConnectWithoutContext ("SendOutgoing", MakeBoundCallback (&SampledFlowMonitor::SendOutgoing, this));
+  ipv4->TraceConnectWithoutContext ("LocalDeliver", MakeBoundCallback (&SampledFlowMonitor::LocalDeliver, this));
+  ipv4->TraceConnectWithoutContext ("Drop", MakeBoundCallback (&SampledFlowMonitor::Drop, this));
+}
+
+inline void
+SampledFlowMonitor::SetProfile (Ipv4Address address, uint32_t profile)
+{
+  m_profiles[address.Get ()] = profile;
+}
+
+inline void
+SampledFlowMonitor::SendOutgoing (SampledFlowMonitor *monitor, const Ipv4Header &header, Ptr<const Packet> packet,
+                                  uint32_t interface)
+{
+  uint16_t sourcePort = 0;
+  uint16_t destinationPort = 0;
+  if (header.GetProtocol () == UdpL4Protocol::PROT_NUMBER && packet->GetSize () >= 8)
+  {
+      UdpHeader udp;
+      packet->PeekHeader (udp);
+      sourcePort = udp.GetSourcePort ();
+      destinationPort = udp.GetDestinationPort ();
+  }
+  else if (header.GetProtocol () == TcpL4Protocol::PROT_NUMBER && packet->GetSize () >= 20)
+  {
+      TcpHeader tcp;
+      packet->PeekHeader (tcp);
+      sourcePort = tcp.GetSourcePort ();
+      destinationPort = tcp.GetDestinationPort ();
+  }
+  // splitmix64 of the 5-tuple
+  uint64_t h = ((uint64_t) header.GetSource ().Get () << 32) | header.GetDestination ().Get ();
+  h ^= ((uint64_t) header.GetProtocol () << 32 | (uint32_t) sourcePort << 16 | destinationPort) * 0x9e3779b97f4a7c15ULL;
+  h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+  h ^= h >> 31;
+  if (h > monitor->m_threshold)
+  {
+      return;
+  }
+
+  std::unordered_map<uint64_t, uint32_t>::iterator it = monitor->m_slots.find (h);
+  if (it == monitor->m_slots.end ())
+  {
+      if (monitor->m_flows.size () >= monitor->m_maxFlows)
+      {
+          ++monitor->m_untrackedPackets;
+          return;
+      }
+      Flow flow = Flow ();
+      flow.source = header.GetSource ();
+      flow.destination = header.GetDestination ();
+      flow.protocol = header.GetProtocol ();
+      flow.sourcePort = sourcePort;
+      flow.destinationPort = destinationPort;
+      flow.lastDelay = Time (-1);
+      it = monitor->m_slots.insert (std::make_pair (h, monitor->m_flows.size ())).first;
+      monitor->m_flows.push_back (flow);
+  }
+  Flow &flow = monitor->m_flows[it->second];
+  if (flow.packets++ % monitor->m_packetInterval == 0)
+  {
+      ++flow.probes;
+      packet->AddByteTag (SampledFlowTag (it->second, Simulator::Now ()));
+  }
+  flow.bytes += packet->GetSize ();
+}
+
+inline void
+SampledFlowMonitor::LocalDeliver (SampledFlowMonitor *monitor, const Ipv4Header &header, Ptr<const Packet> packet,
+                                  uint32_t interface)
+{
+  SampledFlowTag tag;
+  if (!packet->FindFirstMatchingByteTag (tag) || tag.GetSlot () >= monitor->m_flows.size ())
+  {
+      return;
+  }
+  Flow &flow = monitor->m_flows[tag.GetSlot ()];
+  Time delay = Simulator::Now () - tag.GetTxTime ();
+  ++flow.received;
+  flow.delaySum += delay;
+  ++flow.delayHistogram[GetBin (delay)];
+  if (!flow.lastDelay.IsNegative ())
+  {
+      Time jitter = Abs (delay - flow.lastDelay);
+      flow.jitterSum += jitter;
+      ++flow.jitterHistogram[GetBin (jitter)];
+  }
+  flow.lastDelay = delay;
+}
+
+inline void
+SampledFlowMonitor::Drop (SampledFlowMonitor *monitor, const Ipv4Header &header, Ptr<const Packet> packet,
+                          Ipv4L3Protocol::DropReason reason, Ptr<Ipv4> ipv4, uint32_t interface)
+{
+  SampledFlowTag tag;
+  if (packet->FindFirstMatchingByteTag (tag) && tag.GetSlot () < monitor->m_flows.size ())
+  {
+      ++monitor->m_flows[tag.GetSlot ()].dropped;
+  }
+}
+
+inline uint32_t
+SampledFlowMonitor::GetBin (Time time)
+{
+  uint32_t bin = 0;
+  for (int64_t us = time.GetMicroSeconds (); us > 0 && bin < BINS - 1; us >>= 1)
+  {
+      ++bin;
+  }
+  return bin;
+}
+
+inline uint32_t
+SampledFlowMonitor::GetProfile (const Flow &flow) const
+{
+  std::map<uint32_t, uint32_t>::const_iterator it = m_profiles.find (flow.source.Get ());
+  if (it == m_profiles.end ())
+  {
+      it = m_profiles.find (flow.destination.Get ());
+  }
+  return it != m_profiles.end () ? it->second : NO_PROFILE;
+}
+
+// p50, p90 and p99 of a histogram, as the upper edges of their bins [s]
+inline void
+SampledFlowMonitor::GetQuantiles (const uint32_t histogram[BINS], uint64_t count, double values[3])
+{
+  double quantiles[] = { 0.5, 0.9, 0.99 };
+  uint32_t q = 0;
+  uint64_t seen = 0;
+  for (uint32_t k = 0; k < 3; ++k)
+  {
+      values[k] = 0;
+  }
+  for (uint32_t k = 0; k < BINS && q < 3; ++k)
+  {
+      seen += histogram[k];
+      while (q < 3 && count > 0 && seen >= std::ceil (quantiles[q] * count))
+      {
+          values[q++] = std::ldexp (1e-6, k);
+      }
+  }
+}
+
+// Per profile: the loss split into probes dropped by IP and probes missing
+// otherwise (lost below IP or still in flight), the delay and jitter
+// quantiles, and the delay and jitter histograms.
+inline void
+SampledFlowMonitor::PrintStats (std::string flowsFilename, std::string profilesFilename) const
+{
+  std::ofstream flows;
+  flows.open (flowsFilename.c_str (), std::ios_base::out | std::ios_base::trunc);
+  std::ofstream profiles;
+  profiles.open (profilesFilename.c_str (), std::ios_base::out | std::ios_base::trunc);
+  if (!flows.is_open () || !profiles.is_open ())
+  {
+      NS_LOG_UNCOND ("Can't open file " << flowsFilename << " or " << profilesFilename);
+      return;
+  }
+  flows << "% source\tdestination\tprotocol\tsourcePort\tdestinationPort\tprofile\tpackets\tbytes\tprobes"
+        << "\treceived\tdropped\tlost\tmeanDelay\tmeanJitter\tdelayHistogram[" << BINS << "]" << std::endl;
+  std::map<uint32_t, Flow> merged;
+  std::map<uint32_t, uint32_t> flowCount;
+  std::map<uint32_t, uint64_t> jitterCount;
+  for (uint32_t i = 0; i < m_flows.size (); ++i)
+  {
+      const Flow &flow = m_flows[i];
+      uint32_t profile = GetProfile (flow);
+      uint64_t jitterSamples = flow.received > 0 ? flow.received - 1 : 0;
+      flows << flow.source << "\t" << flow.destination << "\t" << (uint32_t) flow.protocol
+            << "\t" << flow.sourcePort << "\t" << flow.destinationPort
+            << "\t" << (profile == NO_PROFILE ? -1 : (int64_t) profile)
+            << "\t" << flow.packets << "\t" << flow.bytes << "\t" << flow.probes
+            << "\t" << flow.received << "\t" << flow.dropped << "\t" << flow.probes - flow.received
+            << "\t" << (flow.received > 0 ? flow.delaySum.GetSeconds () / flow.received : 0.0)
+            << "\t" << (jitterSamples > 0 ? flow.jitterSum.GetSeconds () / jitterSamples : 0.0);
+      for (uint32_t k = 0; k < BINS; ++k)
+      {
+          flows << "\t" << flow.delayHistogram[k];
+      }
+      flows << "\n";
+
+      std::map<uint32_t, Flow>::iterator it = merged.find (profile);
+      if (it == merged.end ())
+      {
+          it = merged.insert (std::make_pair (profile, Flow ())).first;
+      }
+      Flow &sum = it->second;
+      ++flowCount[profile];
+      jitterCount[profile] += jitterSamples;
+      sum.packets += flow.packets;
+      sum.probes += flow.probes;
+      sum.received += flow.received;
+      sum.dropped += flow.dropped;
+      sum.delaySum += flow.delaySum;
+      sum.jitterSum += flow.jitterSum;
+      for (uint32_t k = 0; k < BINS; ++k)
+      {
+          sum.delayHistogram[k] += flow.delayHistogram[k];
+          sum.jitterHistogram[k] += flow.jitterHistogram[k];
+      }
+  }
+  flows << "% untracked packets (no free slot): " << m_untrackedPackets << "\n";
+  flows.close ();
+
+  profiles << "% profile\tflows\tprobes\treceived\tdropped\tmissing\tlossRatio\tmeanDelay\tp50Delay\tp90Delay\tp99Delay"
+           << "\tmeanJitter\tp50Jitter\tp90Jitter\tp99Jitter\tdelayHistogram[" << BINS << "]\tjitterHistogram[" << BINS << "]"
+           << std::endl;
+  for (std::map<uint32_t, Flow>::const_iterator it = merged.begin (); it != merged.end (); ++it)
+  {
+      const Flow &sum = it->second;
+      uint64_t jitterSamples = jitterCount[it->first];
+      uint64_t lost = sum.probes - sum.received;
+      double delays[3];
+      double jitters[3];
+      GetQuantiles (sum.delayHistogram, sum.received, delays);
+      GetQuantiles (sum.jitterHistogram, jitterSamples, jitters);
+      profiles << (it->first == NO_PROFILE ? -1 : (int64_t) it->first) << "\t" << flowCount[it->first]
+               << "\t" << sum.probes << "\t" << sum.received << "\t" << sum.dropped
+               << "\t" << (lost > sum.dropped ? lost - sum.dropped : 0)
+               << "\t" << (sum.probes > 0 ? (double) lost / sum.probes : 0.0)
+               << "\t" << (sum.received > 0 ? sum.delaySum.GetSeconds () / sum.received : 0.0)
+               << "\t" << delays[0] << "\t" << delays[1] << "\t" << delays[2]
+               << "\t" << (jitterSamples > 0 ? sum.jitterSum.GetSeconds () / jitterSamples : 0.0)
+               << "\t" << jitters[0] << "\t" << jitters[1] << "\t" << jitters[2];
+      for (uint32_t k = 0; k < BINS; ++k)
+      {
+          profiles << "\t" << sum.delayHistogram[k];
+      }
+      for (uint32_t k = 0; k < BINS; ++k)
+      {
+          profiles << "\t" << sum.jitterHistogram[k];
+      }
+      profiles << "\n";
+  }
+  profiles.close ();
+}
+
+} // namespace ns3
+
+#endif // SAMPLED_FLOW_MONITOR_H
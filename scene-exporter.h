@@ -0,0 +1,192 @@
+#ifndef SCENE_EXPORTER_H
+#define SCENE_EXPORTER_H
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/mobility-module.h"
+#include "ns3/buildings-module.h"
+#include "ns3/lte-module.h"
+
+#include "async-trace-writer.h"
+#include "lte-trace-registry.h"
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace ns3 {
+
+static GlobalValue g_sceneSampleInterval ("sceneSampleInterval",
+                                          "Interval [s] of the UE position samples in the scene file (0: initial scene only)",
+                                          DoubleValue (0.0),
+                                          MakeDoubleChecker<double> (0.0));
+static GlobalValue g_sceneSampleMinDistance ("sceneSampleMinDistance",
+                                             "Distance [m] a UE has to move since its last scene record to be sampled again, unless its serving cell changed",
+                                             DoubleValue (1.0),
+                                             MakeDoubleChecker<double> (0.0));
+
+// Writes the scene (buildings, eNBs and UEs) in one pass to a binary file,
+// decoded offline by utils/decode-scene.py, which also turns it into the
+// gnuplot object and label lists used to plot a REM.  The file is a 16-byte
+// header ("LTSC", then uint32 version, record size and 0) followed by fixed
+// 40-byte little-endian records:
+//
+//   double time; uint16 kind; uint16 cellId; uint64 id; float values[5]
+//
+// with the id and values of each kind listed in SceneExporter::Kind.  With a
+// sample interval the UE positions and serving cells are sampled again
+// periodically; a UE is only written when it moved at least the minimum
+// distance or changed cell since its last record, so static UEs cost one
+// record.  The devices come from the trace registry instead of probing every
+// device of every node.
+class SceneExporter
+{
+public:
+  enum Kind
+  {
+    BUILDING,   // id: building id; values: xMin, yMin, xMax, yMax, zMax
+    ENB,        // cellId; id: DL EARFCN; values: x, y, z, txPower [dBm], DL bandwidth [RBs]
+    UE,         // cellId: serving cell (0: none); id: IMSI; values: x, y, z, vx, vy
+    HEADER = 0xff
+  };
+  static const uint32_t RECORD_SIZE = 40;
+
+  SceneExporter ();
+
+  // writes the scene at the current time and, if interval is positive,
+  // samples the UEs every interval until the end of the simulation
+  void Start (const LteTraceRegistry &registry, std::string filename, Time interval, double minDistance);
+
+private:
+  struct UeState
+  {
+    Vector position;
+    uint16_t cellId;
+    bool written;
+  };
+
+  void SampleUes ();
+  void WriteRecord (Kind kind, uint16_t cellId, uint64_t id, double v0, double v1, double v2, double v3, double v4);
+  static void Format (std::string &out, const AsyncTraceWriter::Record &record);
+
+  std::vector<Ptr<LteUeNetDevice> > m_ueDevs;
+  std::vector<UeState> m_ues;
+  Time m_interval;
+  double m_minDistance;
+  int32_t m_stream;
+};
+
+inline
+SceneExporter::SceneExporter ()
+  : m_minDistance (0),
+    m_stream (-1)
+{
+}
+
+inline void
+SceneExporter::Start (const LteTraceRegistry &registry, std::string filename, Time interval, double minDistance)
+{
+  m_stream = AsyncTraceWriter::Get ().Open (filename, &SceneExporter::Format);
+  if (m_stream < 0)
+  {
+      return;
+  }
+  m_interval = interval;
+  m_minDistance = minDistance;
+  WriteRecord (HEADER, 0, 0, 0, 0, 0, 0, 0);
+
+  for (BuildingList::Iterator it = BuildingList::Begin (); it != BuildingList::End (); ++it)
+  {
+      Box box = (*it)->GetBoundaries ();
+      WriteRecord (BUILDING, 0, (*it)->GetId (), box.xMin, box.yMin, box.xMax, box.yMax, box.zMax);
+  }
+  const std::vector<Ptr<LteEnbNetDevice> > &enbDevs = registry.GetEnbDevices ();
+  for (uint32_t i = 0; i < enbDevs.size (); ++i)
+  {
+      Ptr<LteEnbNetDevice> dev = enbDevs[i];
+      Vector pos = dev->GetNode ()->GetObject<MobilityModel> ()->GetPosition ();
+      WriteRecord (ENB, dev->GetCellId (), dev->GetDlEarfcn (),
+                   pos.x, pos.y, pos.z, dev->GetPhy ()->GetTxPower (), dev->GetDlBandwidth ());
+  }
+  m_ueDevs = registry.GetUeDevices ();
+  UeState unwritten;
+  unwritten.cellId = 0;
+  unwritten.written = false;
+  m_ues.assign (m_ueDevs.size (), unwritten);
+  SampleUes ();
+}
+
+inline void
+SceneExporter::SampleUes ()
+{
+  for (uint32_t i = 0; i < m_ueDevs.size (); ++i)
+  {
+      UeState &state = m_ues[i];
+      Ptr<MobilityModel> mobility = m_ueDevs[i]->GetNode ()->GetObject<MobilityModel> ();
+      Vector pos = mobility->GetPosition ();
+      uint16_t cellId = m_ueDevs[i]->GetRrc ()->GetCellId ();
+      if (state.written && cellId == state.cellId && CalculateDistance (pos, state.position) < m_minDistance)
+      {
+          continue;
+      }
+      Vector velocity = mobility->GetVelocity ();
+      WriteRecord (UE, cellId, m_ueDevs[i]->GetImsi (), pos.x, pos.y, pos.z, velocity.x, velocity.y);
+      state.position = pos;
+      state.cellId = cellId;
+      state.written = true;
+  }
+  if (m_interval.IsStrictlyPositive ())
+  {
+      Simulator::Schedule (m_interval, &SceneExporter::SampleUes, this);
+  }
+}
+
+inline void
+SceneExporter::WriteRecord (Kind kind, uint16_t cellId, uint64_t id,
+                            double v0, double v1, double v2, double v3, double v4)
+{
+  AsyncTraceWriter::Record record = AsyncTraceWriter::Record ();
+  record.stream = m_stream;
+  record.type = ((uint32_t) cellId << 16) | kind;
+  record.id = id;
+  record.values[0] = Simulator::Now ().GetSeconds ();
+  record.values[1] = v0;
+  record.values[2] = v1;
+  record.values[3] = v2;
+  record.values[4] = v3;
+  record.values[5] = v4;
+  AsyncTraceWriter::Get ().Write (record);
+}
+
+inline void
+SceneExporter::Format (std::string &out, const AsyncTraceWriter::Record &record)
+{
+  char buffer[RECORD_SIZE];
+  uint16_t kind = record.type & 0xffff;
+  uint16_t cellId = record.type >> 16;
+  if (kind == HEADER)
+  {
+      uint32_t words[] = { 1, RECORD_SIZE, 0 };
+      std::memcpy (buffer, "LTSC", 4);
+      std::memcpy (buffer + 4, words, sizeof (words));
+      out.append (buffer, 16);
+      return;
+  }
+  double time = record.values[0];
+  uint64_t id = record.id;
+  float values[5];
+  for (uint32_t v = 0; v < 5; ++v)
+  {
+      values[v] = record.values[1 + v];
+  }
+  std::memcpy (buffer, &time, 8);
+  std::memcpy (buffer + 8, &kind, 2);
+  std::memcpy (buffer + 10, &cellId, 2);
+  std::memcpy (buffer + 12, &id, 8);
+  std::memcpy (buffer + 20, values, 20);
+  out.append (buffer, RECORD_SIZE);
+}
+
+} // namespace ns3
+
+#endif // SCENE_EXPORTER_H
@@ -0,0 +1,449 @@
+#ifndef SCHEDULER_LATENCY_PROBE_H
+#define SCHEDULER_LATENCY_PROBE_H
+
+#include "ns3/core-module.h"
+#include "ns3/lte-module.h"
+
+#include "lte-trace-registry.h"
+
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace ns3 {
+
+static GlobalValue g_schedulerLatency ("schedulerLatency",
+                                       "Measure the wall time of every scheduler decision per cell",
+                                       BooleanValue (false),
+                                       MakeBooleanChecker ());
+static GlobalValue g_schedulerLatencyBudget ("schedulerLatencyBudget",
+                                             "Wall time [s] above which a scheduler decision counts as over budget",
+                                             DoubleValue (0.001),
+                                             MakeDoubleChecker<double> (0.0));
+
+// Measures how long the FfMacScheduler of every cell takes per TTI.  The SAP
+// between the eNB MAC and its scheduler is rerouted through a probe per
+// component carrier: the MAC calls the probe, which times the call and
+// forwards it to the scheduler, and the scheduler answers through the probe
+// to the MAC.  The time spent in the MAC handling the answer (which happens
+// within the trigger call) is not counted.  The DL and UL triggers, i.e. the
+// per-TTI decisions, go into log-spaced histograms (4 bins per octave of
+// nanoseconds) per scheduler type, cell, direction and bucket of active UEs:
+// UEs with buffered DL data for the DL, UEs reporting a non-empty UL buffer
+// for the UL, bucketed by powers of two.  The other SAP calls (buffer and
+// CQI reports) are only summed, since they are per UE and not per TTI.
+class SchedulerLatencyProbe
+{
+public:
+  SchedulerLatencyProbe (Time budget);
+  ~SchedulerLatencyProbe ();
+
+  void Install (const LteTraceRegistry &registry);
+  void PrintStats (std::string filename) const;
+
+private:
+  typedef std::chrono::steady_clock Clock;
+  enum
+  {
+    DL,
+    UL,
+    BINS_PER_OCTAVE = 4,
+    BINS = 128,
+    UE_BUCKETS = 18
+  };
+  struct Histogram
+  {
+    uint64_t counts[BINS];
+    uint64_t calls;
+    uint64_t overBudget;
+    double sum;
+    double max;
+  };
+  class Cell;
+
+  // FfMacSchedSapUser of the scheduler, forwarding to the MAC
+  class MacForwarder : public FfMacSchedSapUser
+  {
+  public:
+    MacForwarder (Cell *cell);
+    virtual void SchedDlConfigInd (const struct SchedDlConfigIndParameters &params);
+    virtual void SchedUlConfigInd (const struct SchedUlConfigIndParameters &params);
+
+  private:
+    Cell *m_cell;
+  };
+
+  // FfMacSchedSapProvider of the MAC, timing and forwarding to the scheduler
+  class Cell : public FfMacSchedSapProvider
+  {
+  public:
+    Cell (SchedulerLatencyProbe *probe, std::string type, uint16_t id, uint16_t rbs,
+          Ptr<LteEnbMac> enbMac, Ptr<FfMacScheduler> ffMacScheduler);
+
+    virtual void SchedDlRlcBufferReq (const struct SchedDlRlcBufferReqParameters &params);
+    virtual void SchedDlPagingBufferReq (const struct SchedDlPagingBufferReqParameters &params);
+    virtual void SchedDlMacBufferReq (const struct SchedDlMacBufferReqParameters &params);
+    virtual void SchedDlTriggerReq (const struct SchedDlTriggerReqParameters &params);
+    virtual void SchedDlRachInfoReq (const struct SchedDlRachInfoReqParameters &params);
+    virtual void SchedDlCqiInfoReq (const struct SchedDlCqiInfoReqParameters &params);
+    virtual void SchedUlTriggerReq (const struct SchedUlTriggerReqParameters &params);
+    virtual void SchedUlNoiseInterferenceReq (const struct SchedUlNoiseInterferenceReqParameters &params);
+    virtual void SchedUlSrInfoReq (const struct SchedUlSrInfoReqParameters &params);
+    virtual void SchedUlMacCtrlInfoReq (const struct SchedUlMacCtrlInfoReqParameters &params);
+    virtual void SchedUlCqiInfoReq (const struct SchedUlCqiInfoReqParameters &params);
+
+    std::string schedulerType;
+    uint16_t cellId;
+    uint16_t bandwidth;
+    FfMacSchedSapProvider *scheduler;
+    FfMacSchedSapUser *mac;
+    MacForwarder forwarder;
+    // wall time spent in the MAC during the current call
+    Clock::duration inMac;
+    double otherSum;
+    uint64_t otherCalls;
+    // per RNTI, the DL logical channels with buffered data and whether the UL buffer is non-empty
+    std::map<uint16_t, uint32_t> dlBuffered;
+    std::map<uint16_t, bool> ulBuffered;
+    uint32_t activeDl;
+    uint32_t activeUl;
+    std::map<uint32_t, Histogram> histograms;
+
+  private:
+    Clock::time_point Begin ();
+    void EndOther (Clock::time_point start);
+    void EndTrigger (Clock::time_point start, uint32_t direction, uint32_t activeUes);
+
+    SchedulerLatencyProbe *m_probe;
+  };
+
+  static uint32_t GetBin (double seconds);
+  static double GetBinUpperEdge (uint32_t bin);
+  static uint32_t GetUeBucket (uint32_t activeUes);
+
+  double m_budget;
+  std::vector<Cell *> m_cells;
+};
+
+inline
+SchedulerLatencyProbe::SchedulerLatencyProbe (Time budget)
+  : m_budget (budget.GetSeconds ())
+{
+}
+
+// the MAC and the schedulers keep pointers to the probes until the simulator is destroyed
+inline
+SchedulerLatencyProbe::~SchedulerLatencyProbe ()
+{
+  for (uint32_t i = 0; i < m_cells.size (); ++i)
+  {
+      delete m_cells[i];
+  }
+}
+
+inline void
+SchedulerLatencyProbe::Install (const LteTraceRegistry &registry)
+{
+  const std::vector<Ptr<LteEnbNetDevice> > &enbDevs = registry.GetEnbDevices ();
+  for (uint32_t i = 0; i < enbDevs.size (); ++i)
+  {
+      Ptr<LteEnbNetDevice> dev = enbDevs[i];
+      // one MAC and scheduler per component carrier
+      std::map<uint8_t, Ptr<ComponentCarrierEnb> > ccMap = dev->GetCcMap ();
+      for (std::map<uint8_t, Ptr<ComponentCarrierEnb> >::iterator it = ccMap.begin (); it != ccMap.end (); ++it)
+      {
+          Ptr<LteEnbMac> mac = it->second->GetMac ();
+          Ptr<FfMacScheduler> scheduler = it->second->GetFfMacScheduler ();
+          m_cells.push_back (new Cell (this, scheduler->GetInstanceTypeId ().GetName (), dev->GetCellId (),
+                                       it->second->GetDlBandwidth (), mac, scheduler));
+      }
+  }
+}
+
+inline
+SchedulerLatencyProbe::MacForwarder::MacForwarder (Cell *cell)
+  : m_cell (cell)
+{
+}
+
+inline void
+SchedulerLatencyProbe::MacForwarder::SchedDlConfigInd (const struct SchedDlConfigIndParameters &params)
+{
+  Clock::time_point start = Clock::now ();
+  m_cell->mac->SchedDlConfigInd (params);
+  m_cell->inMac += Clock::now () - start;
+}
+
+inline void
+SchedulerLatencyProbe::MacForwarder::SchedUlConfigInd (const struct SchedUlConfigIndParameters &params)
+{
+  Clock::time_point start = Clock::now ();
+  m_cell->mac->SchedUlConfigInd (params);
+  m_cell->inMac += Clock::now () - start;
+}
+
+inline
+SchedulerLatencyProbe::Cell::Cell (SchedulerLatencyProbe *probe, std::string type, uint16_t id,
+                                   uint16_t rbs, Ptr<LteEnbMac> enbMac, Ptr<FfMacScheduler> ffMacScheduler)
+  : schedulerType (type),
+    cellId (id),
+    bandwidth (rbs),
+    scheduler (ffMacScheduler->GetFfMacSchedSapProvider ()),
+    mac (enbMac->GetFfMacSchedSapUser ()),
+    forwarder (this),
+    otherSum (0),
+    otherCalls (0),
+    activeDl (0),
+    activeUl (0),
+    m_probe (probe)
+{
+  enbMac->SetFfMacSchedSapProvider (this);
+  ffMacScheduler->SetFfMacSchedSapUser (&forwarder);
+}
+
+inline SchedulerLatencyProbe::Clock::time_point
+SchedulerLatencyProbe::Cell::Begin ()
+{
+  inMac = Clock::duration::zero ();
+  return Clock::now ();
+}
+
+inline void
+SchedulerLatencyProbe::Cell::EndOther (Clock::time_point start)
+{
+  otherSum += std::chrono::duration<double> (Clock::now () - start - inMac).count ();
+  ++otherCalls;
+}
+
+inline void
+SchedulerLatencyProbe::Cell::EndTrigger (Clock::time_point start, uint32_t direction, uint32_t activeUes)
+{
+  double seconds = std::chrono::duration<double> (Clock::now () - start - inMac).count ();
+  uint32_t key = direction * UE_BUCKETS + GetUeBucket (activeUes);
+  std::map<uint32_t, Histogram>::iterator it = histograms.find (key);
+  if (it == histograms.end ())
+  {
+      Histogram empty = Histogram ();
+      it = histograms.insert (std::make_pair (key, empty)).first;
+  }
+  Histogram &histogram = it->second;
+  ++histogram.counts[GetBin (seconds)];
+  ++histogram.calls;
+  histogram.sum += seconds;
+  histogram.max = std::max (histogram.max, seconds);
+  if (seconds > m_probe->m_budget)
+  {
+      ++histogram.overBudget;
+  }
+}
+
+inline void
+SchedulerLatencyProbe::Cell::SchedDlRlcBufferReq (const struct SchedDlRlcBufferReqParameters &params)
+{
+  uint32_t &lcs = dlBuffered[params.m_rnti];
+  uint32_t before = lcs;
+  uint32_t lc = 1u << (params.m_logicalChannelIdentity & 31);
+  if (params.m_rlcTransmissionQueueSize + params.m_rlcRetransmissionQueueSize + params.m_rlcStatusPduSize > 0)
+  {
+      lcs |= lc;
+  }
+  else
+  {
+      lcs &= ~lc;
+  }
+  if (before == 0 && lcs != 0)
+  {
+      ++activeDl;
+  }
+  else if (before != 0 && lcs == 0)
+  {
+      --activeDl;
+  }
+  Clock::time_point start = Begin ();
+  scheduler->SchedDlRlcBufferReq (params);
+  EndOther (start);
+}
+
+inline void
+SchedulerLatencyProbe::Cell::SchedDlPagingBufferReq (const struct SchedDlPagingBufferReqParameters &params)
+{
+  Clock::time_point start = Begin ();
+  scheduler->SchedDlPagingBufferReq (params);
+  EndOther (start);
+}
+
+inline void
+SchedulerLatencyProbe::Cell::SchedDlMacBufferReq (const struct SchedDlMacBufferReqParameters &params)
+{
+  Clock::time_point start = Begin ();
+  scheduler->SchedDlMacBufferReq (params);
+  EndOther (start);
+}
+
+inline void
+SchedulerLatencyProbe::Cell::SchedDlTriggerReq (const struct SchedDlTriggerReqParameters &params)
+{
+  Clock::time_point start = Begin ();
+  scheduler->SchedDlTriggerReq (params);
+  EndTrigger (start, DL, activeDl);
+}
+
+inline void
+SchedulerLatencyProbe::Cell::SchedDlRachInfoReq (const struct SchedDlRachInfoReqParameters &params)
+{
+  Clock::time_point start = Begin ();
+  scheduler->SchedDlRachInfoReq (params);
+  EndOther (start);
+}
+
+inline void
+SchedulerLatencyProbe::Cell::SchedDlCqiInfoReq (const struct SchedDlCqiInfoReqParameters &params)
+{
+  Clock::time_point start = Begin ();
+  scheduler->SchedDlCqiInfoReq (params);
+  EndOther (start);
+}
+
+inline void
+SchedulerLatencyProbe::Cell::SchedUlTriggerReq (const struct SchedUlTriggerReqParameters &params)
+{
+  Clock::time_point start = Begin ();
+  scheduler->SchedUlTriggerReq (params);
+  EndTrigger (start, UL, activeUl);
+}
+
+inline void
+SchedulerLatencyProbe::Cell::SchedUlNoiseInterferenceReq (const struct SchedUlNoiseInterferenceReqParameters &params)
+{
+  Clock::time_point start = Begin ();
+  scheduler->SchedUlNoiseInterferenceReq (params);
+  EndOther (start);
+}
+
+inline void
+SchedulerLatencyProbe::Cell::SchedUlSrInfoReq (const struct SchedUlSrInfoReqParameters &params)
+{
+  Clock::time_point start = Begin ();
+  scheduler->SchedUlSrInfoReq (params);
+  EndOther (start);
+}
+
+inline void
+SchedulerLatencyProbe::Cell::SchedUlMacCtrlInfoReq (const struct SchedUlMacCtrlInfoReqParameters &params)
+{
+  for (uint32_t i = 0; i < params.m_macCeList.size (); ++i)
+  {
+      const MacCeListElement_s &ce = params.m_macCeList[i];
+      if (ce.m_macCeType != MacCeListElement_s::BSR)
+      {
+          continue;
+      }
+      bool buffered = false;
+      for (uint32_t lcg = 0; lcg < ce.m_macCeValue.m_bufferStatus.size (); ++lcg)
+      {
+          buffered = buffered || ce.m_macCeValue.m_bufferStatus[lcg] > 0;
+      }
+      bool &wasBuffered = ulBuffered[ce.m_rnti];
+      if (buffered && !wasBuffered)
+      {
+          ++activeUl;
+      }
+      else if (!buffered && wasBuffered)
+      {
+          --activeUl;
+      }
+      wasBuffered = buffered;
+  }
+  Clock::time_point start = Begin ();
+  scheduler->SchedUlMacCtrlInfoReq (params);
+  EndOther (start);
+}
+
+inline void
+SchedulerLatencyProbe::Cell::SchedUlCqiInfoReq (const struct SchedUlCqiInfoReqParameters &params)
+{
+  Clock::time_point start = Begin ();
+  scheduler->SchedUlCqiInfoReq (params);
+  EndOther (start);
+}
+
+inline uint32_t
+SchedulerLatencyProbe::GetBin (double seconds)
+{
+  double ns = seconds * 1e9;
+  if (ns <= 1)
+  {
+      return 0;
+  }
+  return std::min<uint32_t> (BINS - 1, BINS_PER_OCTAVE * std::log2 (ns));
+}
+
+inline double
+SchedulerLatencyProbe::GetBinUpperEdge (uint32_t bin)
+{
+  return std::pow (2.0, (bin + 1.0) / BINS_PER_OCTAVE) * 1e-9;
+}
+
+// 0, 1, 2-3, 4-7, ...
+inline uint32_t
+SchedulerLatencyProbe::GetUeBucket (uint32_t activeUes)
+{
+  uint32_t bucket = 0;
+  while (activeUes > 0 && bucket < UE_BUCKETS - 1)
+  {
+      activeUes >>= 1;
+      ++bucket;
+  }
+  return bucket;
+}
+
+// Quantiles are the upper edges of their bins, i.e. at most 19% high.
+inline void
+SchedulerLatencyProbe::PrintStats (std::string filename) const
+{
+  std::ofstream outFile;
+  outFile.open (filename.c_str (), std::ios_base::out | std::ios_base::trunc);
+  if (!outFile.is_open ())
+  {
+      NS_LOG_UNCOND ("Can't open file " << filename);
+      return;
+  }
+  outFile << "% schedulerType\tcellId\tbandwidth\tdirection\tminActiveUes\tcalls\tmean\tp50\tp90\tp99\tmax"
+          << "\toverBudget\totherCalls\totherMean" << std::endl;
+  for (uint32_t c = 0; c < m_cells.size (); ++c)
+  {
+      const Cell &cell = *m_cells[c];
+      for (std::map<uint32_t, Histogram>::const_iterator it = cell.histograms.begin (); it != cell.histograms.end (); ++it)
+      {
+          const Histogram &histogram = it->second;
+          uint32_t bucket = it->first % UE_BUCKETS;
+          double quantiles[] = { 0.5, 0.9, 0.99 };
+          double values[3];
+          uint32_t q = 0;
+          uint64_t seen = 0;
+          for (uint32_t bin = 0; bin < BINS && q < 3; ++bin)
+          {
+              seen += histogram.counts[bin];
+              while (q < 3 && seen >= std::ceil (quantiles[q] * histogram.calls))
+              {
+                  values[q++] = std::min (GetBinUpperEdge (bin), histogram.max);
+              }
+          }
+          outFile << cell.schedulerType << "\t" << cell.cellId << "\t" << cell.bandwidth
+                  << "\t" << (it->first / UE_BUCKETS == DL ? "DL" : "UL")
+                  << "\t" << (bucket == 0 ? 0 : 1u << (bucket - 1))
+                  << "\t" << histogram.calls << "\t" << histogram.sum / histogram.calls
+                  << "\t" << values[0] << "\t" << values[1] << "\t" << values[2] << "\t" << histogram.max
+                  << "\t" << histogram.overBudget << "\t" << cell.otherCalls
+                  << "\t" << (cell.otherCalls > 0 ? cell.otherSum / cell.otherCalls : 0.0) << "\n";
+      }
+  }
+  outFile.close ();
+}
+
+} // namespace ns3
+
+#endif // SCHEDULER_LATENCY_PROBE_H
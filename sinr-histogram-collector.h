@@ -0,0 +1,498 @@
+#ifndef SINR_HISTOGRAM_COLLECTOR_H
+#define SINR_HISTOGRAM_COLLECTOR_H
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/lte-module.h"
+
+#include "async-trace-writer.h"
+#include "lte-trace-registry.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace ns3 {
+
+static GlobalValue g_sinrHistograms ("sinrHistograms",
+                                     "Collect SINR and CQI histograms per cell and traffic profile",
+                                     BooleanValue (false),
+                                     MakeBooleanChecker ());
+static GlobalValue g_sinrTDigest ("sinrTDigest",
+                                  "Compression of the t-digest SINR quantile estimates, 0 to disable them",
+                                  UintegerValue (0),
+                                  MakeUintegerChecker<uint32_t> ());
+
+// Merging t-digest (Dunning): quantiles of a stream in O(compression) memory,
+// most accurate in the tails.
+class TDigest
+{
+public:
+  TDigest (double compression);
+
+  void Add (double x);
+  double Quantile (double q);
+
+private:
+  void Merge ();
+
+  double m_compression;
+  // (mean, weight), sorted by mean
+  std::vector<std::pair<double, double> > m_centroids;
+  std::vector<std::pair<double, double> > m_buffer;
+  double m_min;
+  double m_max;
+};
+
+inline
+TDigest::TDigest (double compression)
+  : m_compression (compression),
+    m_min (0),
+    m_max (0)
+{
+}
+
+inline void
+TDigest::Add (double x)
+{
+  if (m_centroids.empty () && m_buffer.empty ())
+  {
+      m_min = x;
+      m_max = x;
+  }
+  m_min = std::min (m_min, x);
+  m_max = std::max (m_max, x);
+  m_buffer.push_back (std::make_pair (x, 1.0));
+  if (m_buffer.size () >= 5 * m_compression)
+  {
+      Merge ();
+  }
+}
+
+inline void
+TDigest::Merge ()
+{
+  if (m_buffer.empty ())
+  {
+      return;
+  }
+  m_buffer.insert (m_buffer.end (), m_centroids.begin (), m_centroids.end ());
+  std::sort (m_buffer.begin (), m_buffer.end ());
+  double total = 0;
+  for (uint32_t i = 0; i < m_buffer.size (); ++i)
+  {
+      total += m_buffer[i].second;
+  }
+  m_centroids.clear ();
+  std::pair<double, double> current = m_buffer[0];
+  double before = 0;
+  for (uint32_t i = 1; i < m_buffer.size (); ++i)
+  {
+      double weight = current.second + m_buffer[i].second;
+      double q0 = before / total;
+      double q2 = (before + weight) / total;
+      // centroid size bound 4 N q (1 - q) / compression
+      if (weight <= 4 * total * std::min (q0 * (1 - q0), q2 * (1 - q2)) / m_compression)
+      {
+          current.first += (m_buffer[i].first - current.first) * m_buffer[i].second / weight;
+          current.second = weight;
+      }
+      else
+      {
+          before += current.second;
+          m_centroids.push_back (current);
+          current = m_buffer[i];
+      }
+  }
+  m_centroids.push_back (current);
+  m_buffer.clear ();
+}
+
+inline double
+TDigest::Quantile (double q)
+{
+  Merge ();
+  if (m_centroids.empty ())
+  {
+      return 0;
+  }
+  double total = 0;
+  for (uint32_t i = 0; i < m_centroids.size (); ++i)
+  {
+      total += m_centroids[i].second;
+  }
+  // interpolate between the centres of the centroids around the rank
+  double rank = q * total;
+  double before = 0;
+  double previousCentre = 0;
+  double previousMean = m_min;
+  for (uint32_t i = 0; i < m_centroids.size (); ++i)
+  {
+      double centre = before + m_centroids[i].second / 2;
+      if (rank < centre)
+      {
+          return previousMean + (m_centroids[i].first - previousMean) * (rank - previousCentre) / (centre - previousCentre);
+      }
+      before += m_centroids[i].second;
+      previousCentre = centre;
+      previousMean = m_centroids[i].first;
+  }
+  if (total > previousCentre)
+  {
+      return previousMean + (m_max - previousMean) * (rank - previousCentre) / (total - previousCentre);
+  }
+  return m_max;
+}
+
+// Streams the DL SINR reported by every UE PHY, the UL SINR measured by every
+// eNB PHY and the DL wideband CQI implied by the DL SINR into fixed histograms
+// per (cellId, traffic profile), instead of logging every TTI of every UE.
+// SINR bins are 1 dB wide from -10 to 40 dB, with one underflow and one
+// overflow bin; CQI bins are the 16 CQI values.  At every epoch the count,
+// mean and 5/50/95 percentiles of the epoch are written; at the end of the run
+// the whole-run histograms, optionally with t-digest SINR quantiles.  UL
+// samples are labelled with the profile of the UE that last reported the same
+// RNTI in the cell.
+class SinrHistogramCollector
+{
+public:
+  enum Metric
+  {
+    DL_SINR,
+    UL_SINR,
+    DL_CQI,
+    METRICS
+  };
+  enum
+  {
+    SINR_BINS = 52,
+    NO_PROFILE = 0xffff
+  };
+
+  // tDigestCompression 0 keeps the histograms only
+  SinrHistogramCollector (uint32_t tDigestCompression);
+
+  void SetProfile (Ptr<NetDevice> ueDev, uint16_t profile);
+  // connects the PHYs of the registered devices
+  void Connect (const LteTraceRegistry &registry);
+  // writes the epoch summaries to filename, aligned with a RadioBearerStatsCalculator
+  void Start (Time startTime, Time epoch, std::string filename);
+  void PrintHistograms (std::string filename);
+
+private:
+  struct Histogram
+  {
+    uint64_t count;
+    double sum;
+    uint32_t bins[SINR_BINS];
+  };
+  struct Group
+  {
+    uint32_t key;
+    Histogram epoch[METRICS];
+    Histogram total[METRICS];
+    std::vector<TDigest> digests;
+  };
+  struct Ue
+  {
+    uint16_t profile;
+    uint32_t rntiKey;
+  };
+
+  static void DlSinr (SinrHistogramCollector *collector, uint32_t ue,
+                      uint16_t cellId, uint16_t rnti, double rsrp, double sinr, uint8_t componentCarrierId);
+  static void UlSinr (SinrHistogramCollector *collector,
+                      uint16_t cellId, uint16_t rnti, double sinr, uint8_t componentCarrierId);
+
+  Group &GetGroup (uint16_t cellId, uint16_t profile);
+  void Add (Group &group, Metric metric, double value);
+  int GetCqi (double sinr) const;
+  static double Percentile (const Histogram &histogram, Metric metric, double q);
+  void EndEpoch ();
+  static void Format (std::string &out, const AsyncTraceWriter::Record &record);
+
+  uint32_t m_tDigestCompression;
+  Ptr<LteAmc> m_amc;
+  std::map<Ptr<NetDevice>, uint16_t> m_profiles;
+  std::vector<Ue> m_ues;
+  std::unordered_map<uint32_t, uint16_t> m_rntiProfiles;
+  std::vector<Group> m_groups;
+  std::unordered_map<uint32_t, uint32_t> m_index;
+  Time m_epoch;
+  int32_t m_stream;
+};
+
+inline
+SinrHistogramCollector::SinrHistogramCollector (uint32_t tDigestCompression)
+  : m_tDigestCompression (tDigestCompression),
+    m_stream (-1)
+{
+  m_amc = CreateObject<LteAmc> ();
+}
+
+inline void
+SinrHistogramCollector::SetProfile (Ptr<NetDevice> ueDev, uint16_t profile)
+{
+  m_profiles[ueDev] = profile;
+}
+
+inline void
+SinrHistogramCollector::Connect (const LteTraceRegistry &registry)
+{
+  const std::vector<Ptr<LteUeNetDevice> > &ueDevs = registry.GetUeDevices ();
+  for (uint32_t i = 0; i < ueDevs.size (); ++i)
+  {
+      std::map<Ptr<NetDevice>, uint16_t>::const_iterator profile = m_profiles.find (ueDevs[i]);
+      Ue ue;
+      ue.profile = profile != m_profiles.end () ? profile->second : NO_PROFILE;
+      ue.rntiKey = 0;
+      m_ues.push_back (ue);
+      ueDevs[i]->GetPhy ()->TraceConnectWithoutContext ("ReportCurrentCellRsrpSinr",
+        MakeBoundCallback (&SinrHistogramCollector::DlSinr, this, (uint32_t) m_ues.size () - 1));
+  }
+  const std::vector<Ptr<LteEnbNetDevice> > &enbDevs = registry.GetEnbDevices ();
+  for (uint32_t i = 0; i < enbDevs.size (); ++i)
+  {
+      enbDevs[i]->GetPhy ()->TraceConnectWithoutContext ("ReportUeSinr",
+        MakeBoundCallback (&SinrHistogramCollector::UlSinr, this));
+  }
+}
+
+inline void
+SinrHistogramCollector::Start (Time startTime, Time epoch, std::string filename)
+{
+  m_epoch = epoch;
+  m_stream = AsyncTraceWriter::Get ().Open (filename, &SinrHistogramCollector::Format);
+  AsyncTraceWriter::Record header = AsyncTraceWriter::Record ();
+  header.stream = m_stream;
+  header.type = METRICS;
+  AsyncTraceWriter::Get ().Write (header);
+  Simulator::Schedule (startTime + epoch - Simulator::Now (), &SinrHistogramCollector::EndEpoch, this);
+}
+
+inline SinrHistogramCollector::Group &
+SinrHistogramCollector::GetGroup (uint16_t cellId, uint16_t profile)
+{
+  uint32_t key = ((uint32_t) cellId << 16) | profile;
+  std::unordered_map<uint32_t, uint32_t>::iterator it = m_index.find (key);
+  if (it == m_index.end ())
+  {
+      Group group;
+      group.key = key;
+      for (uint32_t m = 0; m < METRICS; ++m)
+      {
+          group.epoch[m].count = 0;
+          group.epoch[m].sum = 0;
+          std::fill (group.epoch[m].bins, group.epoch[m].bins + SINR_BINS, 0);
+          group.total[m] = group.epoch[m];
+      }
+      if (m_tDigestCompression > 0)
+      {
+          group.digests.assign (DL_CQI, TDigest (m_tDigestCompression));
+      }
+      it = m_index.insert (std::make_pair (key, m_groups.size ())).first;
+      m_groups.push_back (group);
+  }
+  return m_groups[it->second];
+}
+
+inline void
+SinrHistogramCollector::Add (Group &group, Metric metric, double value)
+{
+  uint32_t bin;
+  if (metric == DL_CQI)
+  {
+      bin = value;
+  }
+  else
+  {
+      bin = std::min<double> (std::max<double> (std::floor (value) + 11, 0), SINR_BINS - 1);
+      if (!group.digests.empty ())
+      {
+          group.digests[metric].Add (value);
+      }
+  }
+  Histogram *histograms[] = { &group.epoch[metric], &group.total[metric] };
+  for (uint32_t h = 0; h < 2; ++h)
+  {
+      ++histograms[h]->count;
+      histograms[h]->sum += value;
+      ++histograms[h]->bins[bin];
+  }
+}
+
+// CQI at the given linear SINR, with the spectral efficiency mapping of LteAmc (PiroEW2010)
+inline int
+SinrHistogramCollector::GetCqi (double sinr) const
+{
+  double ber = 0.00005;
+  double s = std::log (1 + sinr / (-std::log (5.0 * ber) / 1.5)) / std::log (2.0);
+  return m_amc->GetCqiFromSpectralEfficiency (s);
+}
+
+inline void
+SinrHistogramCollector::DlSinr (SinrHistogramCollector *collector, uint32_t ue,
+                                uint16_t cellId, uint16_t rnti, double rsrp, double sinr, uint8_t componentCarrierId)
+{
+  Ue &state = collector->m_ues[ue];
+  uint32_t rntiKey = ((uint32_t) cellId << 16) | rnti;
+  if (state.rntiKey != rntiKey)
+  {
+      state.rntiKey = rntiKey;
+      collector->m_rntiProfiles[rntiKey] = state.profile;
+  }
+  Group &group = collector->GetGroup (cellId, state.profile);
+  collector->Add (group, DL_SINR, 10 * std::log10 (sinr));
+  collector->Add (group, DL_CQI, collector->GetCqi (sinr));
+}
+
+inline void
+SinrHistogramCollector::UlSinr (SinrHistogramCollector *collector,
+                                uint16_t cellId, uint16_t rnti, double sinr, uint8_t componentCarrierId)
+{
+  std::unordered_map<uint32_t, uint16_t>::const_iterator profile
+    = collector->m_rntiProfiles.find (((uint32_t) cellId << 16) | rnti);
+  collector->Add (collector->GetGroup (cellId, profile != collector->m_rntiProfiles.end () ? profile->second : NO_PROFILE),
+                  UL_SINR, 10 * std::log10 (sinr));
+}
+
+// linear interpolation inside the bin holding the rank; SINR underflow and
+// overflow report the edge of the binned range
+inline double
+SinrHistogramCollector::Percentile (const Histogram &histogram, Metric metric, double q)
+{
+  if (histogram.count == 0)
+  {
+      return 0;
+  }
+  double rank = q * histogram.count;
+  double before = 0;
+  uint32_t bins = metric == DL_CQI ? 16 : SINR_BINS;
+  for (uint32_t k = 0; k < bins; ++k)
+  {
+      if (before + histogram.bins[k] >= rank && histogram.bins[k] > 0)
+      {
+          if (metric == DL_CQI)
+          {
+              return k;
+          }
+          if (k == 0 || k == SINR_BINS - 1)
+          {
+              return k == 0 ? -10.0 : 40.0;
+          }
+          return k - 11.0 + (rank - before) / histogram.bins[k];
+      }
+      before += histogram.bins[k];
+  }
+  return metric == DL_CQI ? 15.0 : 40.0;
+}
+
+inline void
+SinrHistogramCollector::EndEpoch ()
+{
+  for (uint32_t g = 0; g < m_groups.size (); ++g)
+  {
+      Group &group = m_groups[g];
+      for (uint32_t m = 0; m < METRICS; ++m)
+      {
+          Histogram &histogram = group.epoch[m];
+          if (histogram.count == 0)
+          {
+              continue;
+          }
+          AsyncTraceWriter::Record record = AsyncTraceWriter::Record ();
+          record.stream = m_stream;
+          record.type = m;
+          record.id = group.key;
+          record.values[0] = Simulator::Now ().GetSeconds ();
+          record.values[1] = histogram.count;
+          record.values[2] = histogram.sum / histogram.count;
+          record.values[3] = Percentile (histogram, (Metric) m, 0.05);
+          record.values[4] = Percentile (histogram, (Metric) m, 0.5);
+          record.values[5] = Percentile (histogram, (Metric) m, 0.95);
+          AsyncTraceWriter::Get ().Write (record);
+          histogram.count = 0;
+          histogram.sum = 0;
+          std::fill (histogram.bins, histogram.bins + SINR_BINS, 0);
+      }
+  }
+  Simulator::Schedule (m_epoch, &SinrHistogramCollector::EndEpoch, this);
+}
+
+inline void
+SinrHistogramCollector::Format (std::string &out, const AsyncTraceWriter::Record &record)
+{
+  static const char *names[] = { "dlSinrDb", "ulSinrDb", "dlCqi" };
+  if (record.type == METRICS)
+  {
+      out += "% time\tcellId\tprofile\tmetric\tsamples\tmean\tp5\tp50\tp95\n";
+      return;
+  }
+  uint16_t profile = record.id & 0xffff;
+  char line[256];
+  std::snprintf (line, sizeof (line), "%g\t%u\t%d\t%s\t%.0f\t%g\t%g\t%g\t%g\n",
+                 record.values[0], (unsigned) (record.id >> 16), profile == NO_PROFILE ? -1 : (int) profile,
+                 names[record.type], record.values[1], record.values[2],
+                 record.values[3], record.values[4], record.values[5]);
+  out += line;
+}
+
+inline void
+SinrHistogramCollector::PrintHistograms (std::string filename)
+{
+  static const char *names[] = { "dlSinrDb", "ulSinrDb", "dlCqi" };
+  std::ofstream outFile;
+  outFile.open (filename.c_str (), std::ios_base::out | std::ios_base::trunc);
+  if (!outFile.is_open ())
+  {
+      NS_LOG_UNCOND ("Can't open file " << filename);
+      return;
+  }
+  std::map<uint32_t, uint32_t> sorted (m_index.begin (), m_index.end ());
+  outFile << "% cellId\tprofile\tmetric\tsamples\tmean\tp5\tp50\tp95\ttdigestP5\ttdigestP50\ttdigestP95\tbins"
+          << " (SINR: <-10, [-10,-9) ... [39,40), >=40 dB; CQI: 0 ... 15)" << std::endl;
+  for (std::map<uint32_t, uint32_t>::const_iterator it = sorted.begin (); it != sorted.end (); ++it)
+  {
+      Group &group = m_groups[it->second];
+      uint16_t profile = group.key & 0xffff;
+      for (uint32_t m = 0; m < METRICS; ++m)
+      {
+          const Histogram &histogram = group.total[m];
+          if (histogram.count == 0)
+          {
+              continue;
+          }
+          outFile << (group.key >> 16) << "\t" << (profile == NO_PROFILE ? -1 : (int) profile) << "\t" << names[m]
+                  << "\t" << histogram.count << "\t" << histogram.sum / histogram.count
+                  << "\t" << Percentile (histogram, (Metric) m, 0.05)
+                  << "\t" << Percentile (histogram, (Metric) m, 0.5)
+                  << "\t" << Percentile (histogram, (Metric) m, 0.95);
+          if (m != DL_CQI && !group.digests.empty ())
+          {
+              outFile << "\t" << group.digests[m].Quantile (0.05) << "\t" << group.digests[m].Quantile (0.5)
+                      << "\t" << group.digests[m].Quantile (0.95);
+          }
+          else
+          {
+              outFile << "\t-\t-\t-";
+          }
+          uint32_t bins = m == DL_CQI ? 16 : SINR_BINS;
+          for (uint32_t k = 0; k < bins; ++k)
+          {
+              outFile << "\t" << histogram.bins[k];
+          }
+          outFile << "\n";
+      }
+  }
+  outFile.close ();
+}
+
+} // namespace ns3
+
+#endif // SINR_HISTOGRAM_COLLECTOR_H
@@ -0,0 +1,231 @@
+#!/usr/bin/env python3
+"""Regression benchmarks for building_sim and building-sim-lena.
+
+Runs small/medium/large fixed-seed presets of both programs through waf,
+records wall time, peak RSS, events/s and headline KPIs, and compares them
+with the stored baselines.  Exits with status 1 when a metric regresses
+beyond its tolerance.
+
+Both programs must be in the scratch/ directory of the ns-3 tree:
+
+    utils/benchmark.py --ns3-dir ~/ns-3.30
+    utils/benchmark.py --ns3-dir ~/ns-3.30 --update-baselines
+"""
+
+import argparse
+import json
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+SCENARIOS = {
+    "building_sim-small": ("building_sim", ["10", "6", "rr"], {}),
+    "building_sim-medium": ("building_sim", ["100", "6", "rr"], {}),
+    "building_sim-large": ("building_sim", ["1000", "6", "rr"], {}),
+    "lena-small": ("building-sim-lena", ["10", "rr"], {"nBlocks": "1"}),
+    "lena-medium": ("building-sim-lena", ["10", "rr"], {"nBlocks": "5"}),
+    "lena-large": ("building-sim-lena", ["10", "rr"], {"nBlocks": "20"}),
+}
+
+PRESETS = {
+    "small": ["building_sim-small", "lena-small"],
+    "medium": ["building_sim-medium", "lena-medium"],
+    "large": ["building_sim-large", "lena-large"],
+}
+
+# metric -> (direction, default relative tolerance); "lower" means lower is better
+METRICS = {
+    "wall_s": ("lower", 0.15),
+    "peak_rss_kb": ("lower", 0.10),
+    "events_per_s": ("higher", 0.15),
+    "dl_rx_bytes": ("exact", 0.01),
+    "ul_rx_bytes": ("exact", 0.01),
+    "dl_delay_s": ("exact", 0.01),
+    "ul_delay_s": ("exact", 0.01),
+    "remote_rx_bytes": ("exact", 0.01),
+    "remote_delay_s": ("exact", 0.01),
+}
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+DEFAULT_BASELINES = os.path.join(HERE, "benchmark-baselines.json")
+
+
+def global_values(settings):
+    return ";".join("%s=%s" % (k, v) for k, v in sorted(settings.items()))
+
+
+def run_program(ns3_dir, program, args, settings, workdir, build=True):
+    """Run one program through waf inside workdir and return its progress summary."""
+    settings = dict(settings)
+    settings.setdefault("RngSeed", "1")
+    settings.setdefault("RngRun", "1")
+    settings["progressInterval"] = "3600"
+    settings["progressFile"] = os.path.join(workdir, "progress.json")
+    env = dict(os.environ)
+    env["NS_GLOBAL_VALUE"] = global_values(settings)
+    run = "--run" if build else "--run-no-build"
+    cmd = [os.path.join(ns3_dir, "waf"), run, " ".join([program] + args), "--cwd", workdir]
+    start = time.time()
+    with open(os.path.join(workdir, "stdout.txt"), "w") as out:
+        status = subprocess.call(cmd, cwd=ns3_dir, env=env, stdout=out, stderr=subprocess.STDOUT)
+    elapsed = time.time() - start
+    if status != 0:
+        raise RuntimeError("%s %s failed with status %d (see %s)" % (program, " ".join(args), status, workdir))
+    done = None
+    with open(settings["progressFile"]) as f:
+        for line in f:
+            record = json.loads(line)
+            if record.get("type") == "done":
+                done = record
+    if done is None:
+        raise RuntimeError("%s did not write a final progress record" % program)
+    done["process_wall_s"] = elapsed
+    return done
+
+
+def read_pdcp_stats(filename):
+    """Sum received bytes and the PDU-weighted mean delay over a PDCP stats file."""
+    rx_bytes = 0
+    rx_pdus = 0
+    delay = 0.0
+    if not os.path.exists(filename):
+        return 0, 0.0
+    with open(filename) as f:
+        for line in f:
+            if line.startswith("%"):
+                continue
+            cols = line.split()
+            if len(cols) < 11:
+                continue
+            # start end CellId IMSI RNTI LCID nTxPDUs TxBytes nRxPDUs RxBytes delay ...
+            n = int(cols[8])
+            rx_pdus += n
+            rx_bytes += int(cols[9])
+            delay += float(cols[10]) * n
+    return rx_bytes, (delay / rx_pdus if rx_pdus else 0.0)
+
+
+def read_remote_stats(filename):
+    """Sum received bytes and the packet-weighted mean delay over the remote host sinks."""
+    rx_bytes = 0
+    packets = 0
+    delay = 0.0
+    if not os.path.exists(filename):
+        return 0, 0.0
+    with open(filename) as f:
+        for line in f:
+            if line.startswith("%"):
+                continue
+            cols = line.split()
+            if len(cols) < 9:
+                continue
+            # port imsi profile source packets bytes first last meanDelay histogram...
+            n = int(cols[4])
+            packets += n
+            rx_bytes += int(cols[5])
+            delay += float(cols[8]) * n
+    return rx_bytes, (delay / packets if packets else 0.0)
+
+
+def measure(ns3_dir, name, keep):
+    program, args, settings = SCENARIOS[name]
+    workdir = tempfile.mkdtemp(prefix="bench-%s-" % name)
+    try:
+        done = run_program(ns3_dir, program, args, settings, workdir)
+        dl_bytes, dl_delay = read_pdcp_stats(os.path.join(workdir, "DlPdcpStats.txt"))
+        ul_bytes, ul_delay = read_pdcp_stats(os.path.join(workdir, "UlPdcpStats.txt"))
+        remote_bytes, remote_delay = read_remote_stats(os.path.join(workdir, "RemoteHostFlowStats.txt"))
+    finally:
+        if not keep:
+            shutil.rmtree(workdir, ignore_errors=True)
+    return {
+        "wall_s": done["setup_wall_s"] + done["wall_s"],
+        "peak_rss_kb": done["peak_rss_kb"],
+        "events_per_s": done["events_per_s"],
+        "dl_rx_bytes": dl_bytes,
+        "ul_rx_bytes": ul_bytes,
+        "dl_delay_s": dl_delay,
+        "ul_delay_s": ul_delay,
+        "remote_rx_bytes": remote_bytes,
+        "remote_delay_s": remote_delay,
+    }
+
+
+def compare(name, result, baseline, tolerances):
+    """Return the list of regression messages for one scenario."""
+    failures = []
+    for metric, (direction, default_tol) in sorted(METRICS.items()):
+        if metric not in baseline:
+            continue
+        tol = tolerances.get(metric, default_tol)
+        ref = baseline[metric]
+        value = result[metric]
+        if ref == 0:
+            change = 0.0 if value == 0 else float("inf")
+        else:
+            change = (value - ref) / abs(ref)
+        if direction == "lower":
+            bad = change > tol
+        elif direction == "higher":
+            bad = change < -tol
+        else:
+            bad = abs(change) > tol
+        flag = "REGRESSION" if bad else "ok"
+        print("  %-14s %14.6g  baseline %14.6g  %+7.1f%%  %s" % (metric, value, ref, 100 * change, flag))
+        if bad:
+            failures.append("%s: %s %+.1f%% (tolerance %.1f%%)" % (name, metric, 100 * change, 100 * tol))
+    return failures
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--ns3-dir", default=".", help="ns-3 source tree containing waf and the scratch programs")
+    parser.add_argument("--preset", action="append", choices=sorted(PRESETS),
+                        help="preset(s) to run (default: small and medium)")
+    parser.add_argument("--baselines", default=DEFAULT_BASELINES)
+    parser.add_argument("--update-baselines", action="store_true",
+                        help="store the measured values as the new baselines instead of comparing")
+    parser.add_argument("--keep", action="store_true", help="keep the per-run working directories")
+    args = parser.parse_args()
+
+    ns3_dir = os.path.abspath(args.ns3_dir)
+    presets = args.preset or ["small", "medium"]
+    with open(args.baselines) as f:
+        stored = json.load(f)
+    tolerances = stored.get("tolerances", {})
+    baselines = stored.setdefault("scenarios", {})
+
+    subprocess.check_call([os.path.join(ns3_dir, "waf"), "build"], cwd=ns3_dir)
+
+    failures = []
+    for preset in presets:
+        for name in PRESETS[preset]:
+            print("%s:" % name)
+            result = measure(ns3_dir, name, args.keep)
+            if args.update_baselines:
+                baselines[name] = result
+                for metric in sorted(result):
+                    print("  %-14s %14.6g" % (metric, result[metric]))
+            elif name not in baselines:
+                print("  no baseline stored, run with --update-baselines")
+            else:
+                failures += compare(name, result, baselines[name], tolerances)
+
+    if args.update_baselines:
+        with open(args.baselines, "w") as f:
+            json.dump(stored, f, indent=2, sort_keys=True)
+            f.write("\n")
+        return 0
+    if failures:
+        print("\n%d regression(s):" % len(failures))
+        for failure in failures:
+            print("  " + failure)
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,120 @@
+#!/usr/bin/env python3
+"""Decoder for the binary event logs written by event-log.h.
+
+Writes one table per event type, with the generic fields named after the
+type, either as CSV files or as columns: one little-endian binary file per
+column plus a schema.json (numpy.fromfile-compatible), or Parquet files when
+pyarrow is installed.
+
+    utils/decode-event-log.py EventLog.bin --format csv --out events/
+    utils/decode-event-log.py EventLog.bin --format columns --out events/
+    utils/decode-event-log.py EventLog.bin --format parquet --out events/
+"""
+
+import argparse
+import json
+import os
+import struct
+import sys
+
+HEADER = struct.Struct("<4sIII")
+RECORD = struct.Struct("<dIHHQ4I")
+
+# type -> (name, names of the used fields), as in EventLog::Type
+TYPES = {
+    0: ("attach", []),
+    1: ("handover_start", ["target_cell_id"]),
+    2: ("handover_end_ok", []),
+    3: ("bearer_setup", ["lcid", "eps_bearer_id"]),
+    4: ("rlc_tx_drop", ["lcid", "size", "uplink"]),
+    5: ("dl_scheduling", ["mcs_tb1", "size_tb1", "mcs_tb2", "size_tb2"]),
+    6: ("ul_scheduling", ["mcs", "size"]),
+}
+
+COMMON = [("time", "d"), ("cell_id", "H"), ("rnti", "H"), ("imsi", "Q")]
+
+
+def read_events(path):
+    """Returns {type: list of record tuples} and the compiled-in category mask."""
+    tables = {}
+    with open(path, "rb") as f:
+        magic, version, record_size, categories = HEADER.unpack(f.read(HEADER.size))
+        if magic != b"LTEV" or version != 1 or record_size != RECORD.size:
+            sys.exit("%s: not a version 1 event log" % path)
+        while True:
+            chunk = f.read(RECORD.size * 65536)
+            if not chunk:
+                break
+            usable = len(chunk) - len(chunk) % RECORD.size
+            for record in RECORD.iter_unpack(chunk[:usable]):
+                tables.setdefault(record[1], []).append(record)
+    return tables, categories
+
+
+def columns(event_type, records):
+    name, fields = TYPES.get(event_type, ("type_%d" % event_type, ["f0", "f1", "f2", "f3"]))
+    cols = {
+        "time": [r[0] for r in records],
+        "cell_id": [r[2] for r in records],
+        "rnti": [r[3] for r in records],
+        "imsi": [r[4] for r in records],
+    }
+    for i, field in enumerate(fields):
+        cols[field] = [r[5 + i] for r in records]
+    order = [c for c, _ in COMMON] + fields
+    return name, order, cols
+
+
+def write_csv(out_dir, name, order, cols):
+    with open(os.path.join(out_dir, name + ".csv"), "w") as f:
+        f.write(",".join(order) + "\n")
+        for row in zip(*(cols[c] for c in order)):
+            f.write(",".join("%.9g" % v if isinstance(v, float) else str(v) for v in row) + "\n")
+
+
+def write_columns(out_dir, name, order, cols):
+    table_dir = os.path.join(out_dir, name)
+    os.makedirs(table_dir, exist_ok=True)
+    formats = dict(COMMON)
+    schema = []
+    for c in order:
+        fmt = formats.get(c, "I")
+        with open(os.path.join(table_dir, c + ".bin"), "wb") as f:
+            f.write(struct.pack("<%d%s" % (len(cols[c]), fmt), *cols[c]))
+        schema.append({"name": c, "dtype": {"d": "<f8", "H": "<u2", "Q": "<u8", "I": "<u4"}[fmt]})
+    with open(os.path.join(table_dir, "schema.json"), "w") as f:
+        json.dump({"rows": len(cols["time"]), "columns": schema}, f, indent=2)
+
+
+def write_parquet(out_dir, name, order, cols):
+    import pyarrow
+    import pyarrow.parquet
+    pyarrow.parquet.write_table(pyarrow.table({c: cols[c] for c in order}),
+                                os.path.join(out_dir, name + ".parquet"))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("log")
+    parser.add_argument("--format", choices=["csv", "columns", "parquet"], default="csv")
+    parser.add_argument("--out", default=".")
+    args = parser.parse_args()
+
+    if args.format == "parquet":
+        try:
+            import pyarrow.parquet  # noqa: F401
+        except ImportError:
+            sys.exit("--format parquet needs pyarrow; use --format columns instead")
+    writer = {"csv": write_csv, "columns": write_columns, "parquet": write_parquet}[args.format]
+
+    tables, categories = read_events(args.log)
+    os.makedirs(args.out, exist_ok=True)
+    for event_type in sorted(tables):
+        name, order, cols = columns(event_type, tables[event_type])
+        writer(args.out, name, order, cols)
+        print("%s: %d events" % (name, len(tables[event_type])))
+    print("categories compiled in: 0x%x" % categories)
+
+
+if __name__ == "__main__":
+    main()
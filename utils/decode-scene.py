@@ -0,0 +1,99 @@
+#!/usr/bin/env python3
+"""Decoder for the scene files written by scene-exporter.h.
+
+With --format gnuplot, writes the gnuplot object and label lists used to plot
+a REM (buildings.txt, enbs.txt, ues.txt), with every UE at its last sampled
+position at or before --time.  With --format csv, writes one table per kind:
+buildings.csv, enbs.csv and ues.csv, the latter with every UE sample, for
+replaying mobility and attachment.
+
+    utils/decode-scene.py scene.bin --format gnuplot
+    utils/decode-scene.py scene.bin --format gnuplot --time 10 --font Helvetica,8
+    utils/decode-scene.py scene.bin --format csv --out scene/
+"""
+
+import argparse
+import os
+import struct
+import sys
+
+HEADER = struct.Struct("<4sIII")
+RECORD = struct.Struct("<dHHQ5f")
+
+# kind -> (table, name of the id, names of the values), as in SceneExporter::Kind
+KINDS = {
+    0: ("buildings", "building_id", ["x_min", "y_min", "x_max", "y_max", "z_max"]),
+    1: ("enbs", "dl_earfcn", ["x", "y", "z", "tx_power_dbm", "dl_bandwidth"]),
+    2: ("ues", "imsi", ["x", "y", "z", "vx", "vy"]),
+}
+BUILDING, ENB, UE = 0, 1, 2
+
+
+def read_scene(path):
+    """Returns {kind: list of record tuples} in file order."""
+    tables = {kind: [] for kind in KINDS}
+    with open(path, "rb") as f:
+        magic, version, record_size, _ = HEADER.unpack(f.read(HEADER.size))
+        if magic != b"LTSC" or version != 1 or record_size != RECORD.size:
+            sys.exit("%s: not a version 1 scene file" % path)
+        while True:
+            chunk = f.read(RECORD.size * 65536)
+            if not chunk:
+                break
+            usable = len(chunk) - len(chunk) % RECORD.size
+            for record in RECORD.iter_unpack(chunk[:usable]):
+                tables.setdefault(record[1], []).append(record)
+    return tables
+
+
+def write_csv(out_dir, tables):
+    for kind, records in sorted(tables.items()):
+        name, id_name, values = KINDS.get(kind, ("kind_%d" % kind, "id", ["v0", "v1", "v2", "v3", "v4"]))
+        with open(os.path.join(out_dir, name + ".csv"), "w") as f:
+            f.write(",".join(["time", "cell_id", id_name] + values) + "\n")
+            for r in records:
+                f.write("%.9g,%d,%d," % (r[0], r[2], r[3]) + ",".join("%.7g" % v for v in r[4:]) + "\n")
+        print("%s: %d records" % (name, len(records)))
+
+
+def write_gnuplot(out_dir, tables, time, font):
+    with open(os.path.join(out_dir, "buildings.txt"), "w") as f:
+        # gnuplot object indices start at 1
+        for n, r in enumerate(tables[BUILDING], 1):
+            f.write("set object %d rect from %g,%g to %g,%g front fs empty \n" % (n, r[4], r[5], r[6], r[7]))
+    with open(os.path.join(out_dir, "enbs.txt"), "w") as f:
+        for r in tables[ENB]:
+            f.write("set label \"%d\" at %g,%g left font \"%s\" textcolor rgb \"white\" front  point pt 2 ps 0.3 "
+                    "lc rgb \"white\" offset 0,0\n" % (r[2], r[4], r[5], font))
+    ues = {}
+    for r in tables[UE]:
+        if r[0] <= time or r[3] not in ues:
+            ues[r[3]] = r
+    with open(os.path.join(out_dir, "ues.txt"), "w") as f:
+        for imsi in sorted(ues):
+            r = ues[imsi]
+            f.write("set label \"%d\" at %g,%g left font \"%s\" textcolor rgb \"grey\" front point pt 1 ps 0.3 "
+                    "lc rgb \"grey\" offset 0,0\n" % (imsi, r[4], r[5], font))
+    print("%d buildings, %d eNBs, %d UEs at t=%g s"
+          % (len(tables[BUILDING]), len(tables[ENB]), len(ues), time))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("scene")
+    parser.add_argument("--format", choices=["gnuplot", "csv"], default="gnuplot")
+    parser.add_argument("--time", type=float, default=0.0, help="UE positions at this time [s] (gnuplot)")
+    parser.add_argument("--font", default="Helvetica,4", help="label font (gnuplot)")
+    parser.add_argument("--out", default=".")
+    args = parser.parse_args()
+
+    tables = read_scene(args.scene)
+    os.makedirs(args.out, exist_ok=True)
+    if args.format == "csv":
+        write_csv(args.out, tables)
+    else:
+        write_gnuplot(args.out, tables, args.time, args.font)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,179 @@
+#!/usr/bin/env python3
+"""Checks that the outputs of building_sim and building-sim-lena do not depend on the worker count.
+
+Each reference configuration is first run alone with asyncTraceWriter=false,
+the sequential reference.  Then, for every worker count w in --workers
+(1, 2, 4 and the number of CPUs by default), w copies of it run at the same
+time with asyncTraceWriter=true, so that parallel sweeps sharing the machine
+(and its fading bank, result cache and relay pipes) are exercised as well as
+the writer thread.  With --threads-global NAME, the GlobalValue NAME is set
+to w in those runs, for components that take a worker count.
+
+Every artifact is split into records and brought into canonical order: text
+files keep their "%" header lines and sort the others, the binary event logs
+and scene files sort their fixed-size records.  The per-file hashes of every
+run are compared with the reference and the first divergent record of each
+differing file is printed.  Files that depend on wall time are skipped.
+
+    utils/determinism-check.py --ns3-dir ~/ns-3.30
+    utils/determinism-check.py --ns3-dir ~/ns-3.30 --config lena-small --workers 1 8
+    utils/determinism-check.py --ns3-dir ~/ns-3.30 --strict-order --keep
+"""
+
+import argparse
+import concurrent.futures
+import hashlib
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+from benchmark import run_program  # noqa: E402
+
+CONFIGS = {
+    "building_sim-small": ("building_sim", ["10", "6", "rr"], {"simTime": "2"}),
+    "building_sim-rem": ("building_sim", ["10", "6", "rr", "rem"], {}),
+    "lena-small": ("building-sim-lena", ["10", "rr"], {"nBlocks": "1"}),
+    "lena-rem": ("building-sim-lena", ["10", "rr", "rem"], {"nBlocks": "1"}),
+}
+
+# written with wall times or by the harness itself
+SKIPPED = {"stdout.txt", "progress.json", "TraceConnectStats.txt", "SchedulerLatency.txt",
+           "PacketPoolStats.txt"}
+
+# magic -> (header size, record size) of the binary record files
+BINARY_RECORDS = {b"LTEV": (16, 40), b"LTSC": (16, 40)}
+
+
+def canonical_records(path, strict_order):
+    """Returns the records of an artifact, in canonical order unless strict_order."""
+    with open(path, "rb") as f:
+        data = f.read()
+    layout = BINARY_RECORDS.get(data[:4])
+    if layout:
+        header_size, record_size = layout
+        header = [data[:header_size]]
+        records = [data[i:i + record_size] for i in range(header_size, len(data), record_size)]
+    else:
+        lines = data.split(b"\n")
+        header = [line for line in lines if line.startswith(b"%")]
+        records = [line for line in lines if line and not line.startswith(b"%")]
+    return header + (records if strict_order else sorted(records))
+
+
+def digest(records):
+    h = hashlib.sha256()
+    for record in records:
+        h.update(len(record).to_bytes(4, "little"))
+        h.update(record)
+    return h.hexdigest()
+
+
+def collect(workdir, strict_order):
+    """Returns {file: records} of every artifact in workdir."""
+    artifacts = {}
+    for name in sorted(os.listdir(workdir)):
+        path = os.path.join(workdir, name)
+        if name not in SKIPPED and os.path.isfile(path):
+            artifacts[name] = canonical_records(path, strict_order)
+    return artifacts
+
+
+def show(record):
+    if all(32 <= b < 127 or b == 9 for b in record):
+        text = record.decode()
+    else:
+        text = record.hex()
+    return text if len(text) <= 160 else text[:157] + "..."
+
+
+def compare(reference, artifacts):
+    """Returns the list of divergences of artifacts from the reference."""
+    problems = []
+    for name in sorted(set(reference) | set(artifacts)):
+        if name not in artifacts:
+            problems.append("%s: missing" % name)
+        elif name not in reference:
+            problems.append("%s: not written by the reference" % name)
+        elif digest(reference[name]) != digest(artifacts[name]):
+            ref, other = reference[name], artifacts[name]
+            index = next((i for i, (a, b) in enumerate(zip(ref, other)) if a != b), min(len(ref), len(other)))
+            problems.append("%s: first divergent record %d of %d/%d\n      reference: %s\n      this run:  %s"
+                            % (name, index, len(ref), len(other),
+                               show(ref[index]) if index < len(ref) else "<end>",
+                               show(other[index]) if index < len(other) else "<end>"))
+    return problems
+
+
+def run_copies(ns3_dir, program, prog_args, settings, copies, prefix):
+    """Runs copies of one configuration at the same time; returns their workdirs."""
+    workdirs = [tempfile.mkdtemp(prefix="%s-%d-" % (prefix, i)) for i in range(copies)]
+    with concurrent.futures.ThreadPoolExecutor(max_workers=copies) as pool:
+        # built once up front, concurrent waf builds would race
+        futures = [pool.submit(run_program, ns3_dir, program, prog_args, settings, w, build=False)
+                   for w in workdirs]
+        for future in futures:
+            future.result()
+    return workdirs
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--ns3-dir", default=".", help="ns-3 source tree containing waf and the scratch programs")
+    parser.add_argument("--config", action="append", choices=sorted(CONFIGS),
+                        help="reference configuration(s) to check (default: all)")
+    parser.add_argument("--workers", type=int, nargs="+", default=[1, 2, 4, os.cpu_count() or 1])
+    parser.add_argument("--threads-global", metavar="NAME",
+                        help="GlobalValue set to the worker count in the parallel runs")
+    parser.add_argument("--set", action="append", default=[], metavar="NAME=VALUE",
+                        help="extra GlobalValue for every run")
+    parser.add_argument("--strict-order", action="store_true",
+                        help="compare records in file order instead of canonical order")
+    parser.add_argument("--keep", action="store_true", help="keep the per-run working directories")
+    args = parser.parse_args()
+
+    ns3_dir = os.path.abspath(args.ns3_dir)
+    subprocess.check_call([os.path.join(ns3_dir, "waf"), "build"], cwd=ns3_dir)
+
+    failures = 0
+    for name in args.config or sorted(CONFIGS):
+        program, prog_args, settings = CONFIGS[name]
+        settings = dict(settings)
+        settings.update(dict(s.split("=", 1) for s in args.set))
+        settings["asyncTraceWriter"] = "false"
+        workdirs = run_copies(ns3_dir, program, prog_args, settings, 1, "determinism-%s-ref" % name)
+        reference = collect(workdirs[0], args.strict_order)
+        print("%s: reference %s" % (name, ", ".join("%s %s" % (f, digest(r)[:12]) for f, r in sorted(reference.items()))))
+        for workers in sorted(set(args.workers)):
+            parallel = dict(settings)
+            parallel["asyncTraceWriter"] = "true"
+            if args.threads_global:
+                parallel[args.threads_global] = str(workers)
+            copies = run_copies(ns3_dir, program, prog_args, parallel, workers,
+                                "determinism-%s-w%d" % (name, workers))
+            workdirs += copies
+            diverged = 0
+            for i, workdir in enumerate(copies):
+                problems = compare(reference, collect(workdir, args.strict_order))
+                if problems:
+                    diverged += 1
+                    print("  workers=%d copy %d: DIVERGES (%s)" % (workers, i, workdir))
+                    for problem in problems:
+                        print("    " + problem)
+            if not diverged:
+                print("  workers=%d: %d identical" % (workers, len(copies)))
+            failures += diverged
+        if not args.keep:
+            for workdir in workdirs:
+                shutil.rmtree(workdir, ignore_errors=True)
+
+    if failures:
+        print("\n%d run(s) diverged from their reference" % failures)
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
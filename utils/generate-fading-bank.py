@@ -0,0 +1,94 @@
+#!/usr/bin/env python3
+"""Generates the fading trace bank read by fading-trace-bank.h.
+
+For each RB count, a frequency-selective Rayleigh channel with a 3GPP
+EPA/EVA/ETU power delay profile is sampled every --sample-period seconds.
+Each tap is a sum of sinusoids with the Doppler spread of --speed at
+--frequency.  The power gain on the centre frequency of every 180 kHz RB is
+stored as float32, normalised to unit mean.  Needs numpy.
+
+    utils/generate-fading-bank.py fading-bank.bin --profile EPA --speed 3
+    utils/generate-fading-bank.py fading-bank.bin --rbs 6 15 25 --length 20
+
+The file is the same for every run and is mapped read-only by them, so
+generate it once per machine and pass it as fadingBank=<file>.
+"""
+
+import argparse
+import struct
+import sys
+
+try:
+    import numpy as np
+except ImportError:
+    sys.exit("generate-fading-bank.py needs numpy")
+
+# 3GPP TS 36.104 annex B.2: (delay [ns], relative power [dB])
+PROFILES = {
+    "EPA": [(0, 0.0), (30, -1.0), (70, -2.0), (90, -3.0), (110, -8.0), (190, -17.2), (410, -20.8)],
+    "EVA": [(0, 0.0), (30, -1.5), (150, -1.4), (310, -3.6), (370, -0.6), (710, -9.1),
+            (1090, -7.0), (1730, -12.0), (2510, -16.9)],
+    "ETU": [(0, -1.0), (50, -1.0), (120, -1.0), (200, 0.0), (230, 0.0), (500, 0.0),
+            (1600, -3.0), (2300, -5.0), (5000, -7.0)],
+}
+RB_BANDWIDTH = 180e3
+SINUSOIDS = 16
+
+
+def generate_block(rng, rb_count, samples, sample_period, profile, doppler):
+    delays = np.array([d for d, _ in PROFILES[profile]]) * 1e-9
+    powers = 10 ** (np.array([p for _, p in PROFILES[profile]]) / 10)
+    powers /= powers.sum()
+    t = np.arange(samples) * sample_period
+    # tap gains, one sum of sinusoids per tap: shape (taps, samples)
+    taps = np.zeros((len(delays), samples), dtype=complex)
+    for tap in range(len(delays)):
+        angles = rng.uniform(0, 2 * np.pi, SINUSOIDS)
+        phases = rng.uniform(0, 2 * np.pi, SINUSOIDS)
+        doppler_shifts = doppler * np.cos(angles)
+        taps[tap] = np.exp(1j * (2 * np.pi * np.outer(t, doppler_shifts) + phases)).sum(axis=1)
+        taps[tap] *= np.sqrt(powers[tap] / SINUSOIDS)
+    # response at the RB centres, relative to the carrier: shape (samples, rbs)
+    f = (np.arange(rb_count) - (rb_count - 1) / 2.0) * RB_BANDWIDTH
+    steering = np.exp(-2j * np.pi * np.outer(delays, f))
+    gain = np.abs(taps.T @ steering) ** 2
+    gain /= gain.mean()
+    return gain.astype("<f4")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("output")
+    parser.add_argument("--rbs", type=int, nargs="+", default=[6, 15, 25, 50, 75, 100],
+                        help="RB counts to generate (bandwidths of the programs)")
+    parser.add_argument("--profile", choices=sorted(PROFILES), default="EPA")
+    parser.add_argument("--speed", type=float, default=3.0, help="UE speed [km/h]")
+    parser.add_argument("--frequency", type=float, default=2.12e9, help="carrier frequency [Hz]")
+    parser.add_argument("--length", type=float, default=10.0, help="trace length [s]")
+    parser.add_argument("--sample-period", type=float, default=1e-3, help="[s]")
+    parser.add_argument("--seed", type=int, default=1)
+    args = parser.parse_args()
+
+    rng = np.random.default_rng(args.seed)
+    doppler = args.speed / 3.6 * args.frequency / 299792458.0
+    samples = int(round(args.length / args.sample_period))
+    header = struct.pack("<4sIIf", b"FADB", 1, len(args.rbs), args.sample_period)
+    offset = len(header) + 16 * len(args.rbs)
+    index = b""
+    blocks = []
+    for rb_count in args.rbs:
+        block = generate_block(rng, rb_count, samples, args.sample_period, args.profile, doppler)
+        index += struct.pack("<IIQ", rb_count, samples, offset)
+        blocks.append(block)
+        offset += block.nbytes
+    with open(args.output, "wb") as f:
+        f.write(header)
+        f.write(index)
+        for block in blocks:
+            f.write(block.tobytes())
+    print("%s: %s, %.1f Hz Doppler, %d samples x RBs %s, %.1f MB"
+          % (args.output, args.profile, doppler, samples, args.rbs, offset / 1e6))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,141 @@
+#!/usr/bin/env python3
+"""UE-count scaling study for building_sim and building-sim-lena.
+
+Runs one program at UE counts doubling from --min-ues up to --max-ues (the
+last point is --max-ues itself), with a short simulated time, and records per
+point the setup wall time, the wall time per simulated second and the peak
+RSS from the final progress record.  Each metric is then fitted with a power
+law a * n^b over all points, and the local exponents between neighbouring
+points show where growth stops being linear (b > --linear-limit).
+
+    utils/scaling-study.py --ns3-dir ~/ns-3.30 --program building_sim --max-ues 100000
+    utils/scaling-study.py --ns3-dir ~/ns-3.30 --program building-sim-lena --macro-fraction 0.8
+
+For building-sim-lena the UE count is split into home UEs (command line) and
+macro UEs (nMacroUes).  Results are written as JSON lines to --out.
+"""
+
+import argparse
+import json
+import math
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+from benchmark import run_program  # noqa: E402
+
+METRICS = ["setup_wall_s", "wall_per_sim_s", "peak_rss_kb"]
+
+
+def ue_counts(min_ues, max_ues):
+    counts = []
+    n = min_ues
+    while n < max_ues:
+        counts.append(n)
+        n *= 2
+    counts.append(max_ues)
+    return counts
+
+
+def scenario(program, n, args):
+    """Command line and GlobalValues of one point."""
+    settings = {"simTime": str(args.sim_time)}
+    settings.update(dict(s.split("=", 1) for s in args.set))
+    if program == "building_sim":
+        return [str(n), str(args.rb), args.scheduler], settings
+    macro = int(round(n * args.macro_fraction))
+    home = n - macro
+    if home == 0 or macro == 0:
+        # the lena program takes at least one UE of each kind
+        home, macro = max(home, 1), max(macro, 1)
+    settings["nMacroUes"] = str(macro)
+    return [str(home), args.scheduler], settings
+
+
+def fit_power_law(points):
+    """Least-squares fit of log y = log a + b log n; returns (a, b)."""
+    xs = [math.log(n) for n, y in points if y > 0]
+    ys = [math.log(y) for n, y in points if y > 0]
+    if len(xs) < 2:
+        return float("nan"), float("nan")
+    mx = sum(xs) / len(xs)
+    my = sum(ys) / len(ys)
+    sxx = sum((x - mx) ** 2 for x in xs)
+    b = sum((x - mx) * (y - my) for x, y in zip(xs, ys)) / sxx if sxx else float("nan")
+    return math.exp(my - b * mx), b
+
+
+def local_exponents(points):
+    out = []
+    for (n0, y0), (n1, y1) in zip(points, points[1:]):
+        if y0 > 0 and y1 > 0 and n1 > n0:
+            out.append((n1, math.log(y1 / y0) / math.log(float(n1) / n0)))
+    return out
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--ns3-dir", default=".", help="ns-3 source tree containing waf and the scratch programs")
+    parser.add_argument("--program", choices=["building_sim", "building-sim-lena"], default="building_sim")
+    parser.add_argument("--min-ues", type=int, default=16)
+    parser.add_argument("--max-ues", type=int, default=100000)
+    parser.add_argument("--sim-time", type=float, default=0.5, help="simulated seconds per point")
+    parser.add_argument("--rb", type=int, default=6, help="building_sim bandwidth in RBs")
+    parser.add_argument("--scheduler", default="rr")
+    parser.add_argument("--macro-fraction", type=float, default=0.5,
+                        help="building-sim-lena share of macro UEs")
+    parser.add_argument("--set", action="append", default=[], metavar="NAME=VALUE",
+                        help="extra GlobalValue for every point")
+    parser.add_argument("--linear-limit", type=float, default=1.2,
+                        help="local exponent above which a metric is reported as superlinear")
+    parser.add_argument("--out", default="scaling.jsonl")
+    parser.add_argument("--keep", action="store_true", help="keep the per-point working directories")
+    args = parser.parse_args()
+
+    ns3_dir = os.path.abspath(args.ns3_dir)
+    subprocess.check_call([os.path.join(ns3_dir, "waf"), "build"], cwd=ns3_dir)
+
+    results = []
+    with open(args.out, "w") as out:
+        for n in ue_counts(args.min_ues, args.max_ues):
+            prog_args, settings = scenario(args.program, n, args)
+            workdir = tempfile.mkdtemp(prefix="scaling-%s-%d-" % (args.program, n))
+            try:
+                done = run_program(ns3_dir, args.program, prog_args, settings, workdir)
+            except RuntimeError as e:
+                print("n=%d: %s; stopping the sweep" % (n, e))
+                break
+            finally:
+                if not args.keep:
+                    shutil.rmtree(workdir, ignore_errors=True)
+            point = {
+                "ues": n,
+                "args": prog_args,
+                "settings": settings,
+                "setup_wall_s": done["setup_wall_s"],
+                "wall_per_sim_s": done["wall_s"] / done["sim_s"] if done["sim_s"] > 0 else float("nan"),
+                "peak_rss_kb": done["peak_rss_kb"],
+                "events_per_s": done["events_per_s"],
+            }
+            results.append(point)
+            out.write(json.dumps(point) + "\n")
+            out.flush()
+            print("n=%-7d setup %9.2f s  run %9.2f s/sim s  peak %10d kB"
+                  % (n, point["setup_wall_s"], point["wall_per_sim_s"], point["peak_rss_kb"]))
+
+        print()
+        for metric in METRICS:
+            points = [(r["ues"], r[metric]) for r in results]
+            a, b = fit_power_law(points)
+            superlinear = [n for n, e in local_exponents(points) if e > args.linear_limit]
+            print("%-15s ~ %.3g * n^%.2f%s" % (metric, a, b,
+                  "; superlinear from n=%d" % superlinear[0] if superlinear else ""))
+            out.write(json.dumps({"fit": metric, "a": a, "b": b,
+                                  "local_exponents": local_exponents(points)}) + "\n")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,420 @@
+#ifndef WRAP_AROUND_PROPAGATION_LOSS_MODEL_H
+#define WRAP_AROUND_PROPAGATION_LOSS_MODEL_H
+
+#include "ns3/core-module.h"
+#include "ns3/mobility-module.h"
+#include "ns3/lte-module.h"
+#include "ns3/buildings-module.h"
+#include "ns3/propagation-loss-model.h"
+
+#include <cmath>
+#include <map>
+#include <vector>
+
+namespace ns3 {
+
+// Lattice shifts of a compact hexagonal cluster of N = 3k(k+1)+1 sites with the
+// given inter-site distance: the cluster tiles the plane when copied along these
+// six vectors, which gives the 3GPP wrap-around (toroidal) geometry.
+inline std::vector<Vector>
+GetHexClusterShifts (uint32_t nSites, double interSiteDistance)
+{
+  uint32_t i = 0;
+  uint32_t j = 0;
+  for (uint32_t a = 1; a <= nSites && i == 0; ++a)
+  {
+      for (uint32_t b = 0; b < a; ++b)
+      {
+          if (a * a + a * b + b * b == nSites)
+          {
+              i = a;
+              j = b;
+              break;
+          }
+      }
+  }
+  NS_ABORT_MSG_IF (i == 0, "No hexagonal cluster with " << nSites << " sites");
+  // i steps along (d, 0) and j along (d/2, d*sqrt(3)/2)
+  double x = interSiteDistance * (i + 0.5 * j);
+  double y = interSiteDistance * std::sqrt (0.75) * j;
+  std::vector<Vector> shifts;
+  for (uint32_t k = 0; k < 6; ++k)
+  {
+      double angle = k * M_PI / 3;
+      shifts.push_back (Vector (x * std::cos (angle) - y * std::sin (angle),
+                                x * std::sin (angle) + y * std::cos (angle), 0.0));
+  }
+  return shifts;
+}
+
+// Site positions of a compact hexagonal cluster around center, ring by ring
+inline std::vector<Vector>
+GetHexClusterSites (uint32_t nSites, double interSiteDistance, Vector center)
+{
+  int32_t rings = 0;
+  while (3 * (rings + 1) * (rings + 2) + 1 <= (int32_t) nSites)
+  {
+      ++rings;
+  }
+  NS_ABORT_MSG_IF ((uint32_t) (3 * rings * (rings + 1) + 1) != nSites,
+                   "Wrap-around needs a compact cluster of 1, 7, 19, 37, ... sites, not " << nSites);
+  std::vector<Vector> sites;
+  for (int32_t ring = 0; ring <= rings; ++ring)
+  {
+      for (int32_t q = -ring; q <= ring; ++q)
+      {
+          for (int32_t r = -ring; r <= ring; ++r)
+          {
+              int32_t s = -q - r;
+              if (std::max (std::abs (q), std::max (std::abs (r), std::abs (s))) != ring)
+              {
+                  continue;
+              }
+              sites.push_back (Vector (center.x + interSiteDistance * (q + 0.5 * r),
+                                       center.y + interSiteDistance * std::sqrt (0.75) * r,
+                                       center.z));
+          }
+      }
+  }
+  return sites;
+}
+
+// Wraps another propagation loss model onto the torus defined by a hexagonal
+// cluster: every link is evaluated towards the closest image of the outdoor
+// end, so the border cells of a 7-site cluster see the same interference as
+// the centre cell of a large grid.  Images are only taken of outdoor nodes
+// (buildings exist once), and the eNB antenna gains, which the spectrum
+// channel computes from the real positions, are corrected for the image
+// direction.
+class WrapAroundPropagationLossModel : public PropagationLossModel
+{
+public:
+  static TypeId GetTypeId ();
+  WrapAroundPropagationLossModel ();
+
+  Vector GetClosestImage (Vector a, Vector b) const;
+  Vector WrapToCluster (Vector p) const;
+
+protected:
+  virtual void NotifyConstructionCompleted ();
+
+private:
+  virtual double DoCalcRxPower (double txPowerDbm, Ptr<MobilityModel> a, Ptr<MobilityModel> b) const;
+  virtual int64_t DoAssignStreams (int64_t stream);
+
+  void SetFrequency (double frequency);
+  double GetFrequency () const;
+  Ptr<PropagationLossModel> GetInner () const;
+  Ptr<MobilityModel> GetImage (Ptr<MobilityModel> node, uint32_t shift, bool forward) const;
+  Ptr<AntennaModel> GetEnbAntenna (Ptr<MobilityModel> node) const;
+  double AntennaGainCorrection (Ptr<MobilityModel> from, Vector realPeer, Vector imagePeer) const;
+
+  std::string m_innerModelType;
+  double m_frequency;
+  double m_interSiteDistance;
+  uint32_t m_clusterSize;
+  double m_centerX;
+  double m_centerY;
+  std::vector<Vector> m_shifts;
+
+  mutable Ptr<PropagationLossModel> m_inner;
+  mutable std::map<std::pair<MobilityModel *, uint32_t>, Ptr<MobilityModel> > m_images;
+  mutable std::map<MobilityModel *, Ptr<AntennaModel> > m_antennas;
+};
+
+NS_OBJECT_ENSURE_REGISTERED (WrapAroundPropagationLossModel);
+
+inline TypeId
+WrapAroundPropagationLossModel::GetTypeId ()
+{
+  static TypeId tid = TypeId ("ns3::WrapAroundPropagationLossModel")
+    .SetParent<PropagationLossModel> ()
+    .AddConstructor<WrapAroundPropagationLossModel> ()
+    .AddAttribute ("InnerModelType",
+                   "TypeId of the propagation loss model evaluated on the wrapped geometry",
+                   StringValue ("ns3::HybridBuildingsPropagationLossModel"),
+                   MakeStringAccessor (&WrapAroundPropagationLossModel::m_innerModelType),
+                   MakeStringChecker ())
+    .AddAttribute ("Frequency",
+                   "Carrier frequency [Hz], forwarded to the inner model",
+                   DoubleValue (2160e6),
+                   MakeDoubleAccessor (&WrapAroundPropagationLossModel::SetFrequency,
+                                       &WrapAroundPropagationLossModel::GetFrequency),
+                   MakeDoubleChecker<double> ())
+    .AddAttribute ("InterSiteDistance",
+                   "Distance between two neighbouring sites of the cluster [m]",
+                   DoubleValue (500),
+                   MakeDoubleAccessor (&WrapAroundPropagationLossModel::m_interSiteDistance),
+                   MakeDoubleChecker<double> ())
+    .AddAttribute ("ClusterSize",
+                   "Number of sites in the hexagonal cluster",
+                   UintegerValue (7),
+                   MakeUintegerAccessor (&WrapAroundPropagationLossModel::m_clusterSize),
+                   MakeUintegerChecker<uint32_t> (1))
+    .AddAttribute ("CenterX",
+                   "X coordinate of the cluster centre [m]",
+                   DoubleValue (0),
+                   MakeDoubleAccessor (&WrapAroundPropagationLossModel::m_centerX),
+                   MakeDoubleChecker<double> ())
+    .AddAttribute ("CenterY",
+                   "Y coordinate of the cluster centre [m]",
+                   DoubleValue (0),
+                   MakeDoubleAccessor (&WrapAroundPropagationLossModel::m_centerY),
+                   MakeDoubleChecker<double> ())
+  ;
+  return tid;
+}
+
+inline
+WrapAroundPropagationLossModel::WrapAroundPropagationLossModel ()
+  : m_frequency (2160e6),
+    m_interSiteDistance (500),
+    m_clusterSize (7),
+    m_centerX (0),
+    m_centerY (0)
+{
+}
+
+inline void
+WrapAroundPropagationLossModel::NotifyConstructionCompleted ()
+{
+  m_shifts = GetHexClusterShifts (m_clusterSize, m_interSiteDistance);
+  PropagationLossModel::NotifyConstructionCompleted ();
+}
+
+inline void
+WrapAroundPropagationLossModel::SetFrequency (double frequency)
+{
+  m_frequency = frequency;
+  if (m_inner)
+  {
+      m_inner->SetAttributeFailSafe ("Frequency", DoubleValue (frequency));
+  }
+}
+
+inline double
+WrapAroundPropagationLossModel::GetFrequency () const
+{
+  return m_frequency;
+}
+
+inline Ptr<PropagationLossModel>
+WrapAroundPropagationLossModel::GetInner () const
+{
+  if (!m_inner)
+  {
+      ObjectFactory factory;
+      factory.SetTypeId (m_innerModelType);
+      m_inner = factory.Create<PropagationLossModel> ();
+      m_inner->SetAttributeFailSafe ("Frequency", DoubleValue (m_frequency));
+  }
+  return m_inner;
+}
+
+// Image of b (among b and its six lattice copies) closest to a
+inline Vector
+WrapAroundPropagationLossModel::GetClosestImage (Vector a, Vector b) const
+{
+  Vector best = b;
+  double bestDistance = CalculateDistance (a, b);
+  for (std::vector<Vector>::const_iterator it = m_shifts.begin (); it != m_shifts.end (); ++it)
+  {
+      Vector image (b.x + it->x, b.y + it->y, b.z);
+      double distance = CalculateDistance (a, image);
+      if (distance < bestDistance)
+      {
+          best = image;
+          bestDistance = distance;
+      }
+  }
+  return best;
+}
+
+inline Vector
+WrapAroundPropagationLossModel::WrapToCluster (Vector p) const
+{
+  return GetClosestImage (Vector (m_centerX, m_centerY, p.z), p);
+}
+
+inline Ptr<MobilityModel>
+WrapAroundPropagationLossModel::GetImage (Ptr<MobilityModel> node, uint32_t shift, bool forward) const
+{
+  std::pair<MobilityModel *, uint32_t> key (PeekPointer (node), forward ? shift : shift + 6);
+  Ptr<MobilityModel> &image = m_images[key];
+  if (!image)
+  {
+      image = CreateObject<ConstantPositionMobilityModel> ();
+      image->AggregateObject (CreateObject<MobilityBuildingInfo> ());
+  }
+  Vector position = node->GetPosition ();
+  double sign = forward ? 1.0 : -1.0;
+  position.x += sign * m_shifts[shift].x;
+  position.y += sign * m_shifts[shift].y;
+  if (CalculateDistance (position, image->GetPosition ()) > 0)
+  {
+      image->SetPosition (position);
+      BuildingsHelper::MakeConsistent (image);
+  }
+  return image;
+}
+
+inline Ptr<AntennaModel>
+WrapAroundPropagationLossModel::GetEnbAntenna (Ptr<MobilityModel> node) const
+{
+  std::map<MobilityModel *, Ptr<AntennaModel> >::iterator it = m_antennas.find (PeekPointer (node));
+  if (it != m_antennas.end ())
+  {
+      return it->second;
+  }
+  Ptr<AntennaModel> antenna;
+  Ptr<Node> n = node->GetObject<Node> ();
+  for (uint32_t i = 0; n && i < n->GetNDevices (); ++i)
+  {
+      Ptr<LteEnbNetDevice> enbDev = DynamicCast<LteEnbNetDevice> (n->GetDevice (i));
+      if (enbDev)
+      {
+          antenna = enbDev->GetPhy ()->GetDownlinkSpectrumPhy ()->GetRxAntenna ();
+      }
+  }
+  m_antennas[PeekPointer (node)] = antenna;
+  return antenna;
+}
+
+inline double
+WrapAroundPropagationLossModel::AntennaGainCorrection (Ptr<MobilityModel> from, Vector realPeer, Vector imagePeer) const
+{
+  Ptr<AntennaModel> antenna = GetEnbAntenna (from);
+  if (!antenna)
+  {
+      return 0.0;
+  }
+  Vector position = from->GetPosition ();
+  return antenna->GetGainDb (Angles (imagePeer, position)) - antenna->GetGainDb (Angles (realPeer, position));
+}
+
+inline double
+WrapAroundPropagationLossModel::DoCalcRxPower (double txPowerDbm, Ptr<MobilityModel> a, Ptr<MobilityModel> b) const
+{
+  Vector aPos = a->GetPosition ();
+  Vector bPos = b->GetPosition ();
+  double bestDistance = CalculateDistance (aPos, bPos);
+  int32_t best = -1;
+  for (uint32_t k = 0; k < m_shifts.size (); ++k)
+  {
+      double distance = CalculateDistance (Vector (aPos.x + m_shifts[k].x, aPos.y + m_shifts[k].y, aPos.z), bPos);
+      if (distance < bestDistance)
+      {
+          best = k;
+          bestDistance = distance;
+      }
+  }
+  if (best < 0)
+  {
+      return GetInner ()->CalcRxPower (txPowerDbm, a, b);
+  }
+
+  Ptr<MobilityBuildingInfo> aInfo = a->GetObject<MobilityBuildingInfo> ();
+  Ptr<MobilityBuildingInfo> bInfo = b->GetObject<MobilityBuildingInfo> ();
+  bool aIndoor = aInfo && aInfo->IsIndoor ();
+  bool bIndoor = bInfo && bInfo->IsIndoor ();
+  if (aIndoor && bIndoor)
+  {
+      // buildings are not replicated, the walls of both ends dominate anyway
+      return GetInner ()->CalcRxPower (txPowerDbm, a, b);
+  }
+
+  // move the outdoor end: a forward by the shift, or b backwards by it
+  double rxPower;
+  if (!aIndoor)
+  {
+      rxPower = GetInner ()->CalcRxPower (txPowerDbm, GetImage (a, best, true), b);
+  }
+  else
+  {
+      rxPower = GetInner ()->CalcRxPower (txPowerDbm, a, GetImage (b, best, false));
+  }
+  Vector shift = m_shifts[best];
+  Vector bSeenFromA (bPos.x - shift.x, bPos.y - shift.y, bPos.z);
+  Vector aSeenFromB (aPos.x + shift.x, aPos.y + shift.y, aPos.z);
+  return rxPower + AntennaGainCorrection (a, bPos, bSeenFromA) + AntennaGainCorrection (b, aPos, aSeenFromB);
+}
+
+inline int64_t
+WrapAroundPropagationLossModel::DoAssignStreams (int64_t stream)
+{
+  return GetInner ()->AssignStreams (stream);
+}
+
+// Uniform positions inside the hexagonal cluster region (the fundamental
+// domain of the wrap-around torus), by rejection from its bounding box
+class HexClusterPositionAllocator : public PositionAllocator
+{
+public:
+  static TypeId GetTypeId ();
+  HexClusterPositionAllocator ();
+  void SetCluster (Ptr<WrapAroundPropagationLossModel> wrap, Vector center, double radius, double z);
+  virtual Vector GetNext () const;
+  virtual int64_t AssignStreams (int64_t stream);
+
+private:
+  Ptr<WrapAroundPropagationLossModel> m_wrap;
+  Vector m_center;
+  double m_radius;
+  double m_z;
+  Ptr<UniformRandomVariable> m_rand;
+};
+
+NS_OBJECT_ENSURE_REGISTERED (HexClusterPositionAllocator);
+
+inline TypeId
+HexClusterPositionAllocator::GetTypeId ()
+{
+  static TypeId tid = TypeId ("ns3::HexClusterPositionAllocator")
+    .SetParent<PositionAllocator> ()
+    .AddConstructor<HexClusterPositionAllocator> ()
+  ;
+  return tid;
+}
+
+inline
+HexClusterPositionAllocator::HexClusterPositionAllocator ()
+  : m_radius (0),
+    m_z (0)
+{
+  m_rand = CreateObject<UniformRandomVariable> ();
+}
+
+inline void
+HexClusterPositionAllocator::SetCluster (Ptr<WrapAroundPropagationLossModel> wrap, Vector center, double radius, double z)
+{
+  m_wrap = wrap;
+  m_center = center;
+  m_radius = radius;
+  m_z = z;
+}
+
+inline Vector
+HexClusterPositionAllocator::GetNext () const
+{
+  while (true)
+  {
+      Vector p (m_rand->GetValue (m_center.x - m_radius, m_center.x + m_radius),
+                m_rand->GetValue (m_center.y - m_radius, m_center.y + m_radius),
+                m_z);
+      if (CalculateDistance (m_wrap->WrapToCluster (p), p) == 0)
+      {
+          return p;
+      }
+  }
+}
+
+inline int64_t
+HexClusterPositionAllocator::AssignStreams (int64_t stream)
+{
+  m_rand->SetStream (stream);
+  return 1;
+}
+
+} // namespace ns3
+
+#endif // WRAP_AROUND_PROPAGATION_LOSS_MODEL_H